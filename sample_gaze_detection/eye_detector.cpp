@@ -104,6 +104,8 @@ void detectEyes(cv::Mat &frame, cv::CascadeClassifier &faceCascade, cv::CascadeC
       cv::Vec3f eyeball = getEyeball(eye, circles);
       cv::Point center(eyeball[0], eyeball[1]);
       centers.push_back(center);
+      // Only the last few are ever averaged; don't keep every center since startup.
+      if (centers.size() > 5) centers.erase(centers.begin());
       center = stabilize(centers, 5);
       if (centers.size() > 1)
       {
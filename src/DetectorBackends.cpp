@@ -0,0 +1,335 @@
+#include "DetectorBackends.h"
+
+#include <algorithm>
+
+// Haar cascade files for face and eye detection. The compiled binary cascades (see
+// eye_mouse_cascade_compile) load much faster and are used when they're there.
+std::string haar_face_file = "haarcascades/haarcascade_frontalface_alt.xml";
+std::string haar_eye_file = "haarcascades/haarcascade_eye.xml";
+std::string haar_face_binary_file = "haarcascades/haarcascade_frontalface_alt.bin";
+std::string haar_eye_binary_file = "haarcascades/haarcascade_eye.bin";
+
+// Where to look for each eye, as fractions of the face rectangle: a band across the upper face,
+// split into an inner and outer edge per side (x is for the eye on the left of the image, the
+// other side is mirrored).
+const double EYE_WINDOW_TOP = .15;
+const double EYE_WINDOW_BOTTOM = .6;
+const double EYE_WINDOW_INNER_X = .05;
+const double EYE_WINDOW_OUTER_X = .58;
+
+// Eye detection sizes, as fractions of the face width.
+const double MIN_EYE_FRACTION = .16;
+const double MAX_EYE_FRACTION = .4;
+
+// How far around the last frame's eye to search, as a fraction of its size on each side.
+const double PREVIOUS_EYE_MARGIN = .75;
+
+// An eye detection covering more than this fraction of the other eye's (or the other eye covering
+// more than this of it) is the other eye, found again where the windows overlap.
+const double SAME_EYE_OVERLAP = .5;
+
+// The smallest face (pixels, in camera frames) the Haar cascade looks for: someone sitting at a
+// webcam, not people in the background.
+const int MIN_HAAR_FACE = 250;
+
+#if EYEMOUSE_WITH_DNN
+// NN model files for OpenCV_DNN
+std::string caffe_model = "res10_300x300_ssd_iter_140000.caffemodel";
+std::string caffe_fp16_model = "res10_300x300_ssd_iter_140000_fp16.caffemodel";
+std::string prototxt_file = "deploy.prototxt";
+std::string tf_uint8_model = "opencv_face_detector_uint8.pb";
+std::string tf_config_file = "opencv_face_detector.pbtxt";
+
+// Per channel (B, G, R) mean the SSD face detector was trained with.
+const cv::Scalar DNN_MEAN(104, 177, 123);
+
+// OpenCV's thread count before a DnnConfig changed it, or -1 if none has. cv::setNumThreads() is
+// process-wide, so a later config asking for the default has to put this back.
+static int default_threads = -1;
+
+static void set_dnn_threads(int threads) {
+    if (threads > 0) {
+        if (default_threads < 0) default_threads = cv::getNumThreads();
+        cv::setNumThreads(threads);
+    } else if (default_threads >= 0) {
+        cv::setNumThreads(default_threads);
+        default_threads = -1;
+    }
+}
+#endif
+
+#if EYEMOUSE_WITH_DLIB
+// Cascade file for the dlib cascade.
+std::string dlib_68_file = "shape_predictor_68_face_landmarks.dat";
+#endif
+
+void HaarBackend::load() {
+    if (!face_cascade_.load(haar_face_binary_file)) face_cascade_.load(haar_face_file);
+    if (!eye_cascade_.load(haar_eye_binary_file)) eye_cascade_.load(haar_eye_file);
+}
+
+void HaarBackend::detect(cv::Mat &frame, DetectorState &state) {
+    cv::Mat gray;
+    std::vector<cv::Rect> faces;
+
+    // Eyes from the last frame (detected or tracked), to narrow this frame's search.
+    bool had_eyes = state.found;
+
+    state.found = false;
+    state.eyes_missed = false;
+    if (frame.empty()) return;
+    cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+    int min_face = cvRound(MIN_HAAR_FACE * state.image_scale);
+    face_cascade_.detectMultiScale(gray, faces, 1.1, 2, cv::Size(min_face, min_face));
+
+    if (faces.size() == 0) return;
+    cv::Rect face = faces[0];
+
+    state.face.setCoords(face);
+
+    // Search for each eye on its own side of the upper face, at the sizes an eye of this face can
+    // be. The right eye is the one on the left of the image (mirror image).
+    cv::Rect r_eye, l_eye;
+    double r_weight, l_weight;
+    if (!_detectEye(gray, face, state.right.getCoords(), had_eyes, true, cv::Rect(), r_eye, r_weight) ||
+        !_detectEye(gray, face, state.left.getCoords(), had_eyes, false, r_eye, l_eye, l_weight)) {
+        state.eyes_missed = true;
+        return;
+    }
+
+    state.right.setCoords(r_eye);
+    state.right.setConfidence(r_weight);
+
+    state.left.setCoords(l_eye);
+    state.left.setConfidence(l_weight);
+    state.found = true;
+}
+
+int HaarBackend::mostConfident(const std::vector<cv::Rect>& eyes, const std::vector<double>& weights,
+                               const cv::Point& window_tl, const cv::Rect& other) {
+    int best = -1;
+    for (size_t i = 0; i < eyes.size(); ++i) {
+        if (best >= 0 && weights[i] <= weights[best]) continue;
+        cv::Rect overlap = (eyes[i] + window_tl) & other;
+        if (overlap.area() > SAME_EYE_OVERLAP * std::min(eyes[i].area(), other.area())) continue;
+        best = i;
+    }
+    return best;
+}
+
+cv::Rect HaarBackend::_eyeSearchWindow(const cv::Rect& face, bool image_left) {
+    double x0 = image_left ? EYE_WINDOW_INNER_X : 1 - EYE_WINDOW_OUTER_X;
+    double x1 = image_left ? EYE_WINDOW_OUTER_X : 1 - EYE_WINDOW_INNER_X;
+
+    return cv::Rect(cv::Point(face.x + cvRound(face.width * x0), face.y + cvRound(face.height * EYE_WINDOW_TOP)),
+                    cv::Point(face.x + cvRound(face.width * x1), face.y + cvRound(face.height * EYE_WINDOW_BOTTOM)));
+}
+
+bool HaarBackend::_detectEye(const cv::Mat& gray, const cv::Rect& face, const cv::Rect& previous, bool use_previous,
+                             bool image_left, const cv::Rect& other, cv::Rect& eye, double& weight) {
+    cv::Size min_size(cvRound(face.width * MIN_EYE_FRACTION), cvRound(face.width * MIN_EYE_FRACTION));
+    cv::Size max_size(cvRound(face.width * MAX_EYE_FRACTION), cvRound(face.width * MAX_EYE_FRACTION));
+
+    cv::Rect geometry = _eyeSearchWindow(face, image_left) & cv::Rect(0, 0, gray.cols, gray.rows);
+
+    // Where the eye was is a tighter guess than where eyes usually are, if it's still plausible
+    // for this face.
+    cv::Rect window = geometry;
+    if (use_previous && (previous & geometry).area() > 0) {
+        int margin_x = cvRound(previous.width * PREVIOUS_EYE_MARGIN);
+        int margin_y = cvRound(previous.height * PREVIOUS_EYE_MARGIN);
+        cv::Rect around(previous.x - margin_x, previous.y - margin_y,
+                        previous.width + 2 * margin_x, previous.height + 2 * margin_y);
+        around &= geometry;
+        if (around.width >= max_size.width && around.height >= max_size.height) window = around;
+    }
+
+    for (;;) {
+        std::vector<cv::Rect> eyes;
+        std::vector<int> levels;
+        std::vector<double> weights;
+
+        if (window.width >= min_size.width && window.height >= min_size.height) {
+            eye_cascade_.detectMultiScale(gray(window), eyes, levels, weights, 1.1, 3, min_size, max_size);
+        }
+
+        int best = mostConfident(eyes, weights, window.tl(), other);
+        if (best >= 0) {
+            eye = eyes[best] + window.tl();
+            weight = weights[best];
+            return true;
+        }
+
+        // Nothing near the last position; look over the whole band before giving up.
+        if (window == geometry) return false;
+        window = geometry;
+    }
+}
+
+#if EYEMOUSE_WITH_DNN
+
+void DnnBackend::setConfig(const DnnConfig &config) {
+    if (!net_.empty() && config.precision != config_.precision) {
+        _load(config);
+        return;
+    }
+
+    config_ = config;
+    if (net_.empty()) return;
+
+    net_.setPreferableBackend(config_.backend);
+    net_.setPreferableTarget(config_.target);
+    set_dnn_threads(config_.threads);
+}
+
+void DnnBackend::_load(const DnnConfig &config) {
+    // Read the trained neural net from file, in whichever format the precision comes in. Throws
+    // (leaving the current net and settings alone) if the files can't be read.
+    cv::dnn::Net net;
+    switch (config.precision) {
+    case DnnFP32:
+        net = cv::dnn::readNetFromCaffe(prototxt_file, caffe_model);
+        break;
+    case DnnFP16:
+        net = cv::dnn::readNetFromCaffe(prototxt_file, caffe_fp16_model);
+        break;
+    case DnnINT8:
+        net = cv::dnn::readNetFromTensorflow(tf_uint8_model, tf_config_file);
+        break;
+    }
+
+    net.setPreferableBackend(config.backend);
+    net.setPreferableTarget(config.target);
+    set_dnn_threads(config.threads);
+
+    net_ = net;
+    config_ = config;
+}
+
+void DnnBackend::detect(cv::Mat &frame, DetectorState &state) {
+	state.found = false;
+
+	// From https://github.com/opencv/opencv/tree/master/samples/dnn:
+	//   "To achieve the best accuracy run the model on BGR images resized
+	//   to 300x300 applying mean subtraction of values (104, 177, 123) for
+	//   each blue, green and red channels correspondingly."
+	// Smaller input sizes (see DnnConfig) are much cheaper. The blob is written in place so its
+	// buffer is reused between frames.
+	int input_size = config_.input_size;
+	cv::dnn::blobFromImage(frame, blob_, 1.0, cv::Size(input_size, input_size), DNN_MEAN, false, false);
+
+	// Perform forward pass on the current frame - returns a matrix of potential faces.
+	// For unknown reason, the matrix is always 1x1x200x7. There are 200 potential
+	// faces (why the excess dimensions in front?), each with 7 features, the
+	// relevant ones being:
+	// 				faces[0,0,i,2] - Float showing the confidence (<1) the ith rectangle is a face
+	//				faces[0,0,i,3] - Float showing the scale of the width of the starting x coord. Multiply by width
+	//												 for pixel value of the starting x coord.
+	//				faces[0,0,i,4] - Float showing the scale of the width of the starting y coord. Multiply by width
+	//												 for pixel value of the starting y coord.
+	//				faces[0,0,i,5] - Float showing the scale of the width of the ending x coord. Multiply by width
+	//												 for pixel value of the ending x coord.
+	//				faces[0,0,i,6] - Float showing the scale of the width of the ending y coord. Multiply by width
+	//												 for pixel value of the ending y coord.
+	net_.setInput(blob_);
+	cv::Mat output = net_.forward();
+
+	// View the 1x1xNx7 output as an Nx7 matrix so we can index it by row.
+	cv::Mat faces(output.size[2], output.size[3], CV_32F, output.ptr<float>());
+
+	// Iterate through all the potential faces and keep the most confident one.
+	float best_confidence = FACE_CONFIDENCE_THRESHOLD;
+	for (int i = 0; i < faces.rows; ++i) {
+		float confidence = faces.at<float>(i, 2);
+		// std::cout << "Confidence: " << faces.at<float>(i, 2) << std::endl;
+
+		if (confidence > best_confidence) {
+			// Extract the bounding rectangle, clamped to the frame (the net can go over the edges).
+			int x    = std::max(0.0f, faces.at<float>(i, 3)) * state.width;
+			int y    = std::max(0.0f, faces.at<float>(i, 4)) * state.height;
+			int endX = std::min(1.0f, faces.at<float>(i, 5)) * state.width;
+			int endY = std::min(1.0f, faces.at<float>(i, 6)) * state.height;
+			if (endX <= x || endY <= y) continue;
+
+            // Draw the bounding rectangle and save it with our confidence to our face object
+            // camux::drawRectangle(frame, x, y, endX, endY);
+            state.face.setCoords(x, y, endX, endY);
+            state.face.setConfidence(confidence);
+            best_confidence = confidence;
+            state.found = true;
+
+			// cv::putText(frame, std::to_string(confidence * 100) + "%", cv::Point(x, y - 10), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(0, 0, 255));
+        }
+	}
+}
+
+#endif
+
+#if EYEMOUSE_WITH_DLIB
+
+void DlibBackend::load() {
+    // Initialze the dlib facial detector
+    detector_ = dlib::get_frontal_face_detector();
+    // Load the trained cascade of trees from file.
+    dlib::deserialize(dlib_68_file) >> predictor_;
+}
+
+void DlibBackend::detect(cv::Mat &frame, DetectorState &state) {
+    state.found = false;
+    if (frame.empty()) return;
+
+    // Convert the opencv frame to a dlib format and run it through the cascade
+    dlib::cv_image<dlib::rgb_pixel> dlib_frame(frame);
+    std::vector<dlib::rectangle> faces = detector_(dlib_frame);
+
+    // Nothing to draw if we don't detect any faces
+    if (faces.empty()) return;
+
+    state.landmarks.clear();
+    // Define an OpenCV rectangle on the outermost boundaries of the landmarks
+    int x    = faces[0].left();
+    int y    = faces[0].top();
+    int endX = x + faces[0].width();
+    int endY = y + faces[0].height();
+
+    // Draw the bounding rectangle and save it to our face object
+    // camux::drawRectangle(frame, x, y, endX, endY);
+    state.face.setCoords(x, y, endX, endY);
+
+    // We use our shape predictor to get all 68 landmark points from the face detector
+    dlib::full_object_detection shape = predictor_(dlib_frame, faces[0]);
+    camux::Points l_eye, r_eye;
+    state.shape.clear();
+
+    // Go through each of the landmarks, convert it to an OpenCV Point, and draw it on the frame.
+    for(int i = 0; i < shape.num_parts(); ++i){
+        cv::Point2u p(shape.part(i).x(), shape.part(i).y());
+        state.shape.push_back(cv::Point2f(shape.part(i).x(), shape.part(i).y()));
+
+        // Left Eye landmarks
+        if (i >= 36 && i <= 41) {
+            // cv::circle(frame, p, 2.0, cv::Scalar(0, 255, 255), 1, 8);
+            l_eye.push_back(p);
+        }
+        // Right Eye landmarks
+        else if (i >= 42 && i <= 47) {
+            // cv::circle(frame, p, 2.0, cv::Scalar(255, 255, 0), 1, 8);
+            r_eye.push_back(p);
+        } else {
+            state.landmarks.push_back(p);
+        }
+    }
+
+    state.left.setCoords(camux::boundingRectMargin(l_eye, .5, .5));
+    state.right.setCoords(camux::boundingRectMargin(r_eye, .5, .5));
+
+    // The eyes use these for the eye aspect ratio (blink detection).
+    state.left.setLandmarks(l_eye);
+    state.right.setLandmarks(r_eye);
+    state.found = true;
+
+    // camux::drawRectangle(frame, state.left.getCoords());
+    // camux::drawRectangle(frame, state.right.getCoords());
+}
+
+#endif
@@ -0,0 +1,265 @@
+#pragma once
+
+#include "camux/Cascade.h"
+#include "camux/Eye.h"
+#include "camux/Face.h"
+#include "camux/geometry.hpp"
+
+#include <opencv2/imgproc.hpp>
+
+// Which optional backends are built (see the EYEMOUSE_WITH_* CMake options). The Haar cascades are
+// always there.
+#ifndef EYEMOUSE_WITH_DNN
+#define EYEMOUSE_WITH_DNN 1
+#endif
+#ifndef EYEMOUSE_WITH_DLIB
+#define EYEMOUSE_WITH_DLIB 1
+#endif
+
+#if EYEMOUSE_WITH_DNN
+#include <opencv2/dnn.hpp>
+#endif
+
+#if EYEMOUSE_WITH_DLIB
+#include <dlib/image_processing/frontal_face_detector.h>
+#include <dlib/image_processing/shape_predictor.h>
+#include <dlib/image_processing.h>
+#include <dlib/opencv/cv_image.h>
+#endif
+
+#include <vector>
+
+
+// Tunable confidence threshold (>0, <1.0) for deciding if a feature is a face
+const float FACE_CONFIDENCE_THRESHOLD = 0.6;
+
+/**
+ * @brief The different types of face detection methods
+ *
+ * OpenCv_DNN: A pretrained deep neural network trained to find faces.
+ *  Pros: Most accurate of the three. Second fastest (50-100 ms latency)
+ *  Cons: No eye location provided - need to train a model for that
+ *
+ * Dlib 68 landmark locator: Pre trained cascade of regression trees.
+ *  Pros: Locates 68 different facial landmarks, including 6 surrounding the eyes
+ *  Cons: Slowest (~150 ms latency). Not as accurate as DNN (needs to be front facing)
+ *
+ * Haar Cascades:
+ *  Pros:
+ *  Cons:
+ */
+enum Detector {
+    OpenCV_DNN,
+    Dlib_68,
+    HaarCascade
+};
+
+/**
+ * @brief What a detection finds besides the face, which decides how it's followed with optical
+ * flow until the next one.
+ */
+enum DetectorFeatures {
+    // Just the face (OpenCV_DNN).
+    FaceOnly,
+    // The face and a box per eye (HaarCascade).
+    FaceAndEyes,
+    // The face's 68 landmarks, the eyes' included (Dlib_68).
+    FaceLandmarks
+};
+
+/**
+ * @brief Where a backend writes what it found. Shared with the optical flow tracking that moves it
+ * along between detections (see FaceEyeDetectorBase).
+ */
+struct DetectorState {
+    DetectorState(camux::Face &face, camux::Eye &left, camux::Eye &right) : face(face), left(left), right(right) {}
+
+    camux::Face &face;
+    camux::Eye &left;
+    camux::Eye &right;
+
+    // Whether the last detection/tracking step found a face.
+    bool found = false;
+    // Whether the last detection found a face but not both of its eyes, so found is false anyway
+    // (HaarCascade only: the eye cascade found nothing in one side of the face).
+    bool eyes_missed = false;
+
+    // The facial landmarks other than the eyes', and all 68 for seeding the tracker (Dlib_68 only).
+    std::vector<cv::Point2u> landmarks;
+    std::vector<cv::Point2f> shape;
+
+    // The height and width of the last frame used, and how much frames are scaled from the
+    // camera's (see FaceEyeDetectorBase::setImageScale()).
+    int width = 0;
+    int height = 0;
+    double image_scale = 1;
+
+    /**
+     * @brief Clip a rectangle to the last frame's bounds.
+     */
+    cv::Rect clip(const cv::Rect &r) const { return r & cv::Rect(0, 0, width, height); }
+};
+
+/**
+ * @brief Haar cascades for the face, then each eye within it.
+ */
+class HaarBackend {
+public:
+    static const Detector method = HaarCascade;
+    static const DetectorFeatures features = FaceAndEyes;
+
+    /**
+     * @brief Load the cascades, preferring the compiled binary ones (see eye_mouse_cascade_compile).
+     */
+    void load();
+
+    /**
+     * @brief Whether both cascades loaded.
+     */
+    bool isLoaded() { return !face_cascade_.empty() && !eye_cascade_.empty(); }
+
+    void detect(cv::Mat &frame, DetectorState &state);
+
+    /**
+     * @brief Which of an eye search's detections _detectEye() picks: the most confident (the first
+     * of equals) that isn't the other eye. The two eyes' search windows overlap across the middle
+     * of the face, so one detection can turn up in both.
+     *
+     * @param eyes The detections, relative to the search window.
+     * @param weights Their confidences.
+     * @param window_tl Where the search window is in the frame.
+     * @param other The other eye, in frame coordinates, or an empty rectangle if it's not known.
+     * @return Its index, or -1 if there is none.
+     */
+    static int mostConfident(const std::vector<cv::Rect>& eyes, const std::vector<double>& weights,
+                             const cv::Point& window_tl, const cv::Rect& other);
+
+private:
+    /**
+     * @brief Where an eye can be in a face: a band of the upper face, on one side.
+     *
+     * @param face The face rectangle.
+     * @param image_left Whether this is the eye on the left of the image (the right eye).
+     */
+    cv::Rect _eyeSearchWindow(const cv::Rect& face, bool image_left);
+
+    /**
+     * @brief Find one eye with the Haar eye cascade, searching only where and at the sizes that
+     * eye can be: around its last position if there is one, otherwise its side of the face.
+     *
+     * @param gray The grayscale frame.
+     * @param face The face the eye belongs to.
+     * @param previous The eye's last position.
+     * @param use_previous Whether previous is from the last frame.
+     * @param image_left Whether this is the eye on the left of the image (the right eye).
+     * @param other The other eye if it's already been found this frame, else an empty rectangle.
+     * @param eye Set to the most confident detection, in frame coordinates.
+     * @param weight Set to that detection's confidence.
+     * @return true If the eye was found.
+     */
+    bool _detectEye(const cv::Mat& gray, const cv::Rect& face, const cv::Rect& previous, bool use_previous,
+                    bool image_left, const cv::Rect& other, cv::Rect& eye, double& weight);
+
+    camux::Cascade face_cascade_;
+    camux::Cascade eye_cascade_;
+};
+
+#if EYEMOUSE_WITH_DNN
+
+/**
+ * @brief Which weights of the SSD face detector OpenCV_DNN loads. All three are the same
+ * network; the smaller ones trade a little recall for load time and memory.
+ *
+ * DnnFP32: res10_300x300_ssd_iter_140000.caffemodel (Caffe, the original)
+ * DnnFP16: res10_300x300_ssd_iter_140000_fp16.caffemodel (Caffe, half precision weights)
+ * DnnINT8: opencv_face_detector_uint8.pb (TensorFlow, 8 bit quantized weights)
+ */
+enum DnnPrecision {
+    DnnFP32,
+    DnnFP16,
+    DnnINT8
+};
+
+/**
+ * @brief Inference settings for the OpenCV_DNN face detector. See eye_mouse_dnn_bench for how
+ * they trade latency against recall on a given machine.
+ */
+struct DnnConfig {
+    // Side of the square image fed to the net. The model was trained at 300; 150-200 is several
+    // times cheaper and still finds faces that fill a good part of a webcam frame.
+    int input_size = 300;
+    // cv::dnn::Backend and cv::dnn::Target to run on.
+    int backend = cv::dnn::DNN_BACKEND_OPENCV;
+    int target = cv::dnn::DNN_TARGET_CPU;
+    // Threads for inference, 0 for OpenCV's default (the count it had before a config changed it).
+    // Note OpenCV has one thread pool per process, so this is set with cv::setNumThreads() and
+    // affects every other OpenCV call too.
+    int threads = 0;
+    DnnPrecision precision = DnnFP32;
+};
+
+/**
+ * @brief OpenCV's SSD face detector. Finds the face only, no eyes.
+ */
+class DnnBackend {
+public:
+    static const Detector method = OpenCV_DNN;
+    static const DetectorFeatures features = FaceOnly;
+
+    /**
+     * @brief Load the net with the current config.
+     */
+    void load() { _load(config_); }
+
+    /**
+     * @brief Change the inference settings. Reloads the net if the precision changed and it was
+     * already loaded; throws (leaving the current net and settings alone) if that fails.
+     */
+    void setConfig(const DnnConfig &config);
+    const DnnConfig & getConfig() { return config_; }
+
+    void detect(cv::Mat &frame, DetectorState &state);
+
+private:
+    /**
+     * @brief Load the DNN weights for a config's precision, apply its backend, target and thread
+     * settings, and make it the current config.
+     *
+     * @param config The settings to load.
+     */
+    void _load(const DnnConfig &config);
+
+    cv::dnn::Net net_;
+    DnnConfig config_;
+    // Input blob for the net, reused between frames.
+    cv::Mat blob_;
+};
+
+#endif
+
+#if EYEMOUSE_WITH_DLIB
+
+/**
+ * @brief Dlib's HOG face detector, then its 68 landmark shape predictor for the eyes.
+ */
+class DlibBackend {
+public:
+    static const Detector method = Dlib_68;
+    static const DetectorFeatures features = FaceLandmarks;
+
+    /**
+     * @brief Initialize the face detector and load the landmark model. Throws if it can't be read.
+     */
+    void load();
+
+    void detect(cv::Mat &frame, DetectorState &state);
+
+private:
+    // Loads "shape_predictor_68_face_landmarks.dat" file, which is a pre-trained
+    // cascade of regression tree implemented using "One Millisecond face alignment
+    // with an ensemble of regression trees"
+    dlib::shape_predictor predictor_;
+    dlib::frontal_face_detector detector_;
+};
+
+#endif
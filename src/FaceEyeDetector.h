@@ -1,68 +1,177 @@
 #pragma once
 
+#include "DetectorBackends.h"
+
 #include "camux/Eye.h"
 #include "camux/Face.h"
+#include "camux/LandmarkTracker.h"
 #include "camux/geometry.hpp"
 
-#include "opencv2/objdetect/objdetect.hpp"
-#include <opencv2/highgui.hpp>
-#include <opencv2/dnn.hpp>
 #include <opencv2/imgproc.hpp>
 
-#include <dlib/image_processing/frontal_face_detector.h>
-#include <dlib/image_processing/render_face_detections.h>
-#include <dlib/image_processing/shape_predictor.h>
-#include <dlib/image_processing.h>
-#include <dlib/opencv/cv_image.h>
+#include <vector>
 
 
-// Tunable confidence threshold (>0, <1.0) for deciding if a feature is a face
-const float FACE_CONFIDENCE_THRESHOLD = 0.6;
+// The most frames trackFace() will follow the face with optical flow before forcing a full
+// detection anyway, to correct any drift the forward-backward check didn't catch.
+const int MAX_TRACKED_FRAMES = 30;
 
 /**
- * @brief The different types of face detection methods
- *
- * OpenCv_DNN: A pretrained deep neural network trained to find faces.
- *  Pros: Most accurate of the three. Second fastest (50-100 ms latency)
- *  Cons: No eye location provided - need to train a model for that
- *
- * Dlib 68 landmark locator: Pre trained cascade of regression trees.
- *  Pros: Locates 68 different facial landmarks, including 6 surrounding the eyes
- *  Cons: Slowest (~150 ms latency). Not as accurate as DNN (needs to be front facing)
- *
- * Haar Cascades:
- *  Pros:
- *  Cons:
+ * @brief What every face detector shares, whichever backend finds the face: where the face and
+ *  eyes are, following them with optical flow between detections, and drawing them.
  */
-enum Detector {
-    OpenCV_DNN,
-    Dlib_68,
-    HaarCascade
+class FaceEyeDetectorBase {
+public:
+    /**
+     * @brief Whether the last detectFace()/trackFace() call found a face. If not, the face and
+     * eye objects still hold the last positions that were found.
+     */
+    bool foundFace() { return state_.found; }
+
+    /**
+     * @brief Whether the last trackFace() call ran the detector (rather than optical flow).
+     */
+    bool ranDetector() { return ran_detector_; }
+
+    /**
+     * @brief Whether the last trackFace() call ran the detector and it found the face but lost
+     * an eye, so no face was reported (HaarCascade only).
+     */
+    bool missedEyes() { return ran_detector_ && state_.eyes_missed; }
+
+    /**
+     * @brief Stop following the last detection, so the next trackFace() runs the detector. The
+     * face and eyes keep their positions, which the eye search starts from.
+     */
+    void reset() { tracker_.reset(); frames_since_detect_ = 0; }
+
+    /**
+     * @brief reset(), and forget the last detection and frame too, as if no frame had been seen.
+     */
+    void clear() {
+        reset();
+        state_.found = state_.eyes_missed = false;
+        state_.landmarks.clear();
+        state_.shape.clear();
+        ran_detector_ = false;
+    }
+
+    /**
+     * @brief How much the frames being passed in are scaled from the camera's. The sizes tuned for
+     * camera frames (e.g the smallest face the Haar cascade looks for) are scaled to match.
+     */
+    void setImageScale(double scale) { state_.image_scale = scale; }
+
+    /**
+     * @brief Draw the bounding rectangle of the last detected face on a frame.
+     *
+     * TODO: See drawEyes() for why this is a poor design for this function.
+     *
+     * @param frame The cv::Mat image to draw the face onto
+     */
+    void drawFace(cv::Mat& frame);
+
+    /**
+     * @brief Draw the bounding rectangle of the last detected eyes on a frame. Requires
+     * that you pass the same frame you used in detecting the face/eyes in order for the coordinates to
+     * match.
+     * TODO: That's dumb. Save a reference to the frame when we run detect(), since the bounding rectangle
+     * is entirely relative to the coordinate system of that frame. It's useless for frames other than those
+     * with the same coordinate system.
+     *
+     * @param frame The image to draw the face onto.
+     */
+    void drawEyes(cv::Mat& frame);
+
+    /**
+     * @brief Draw the landmarks of the last Dlib_68 detection.
+     *
+     * @param frame The image to draw onto.
+     * @param scale How much the frames detected on were scaled from this one (see setImageScale()).
+     */
+    void drawLandmarks(cv::Mat& frame, double scale = 1);
+
+    /**
+     * @brief Get the Face object
+     *
+     * @return camux::Face&
+     */
+    camux::Face & getFace() { return state_.face; }
+
+protected:
+    FaceEyeDetectorBase(camux::Face &face, camux::Eye &l_eye, camux::Eye &r_eye) : state_(face, l_eye, r_eye) {}
+
+    /**
+     * @brief Start a frame: note its size and, if the last detection can still be followed,
+     * follow it with optical flow.
+     *
+     * @return true If it was followed (or the frame is empty), so there's no need to run the
+     * detector.
+     */
+    bool _track(cv::Mat &frame);
+
+    /**
+     * @brief Finish a frame the detector ran on: start following what it found, if anything.
+     *
+     * @param features What the detector that ran finds.
+     */
+    void _detected(DetectorFeatures features);
+
+    /**
+     * @brief Seed the tracker from the last detection: the 68 landmarks for FaceLandmarks,
+     * otherwise corners found inside the face (and eye) boxes.
+     */
+    void _seedTracker(DetectorFeatures features);
+
+    /**
+     * @brief Move the face, eyes and landmarks to where the tracker says they are now.
+     */
+    void _applyTracking();
+
+    // The face and eyes, and what the detector and tracker found.
+    DetectorState state_;
+
+    bool ran_detector_ = false;
+
+private:
+    // Optical flow tracking between detector runs (see trackFace()).
+    camux::LandmarkTracker tracker_;
+    DetectorFeatures tracked_features_ = FaceOnly;
+    int frames_since_detect_ = 0;
+    cv::Mat gray_;
+    std::vector<cv::Point2f> seed_points_, corners_;
+    std::vector<int> seed_groups_;
 };
 
 /**
  * @brief A detector of a face and its eyes. You construct it with face and eye objects
- *  as well as an image which you want to detect a face and its eyes on and a selection of a 
+ *  as well as an image which you want to detect a face and its eyes on and a selection of a
  *  face detection method you'd like to use (see enum Detector above). Call the detect method
  *  with that image to save the relevant info. Can draw bounding boxes for the face/eyes as well as
  *  a 68 landmark feature summary of the image.
  *
+ *  The method can be changed at runtime, so this holds every backend that was built. Where the
+ *  method is fixed, FaceEyeDetectorT is leaner.
  */
-class FaceEyeDetector {
+class FaceEyeDetector : public FaceEyeDetectorBase {
 public:
     /**
      * @brief Construct a default Face Detector object
      * The default FaceEyeDetector object uses the OpenCV DNN
-     * for face detection.
+     * for face detection (Haar cascades if DNN isn't built).
      *
      * @param face The face object to write face detection info
      * @param l_eye The left eye object to write eye detection info
      * @param r_eye The left eye object to write eye detection info
      */
-    FaceEyeDetector(camux::Face &face, camux::Eye &l_eye, camux::Eye &r_eye) : 
-      face_(face), left_(l_eye), right_(r_eye) {
+    FaceEyeDetector(camux::Face &face, camux::Eye &l_eye, camux::Eye &r_eye) :
+      FaceEyeDetectorBase(face, l_eye, r_eye) {
         // Default method is the DNN
+#if EYEMOUSE_WITH_DNN
         method_ = OpenCV_DNN;
+#else
+        method_ = HaarCascade;
+#endif
 
         changeMethod(method_);
     };
@@ -75,7 +184,7 @@ public:
      * @param r_eye The left eye object to write eye detection info
      */
     FaceEyeDetector(const Detector method, camux::Face &face, camux::Eye &l_eye, camux::Eye &r_eye) :
-      face_(face), left_(l_eye), right_(r_eye) {
+      FaceEyeDetectorBase(face, l_eye, r_eye) {
 
         method_ = method;
         changeMethod(method_);
@@ -90,91 +199,89 @@ public:
     void detectFace(cv::Mat &frame);
 
     /**
-     * @brief Opens the files required for the face detection method and initializes
-     * the required data structures (e.g neural net)
+     * @brief Like detectFace(), but only runs the detector when it has to. After a successful
+     * detection the face (and eye/landmark) positions are followed with optical flow on the
+     * following frames; the detector only runs again when tracking is lost (forward-backward
+     * error or too many lost points) or after MAX_TRACKED_FRAMES frames.
      *
-     * @param method The method of detection (neural net, haar cascade, dlib) to use for face detection now
+     * @param frame The OpenCV style image to find face on.
      */
-    void changeMethod(Detector method);
+    void trackFace(cv::Mat &frame);
 
     /**
-     * @brief Draw the bounding rectangle of the last detected face on a frame.
-     *
-     * TODO: See drawEyes() for why this is a poor design for this function.
+     * @brief Opens the files required for the face detection method and initializes
+     * the required data structures (e.g neural net). Throws std::runtime_error for a method
+     * that wasn't built (see the EYEMOUSE_WITH_* CMake options).
      *
-     * @param frame The cv::Mat image to draw the face onto
+     * @param method The method of detection (neural net, haar cascade, dlib) to use for face detection now
      */
-    void drawFace(cv::Mat& frame);
+    void changeMethod(Detector method);
 
+#if EYEMOUSE_WITH_DNN
     /**
-     * @brief Draw the bounding rectangle of the last detected eyes on a frame. Requires
-     * that you pass the same frame you used in detecting the face/eyes in order for the coordinates to
-     * match. 
-     * TODO: That's dumb. Save a reference to the frame when we run detect(), since the bounding rectangle
-     * is entirely relative to the coordinate system of that frame. It's useless for frames other than those
-     * with the same coordinate system.
+     * @brief Change the inference settings of the OpenCV_DNN detector. Reloads the net if the
+     * precision changed and the net has been loaded (DNN is or was the method).
      *
-     * @param frame The image to draw the face onto.
+     * @param config The new settings.
      */
-    void drawEyes(cv::Mat& frame);
-
-    void drawLandmarks(cv::Mat& frame);
+    void setDnnConfig(const DnnConfig &config) { dnn_.setConfig(config); }
 
-    /**
-     * @brief Get the Face object
-     * 
-     * @return camux::Face& 
-     */
-    camux::Face & getFace() { return face_; }
+    const DnnConfig & getDnnConfig() { return dnn_.getConfig(); }
+#endif
 
 private:
+    // What each method finds.
+    static DetectorFeatures _features(Detector method);
+
     // The method of facial recognition to use.
     Detector method_;
 
-    // The height and width of the last frame used.
-    int height_ = 720;
-    int width_ = 1080;
-
-    // The face object reference to write the most probable face to.
-    camux::Face & face_;
-    camux::Eye & left_;
-    camux::Eye & right_;
-
-    // The facial landmarks (other than those belonging to the eyes)
-    std::vector<cv::Point2u> landmarks_;
-
-    // Neural net for the OpenCv face detection method. Initialized when we select
-    // OpenCvDNN as our detection method.
-    cv::dnn::Net net_;
-
-    // Loads "shape_predictor_68_face_landmarks.dat" file, which is a pre-trained
-    // cascade of regression tree implemented using "One Millisecond face alignment
-    // with an ensemble of regression trees"
-    dlib::shape_predictor dlib_sp_;
-    dlib::frontal_face_detector dlib_;
+    HaarBackend haar_;
+#if EYEMOUSE_WITH_DNN
+    DnnBackend dnn_;
+#endif
+#if EYEMOUSE_WITH_DLIB
+    DlibBackend dlib_;
+#endif
+};
 
-    cv::CascadeClassifier haar_face_;
-    cv::CascadeClassifier haar_eye_;
+/**
+ * @brief A FaceEyeDetector with its backend (HaarBackend, DnnBackend or DlibBackend) fixed at
+ *  compile time. It only holds and loads that backend, and calls it directly rather than through
+ *  the per-frame switch on the method, so a build or tool that only ever uses one method needs
+ *  nothing of the others (see the EYEMOUSE_WITH_* CMake options).
+ *
+ *  Construction throws whatever the backend's load() does.
+ */
+template <class Backend>
+class FaceEyeDetectorT : public FaceEyeDetectorBase {
+public:
+    FaceEyeDetectorT(camux::Face &face, camux::Eye &l_eye, camux::Eye &r_eye) :
+      FaceEyeDetectorBase(face, l_eye, r_eye) {
+        backend_.load();
+    }
 
     /**
-     * @brief Performs the OpenCVDNN facial recognition method on an image.
-     * Will draw a bounding box on the image to indicate the face.
-     *
-     * @param frame The OpenCV style image to find a face on.
-     */
-    void _detectDNN(cv::Mat &frame);
-    /**
-     * @brief Performs a Haar Cascade facial recognition method on an image.
-     * Will modify the image to indicate the face.
-     *
-     * @param frame The OpenCV style image to find a face on.
+     * @brief See FaceEyeDetector::detectFace().
      */
-    void _detectHAAR(cv::Mat &frame);
+    void detectFace(cv::Mat &frame) {
+        state_.height = frame.rows;
+        state_.width = frame.cols;
+        backend_.detect(frame, state_);
+    }
+
     /**
-     * @brief Performs the Dlib 68 landmark facial recognition method on an image.
-     * Will draw the 68 landmarks on the image to indicate the face.
-     *
-     * @param frame The OpenCV style image to find a face on.
+     * @brief See FaceEyeDetector::trackFace().
      */
-    void _detectDLIB(cv::Mat &frame);
+    void trackFace(cv::Mat &frame) {
+        if (_track(frame)) return;
+
+        detectFace(frame);
+        _detected(Backend::features);
+    }
+
+    Backend & getBackend() { return backend_; }
+
+private:
+    Backend backend_;
 };
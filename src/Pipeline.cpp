@@ -0,0 +1,313 @@
+#include "Pipeline.h"
+
+#include <cmath>
+
+Pipeline::Pipeline(Detector method) :
+    detector_(method, face_, left_, right_), eye_pair_(left_, right_) {
+    kernel_ = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
+}
+
+bool Pipeline::findForeheadDot(const cv::Mat &face_frame, cv::Rect &dot) {
+    // Identify the blue on the image (for forehead dot feature)
+    cv::cvtColor(face_frame, hsv_, cv::COLOR_BGR2HSV);
+    cv::inRange(hsv_, cv::Scalar(forehead_range_.low_h, forehead_range_.low_s, forehead_range_.low_v),
+                cv::Scalar(forehead_range_.high_h, forehead_range_.high_s, forehead_range_.high_v), forehead_mask_);
+    cv::morphologyEx(forehead_mask_, forehead_mask_, cv::MORPH_OPEN, kernel_);
+
+    cv::findContours(forehead_mask_, contours_, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
+    if (contours_.empty()) return false;
+
+    dot = cv::boundingRect(contours_[0]);
+    return true;
+}
+
+void Pipeline::process(const camux::Frame &frame, camux::GazeSample &sample) {
+    _process(frame, sample);
+    latest_.publish(sample);
+}
+
+// Scale a rectangle (or point) by a factor, e.g between two processing scales.
+static cv::Rect rescale(const cv::Rect &r, double factor) {
+    return camux::ResolutionController::fromFrame(r, factor);
+}
+
+static cv::Point unscale(const cv::Point2f &p, double scale) {
+    return cv::Point(cvRound(p.x / scale), cvRound(p.y / scale));
+}
+
+void Pipeline::scan(const camux::Frame &frame, double scale, camux::GazeSample &sample) {
+    // A near-eye camera has nobody to look for; the frame is the eye.
+    if (input_mode_ != FaceInput) {
+        process(frame, sample);
+        return;
+    }
+
+    sample = camux::GazeSample();
+    sample.frame = frame.index;
+    sample.capture_us = frame.capture_us;
+    sample.timestamp_us = frame.timestamp_us;
+
+    if (!frame.image.empty()) {
+        int64_t start = camux::steadyMicros();
+        cv::resize(frame.image, scan_image_, cv::Size(), scale, scale, cv::INTER_AREA);
+
+        // Whatever was being followed is long gone (and in the other coordinates).
+        detector_.reset();
+        detector_.setImageScale(scale);
+        detector_.detectFace(scan_image_);
+        detector_.setImageScale(scale_);
+
+        sample.face_found = detector_.foundFace();
+        sample.ran_detector = true;
+        if (sample.face_found) {
+            sample.face = camux::ResolutionController::toFrame(face_.getCoords(), scale);
+            sample.left_eye = camux::ResolutionController::toFrame(left_.getCoords(), scale);
+            sample.right_eye = camux::ResolutionController::toFrame(right_.getCoords(), scale);
+            sample.face_confidence = face_.getConfidence();
+            sample.left_eye_confidence = left_.getConfidence();
+            sample.right_eye_confidence = right_.getConfidence();
+
+            // Into the processing scale, for the full detection on the next frame to start from.
+            face_.setCoords(rescale(face_.getCoords(), scale_ / scale));
+            left_.setCoords(rescale(left_.getCoords(), scale_ / scale));
+            right_.setCoords(rescale(right_.getCoords(), scale_ / scale));
+        }
+        resolution_.update(sample.face_found, sample.face);
+        sample.detect_us = camux::steadyMicros() - start;
+    }
+
+    sample.done_us = camux::steadyMicros();
+    latest_.publish(sample);
+}
+
+void Pipeline::setInputMode(InputMode mode) {
+    if (mode == input_mode_) return;
+
+    // Near-eye ROIs are in frame pixels, and whatever the detector was following is meaningless
+    // in the other mode.
+    _setScale(1);
+    detector_.reset();
+    resolution_ = camux::ResolutionController();
+    input_mode_ = mode;
+}
+
+void Pipeline::reset() {
+    bool warm_start = left_.isWarmStart();
+    face_ = camux::Face();
+    left_ = camux::Eye();
+    right_ = camux::Eye();
+    left_.setWarmStart(warm_start);
+    right_.setWarmStart(warm_start);
+
+    detector_.clear();
+    detector_.setImageScale(1);
+    scale_ = 1;
+    resolution_ = camux::ResolutionController();
+    gaze_mapper_ = camux::GazeMapper();
+}
+
+void Pipeline::_setScale(double scale) {
+    if (scale == scale_) return;
+
+    // Carry the face and eyes over to the new scale. Optical flow can't follow them across the
+    // change, so the next frame runs the detector (starting from them).
+    face_.setCoords(rescale(face_.getCoords(), scale / scale_));
+    left_.setCoords(rescale(left_.getCoords(), scale / scale_));
+    right_.setCoords(rescale(right_.getCoords(), scale / scale_));
+    detector_.reset();
+    detector_.setImageScale(scale);
+    scale_ = scale;
+}
+
+void Pipeline::_cropEye(const cv::Mat &frame, const cv::Rect &eye, cv::Mat &resized, cv::Mat &crop, double &eye_scale) {
+    // Every eye crop goes to the localizer at about the same width, however near the user is.
+    eye_scale = camux::ResolutionController::eyeScale(eye);
+    if (eye.area() == 0) {
+        crop = cv::Mat();
+    } else if (std::abs(eye_scale - 1) < .05) {
+        eye_scale = 1;
+        crop = frame(eye);
+    } else {
+        // Into a buffer of our own: crop may still be a view into an earlier frame.
+        cv::resize(frame(eye), resized, cv::Size(), eye_scale, eye_scale, eye_scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+        crop = resized;
+    }
+}
+
+void Pipeline::_process(const camux::Frame &frame, camux::GazeSample &sample) {
+    sample = camux::GazeSample();
+    sample.frame = frame.index;
+    sample.capture_us = frame.capture_us;
+    sample.timestamp_us = frame.timestamp_us;
+
+    if (frame.image.empty()) {
+        sample.done_us = camux::steadyMicros();
+        return;
+    }
+
+    if (input_mode_ != FaceInput) {
+        _processNearEye(frame, sample);
+        return;
+    }
+
+    // Detection, tracking and the forehead dot run on the frame shrunk to the scale the resolution
+    // controller picked from the last frame's face. Everything in the sample is in full frame pixels.
+    int64_t start = camux::steadyMicros();
+    _setScale(resolution_.getScale());
+    if (scale_ < 1) {
+        cv::resize(frame.image, scaled_, cv::Size(), scale_, scale_, cv::INTER_AREA);
+        image_ = scaled_;
+    } else {
+        image_ = frame.image;
+    }
+    cv::Rect bounds(0, 0, image_.cols, image_.rows);
+    cv::Rect frame_bounds(0, 0, frame.image.cols, frame.image.rows);
+
+    // Runs the full detector only when optical flow tracking of the last detection breaks down.
+    detector_.trackFace(image_);
+
+    int64_t stage = camux::steadyMicros();
+    sample.detect_us = stage - start;
+    sample.face_found = detector_.foundFace();
+    sample.ran_detector = detector_.ranDetector();
+    sample.eyes_missed = detector_.missedEyes();
+    sample.face = camux::ResolutionController::toFrame(face_.getCoords(), scale_);
+    sample.left_eye = camux::ResolutionController::toFrame(left_.getCoords(), scale_);
+    sample.right_eye = camux::ResolutionController::toFrame(right_.getCoords(), scale_);
+    sample.face_confidence = face_.getConfidence();
+    sample.left_eye_confidence = left_.getConfidence();
+    sample.right_eye_confidence = right_.getConfidence();
+
+    resolution_.update(sample.face_found, sample.face);
+
+    cv::Rect face_rect = face_.getCoords() & bounds;
+    if (face_rect.area() == 0) {
+        sample.done_us = camux::steadyMicros();
+        return;
+    }
+
+    cv::Rect dot;
+    sample.forehead_found = findForeheadDot(image_(face_rect), dot);
+    if (sample.forehead_found) sample.forehead_dot = camux::ResolutionController::toFrame(dot + face_rect.tl(), scale_);
+    sample.forehead = unscale(cv::Point2f(face_rect.x + dot.x + dot.width / 2.f, face_rect.y + dot.y + dot.height / 2.f), scale_);
+
+    int64_t now = camux::steadyMicros();
+    sample.forehead_us = now - stage;
+    stage = now;
+
+    // The pupils are localized in crops of the full resolution frame.
+    cv::Rect le = sample.left_eye & frame_bounds;
+    cv::Rect re = sample.right_eye & frame_bounds;
+    double left_scale, right_scale;
+    _cropEye(frame.image, le, left_resized_, left_crop_, left_scale);
+    _cropEye(frame.image, re, right_resized_, right_crop_, right_scale);
+
+    cv::Point left_center, right_center;
+    eye_pair_.findPupilCenters(left_crop_, right_crop_, left_center, right_center);
+    sample.pupils_us = eye_pair_.getLatencyUs();
+    sample.left_pupil_us = eye_pair_.getLeftUs();
+    sample.right_pupil_us = eye_pair_.getRightUs();
+    sample.left_pupil = le.tl() + unscale(left_center, left_scale);
+    sample.right_pupil = re.tl() + unscale(right_center, right_scale);
+    sample.left_closed = left_.isClosed();
+    sample.right_closed = right_.isClosed();
+    sample.left_blinked = left_.blinked();
+    sample.right_blinked = right_.blinked();
+    sample.left_blinks = left_.getBlinkCount();
+    sample.right_blinks = right_.getBlinkCount();
+
+    now = camux::steadyMicros();
+    sample.pupil_us = now - stage;
+    stage = now;
+
+    // The gaze feature: the pupils relative to the forehead dot, which moves with the head.
+    if (sample.forehead_found && !sample.left_closed && !sample.right_closed) {
+        sample.has_offset = true;
+        sample.gaze_offset = cv::Point2f(sample.left_pupil + sample.right_pupil) * .5f - cv::Point2f(sample.forehead);
+
+        if (gaze_mapper_.isFitted()) {
+            sample.gaze_valid = true;
+            sample.gaze = gaze_mapper_.map(sample.gaze_offset);
+        }
+    }
+
+    now = camux::steadyMicros();
+    sample.map_us = now - stage;
+    sample.done_us = now;
+}
+
+void Pipeline::_processNearEye(const camux::Frame &frame, camux::GazeSample &sample) {
+    int64_t start = camux::steadyMicros();
+    bool stereo = input_mode_ == StereoEyeInput;
+
+    // The eyes are where the camera was mounted to see them: nothing to detect or track.
+    cv::Rect bounds(0, 0, frame.image.cols, frame.image.rows);
+    cv::Rect le = bounds, re;
+    if (stereo) {
+        le = left_roi_.area() ? left_roi_ & bounds : cv::Rect(0, 0, bounds.width / 2, bounds.height);
+        re = right_roi_.area() ? right_roi_ & bounds : cv::Rect(bounds.width / 2, 0, bounds.width - bounds.width / 2, bounds.height);
+    }
+    face_.setCoords(bounds);
+    left_.setCoords(le);
+    right_.setCoords(re);
+
+    sample.face_found = le.area() > 0 && (!stereo || re.area() > 0);
+    sample.face = bounds;
+    sample.left_eye = le;
+    sample.right_eye = re;
+    if (!sample.face_found) {
+        sample.done_us = camux::steadyMicros();
+        return;
+    }
+
+    // Straight to the localizer at full resolution; large crops search on every core (see
+    // camux::maximizePupilObjectiveParallel()).
+    cv::Point left_center, right_center;
+    left_crop_ = frame.image(le);
+    if (stereo) {
+        right_crop_ = frame.image(re);
+        eye_pair_.findPupilCenters(left_crop_, right_crop_, left_center, right_center);
+        sample.pupils_us = eye_pair_.getLatencyUs();
+        sample.left_pupil_us = eye_pair_.getLeftUs();
+        sample.right_pupil_us = eye_pair_.getRightUs();
+    } else {
+        int64_t search_start = camux::steadyMicros();
+        left_center = left_.findPupilCenter(left_crop_);
+        sample.pupils_us = sample.left_pupil_us = camux::steadyMicros() - search_start;
+    }
+
+    sample.left_pupil = le.tl() + left_center;
+    sample.left_closed = left_.isClosed();
+    sample.left_blinked = left_.blinked();
+    sample.left_blinks = left_.getBlinkCount();
+    if (stereo) {
+        sample.right_pupil = re.tl() + right_center;
+        sample.right_closed = right_.isClosed();
+        sample.right_blinked = right_.blinked();
+        sample.right_blinks = right_.getBlinkCount();
+    }
+
+    int64_t now = camux::steadyMicros();
+    sample.pupil_us = now - start;
+    int64_t stage = now;
+
+    // The gaze feature: the pupils relative to the middle of their eye ROIs. The camera moves
+    // with the head, so there's no head motion to take out.
+    if (!sample.left_closed && !sample.right_closed) {
+        sample.has_offset = true;
+        sample.gaze_offset = cv::Point2f(left_center) - cv::Point2f(le.width / 2.f, le.height / 2.f);
+        if (stereo) {
+            cv::Point2f right_offset = cv::Point2f(right_center) - cv::Point2f(re.width / 2.f, re.height / 2.f);
+            sample.gaze_offset = (sample.gaze_offset + right_offset) * .5f;
+        }
+
+        if (gaze_mapper_.isFitted()) {
+            sample.gaze_valid = true;
+            sample.gaze = gaze_mapper_.map(sample.gaze_offset);
+        }
+    }
+
+    now = camux::steadyMicros();
+    sample.map_us = now - stage;
+    sample.done_us = now;
+}
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "FaceEyeDetector.h"
+#include "camux/EyePair.h"
+#include "camux/Face.h"
+#include "camux/FrameSource.h"
+#include "camux/GazeMapper.h"
+#include "camux/GazeSample.h"
+#include "camux/Latest.h"
+#include "camux/ResolutionController.h"
+
+#include <vector>
+
+/**
+ * @brief The HSV range the forehead dot is picked out with. HIGHLY DEPENDENT ON THE
+ * ENVIRONMENT! (OpenCV HSV: hue 0-179, saturation and value 0-255.)
+ */
+struct ForeheadDotRange {
+    int low_h = 98, low_s = 43, low_v = 0;
+    int high_h = 119, high_s = 255, high_v = 156;
+};
+
+/**
+ * @brief What the camera is looking at.
+ */
+enum InputMode {
+    // A webcam in front of the user: the face is detected and tracked, the eyes found in it, and
+    // gaze measured against the forehead dot.
+    FaceInput,
+    // A near-eye (head-mounted) camera whose whole frame is one eye, localized as the left eye.
+    SingleEyeInput,
+    // A near-eye stereo camera with both eyes side by side in one frame: the left half (or the
+    // left eye ROI, see Pipeline::setEyeRois()) is the left eye, the right half the right.
+    StereoEyeInput
+};
+
+/**
+ * @brief The per-frame tracking work, with no windows or drawing: face/eye detection and
+ * tracking, the forehead dot, both pupils, and the gaze mapping. Turns each Frame into a
+ * GazeSample.
+ *
+ * Frames are processed at a scale picked per frame from the size of the face (see
+ * camux::ResolutionController). The face, eyes and detector work in the scaled frame's pixels;
+ * samples are always in full frame pixels.
+ *
+ * It owns the face, eyes, detector and gaze mapper; use the getters to restore or save
+ * calibration state, or to tune them.
+ */
+class Pipeline {
+public:
+    /**
+     * @param method The face detection method to start with. Its model files are loaded here.
+     */
+    Pipeline(Detector method = HaarCascade);
+
+    /**
+     * @brief Process one frame.
+     *
+     * @param frame The frame. Its image isn't modified.
+     * @param sample Set to what was found. If the image is empty, only the timestamps are set.
+     *  Also published to getLatest().
+     */
+    void process(const camux::Frame &frame, camux::GazeSample &sample);
+
+    /**
+     * @brief Just look for a face, in a copy of the frame shrunk by scale: the cheap check for
+     * whether anyone's there at all (see camux::PresenceScheduler). Only the face and eyes of
+     * the sample are set, in full frame coordinates, and the next process() starts with a full
+     * detection around them. Also published to getLatest().
+     */
+    void scan(const camux::Frame &frame, double scale, camux::GazeSample &sample);
+
+    /**
+     * @brief The latest sample, for other threads. The face, eyes and detector below are only
+     * safe to touch from the thread calling process(); this is the way to read results from
+     * anywhere else.
+     */
+    const camux::Latest<camux::GazeSample> & getLatest() { return latest_; }
+
+    FaceEyeDetector & getDetector() { return detector_; }
+    camux::Face & getFace() { return face_; }
+    camux::Eye & getLeftEye() { return left_; }
+    camux::Eye & getRightEye() { return right_; }
+    camux::EyePair & getEyePair() { return eye_pair_; }
+    camux::GazeMapper & getGazeMapper() { return gaze_mapper_; }
+
+    ForeheadDotRange & getForeheadRange() { return forehead_range_; }
+
+    /**
+     * @brief Switch between a webcam on the face (the default) and a near-eye camera. With a
+     * near-eye camera the frame already is the eye (or eyes), so there's no face detection,
+     * tracking, landmarks, resolution control or forehead dot: the eye ROIs go straight to the
+     * pupil localizer, at full resolution, and the sample's face is the whole frame. The gaze
+     * feature is the pupils' offset from their ROIs' centers, since the camera moves with the
+     * head.
+     */
+    void setInputMode(InputMode mode);
+    InputMode getInputMode() { return input_mode_; }
+
+    /**
+     * @brief Forget everything learned from the frames so far (the face and eyes, tracking, the
+     * pupil thresholds and blink state, the processing scale and the gaze fit), as if the pipeline
+     * were new. The input mode, eye ROIs, forehead range and eye pair settings are kept, as is
+     * whether the eyes warm start.
+     */
+    void reset();
+
+    /**
+     * @brief Where the eyes are in a StereoEyeInput frame, in frame pixels. Empty rectangles (the
+     * default) mean the left and right halves of the frame.
+     */
+    void setEyeRois(const cv::Rect &left, const cv::Rect &right) { left_roi_ = left; right_roi_ = right; }
+
+    /**
+     * @brief The scale the last frame was processed at, to map anything read from the detector,
+     * face or eyes (rather than the sample) back to full frame pixels.
+     */
+    double getScale() { return scale_; }
+
+    /**
+     * @brief The face crop's pixels in the forehead dot's HSV range, from the last frame.
+     */
+    const cv::Mat & getForeheadMask() { return forehead_mask_; }
+
+    /**
+     * @brief Find the forehead dot in a face crop, as process() does every frame: the pixels in
+     * the HSV range, opened, and the first outer contour's bounding box. Returns whether it was
+     * found, with its rectangle relative to the crop.
+     */
+    bool findForeheadDot(const cv::Mat &face_frame, cv::Rect &dot);
+
+private:
+    /**
+     * @brief process(), short of publishing the sample.
+     */
+    void _process(const camux::Frame &frame, camux::GazeSample &sample);
+
+    /**
+     * @brief _process() for a near-eye camera (see setInputMode()).
+     */
+    void _processNearEye(const camux::Frame &frame, camux::GazeSample &sample);
+
+    /**
+     * @brief Switch to processing frames at a new scale, carrying the face and eyes over to it.
+     */
+    void _setScale(double scale);
+
+    /**
+     * @brief Crop an eye (full frame pixels) out of the frame for the pupil localizer, resized to
+     * the width it's given every eye at.
+     *
+     * @param resized The buffer to resize into.
+     * @param crop Set to the crop: a view into the frame, or resized.
+     * @param eye_scale Set to how much the crop was resized by.
+     */
+    void _cropEye(const cv::Mat &frame, const cv::Rect &eye, cv::Mat &resized, cv::Mat &crop, double &eye_scale);
+
+    // Declared before the detector, which holds references to them.
+    camux::Face face_;
+    camux::Eye left_;
+    camux::Eye right_;
+
+    FaceEyeDetector detector_;
+    camux::EyePair eye_pair_;
+    camux::GazeMapper gaze_mapper_;
+
+    ForeheadDotRange forehead_range_;
+
+    InputMode input_mode_ = FaceInput;
+    cv::Rect left_roi_, right_roi_;
+
+    camux::ResolutionController resolution_;
+    // The scale the face, eyes and detector are working in.
+    double scale_ = 1;
+
+    camux::Latest<camux::GazeSample> latest_;
+
+    // Working buffers, reused between frames.
+    // The frame being processed: the camera's image, or scaled_.
+    cv::Mat image_, scaled_, scan_image_, hsv_, forehead_mask_, kernel_;
+    cv::Mat left_crop_, right_crop_, left_resized_, right_resized_;
+    std::vector<std::vector<cv::Point>> contours_;
+};
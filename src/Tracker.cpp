@@ -0,0 +1,120 @@
+#include "Tracker.h"
+
+#include "camux/CalibrationProfile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+// How long to wait after the source had nothing, doubling on each empty read in a row up to the
+// maximum, and how many empty reads in a row mean the source has stopped delivering for good
+// (about 10 s at the maximum wait).
+const int EMPTY_READ_WAIT_MS = 1;
+const int MAX_EMPTY_READ_WAIT_MS = 50;
+const int MAX_EMPTY_READS = 200;
+
+Tracker::Tracker(Detector method) : pipeline_(method), running_(false), stop_(false) {}
+
+Tracker::~Tracker() {
+    stop();
+}
+
+bool Tracker::loadProfile(const std::string &path) {
+    if (running_) return false;
+
+    camux::CalibrationProfile profile;
+    if (!profile.load(path)) return false;
+
+    pipeline_.getLeftEye().getThresholdController() = profile.left_thresholds;
+    pipeline_.getRightEye().getThresholdController() = profile.right_thresholds;
+    pipeline_.getGazeMapper() = profile.gaze;
+    return true;
+}
+
+void Tracker::setCallback(const Callback &callback) {
+    std::lock_guard<std::mutex> lock(callback_mutex_);
+    callback_ = callback;
+}
+
+bool Tracker::start(camux::FrameSource &source) {
+    if (running_) return false;
+    // Reap the thread of a run that ended by itself.
+    if (thread_.joinable()) thread_.join();
+
+    {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        error_.clear();
+    }
+
+    stop_ = false;
+    running_ = true;
+    try {
+        thread_ = std::thread(&Tracker::_run, this, &source);
+    } catch (...) {
+        running_ = false;
+        throw;
+    }
+    return true;
+}
+
+void Tracker::stop() {
+    stop_ = true;
+    if (thread_.joinable()) thread_.join();
+    running_ = false;
+}
+
+std::string Tracker::lastError() {
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    return error_;
+}
+
+bool Tracker::poll(camux::GazeSample &sample, uint64_t &seen) {
+    // Only copy out the sample when there's a new one.
+    const camux::Latest<camux::GazeSample> &latest = pipeline_.getLatest();
+    if (latest.count() == seen) return false;
+
+    seen = latest.read(sample);
+    return true;
+}
+
+void Tracker::_run(camux::FrameSource *source) {
+    camux::Frame frame;
+    camux::GazeSample sample;
+    int empty_reads = 0;
+    std::string error;
+
+    // Nothing may escape the thread: that would terminate the host process. The first error
+    // (e.g a cv::Exception from a frame OpenCV doesn't like) stops tracking instead.
+    try {
+        while (!stop_ && source->read(frame)) {
+            // Nothing from the source this time (e.g a dropped camera frame). Back off rather than
+            // spin, and give up on a source that's stopped delivering.
+            if (frame.image.empty()) {
+                if (++empty_reads >= MAX_EMPTY_READS) {
+                    error = "the frame source stopped delivering frames";
+                    break;
+                }
+                int wait_ms = std::min(EMPTY_READ_WAIT_MS << std::min(empty_reads - 1, 16), MAX_EMPTY_READ_WAIT_MS);
+                std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms));
+                continue;
+            }
+            empty_reads = 0;
+
+            // Also publishes the sample for poll().
+            pipeline_.process(frame, sample);
+
+            std::lock_guard<std::mutex> lock(callback_mutex_);
+            if (callback_) callback_(sample);
+        }
+    } catch (const std::exception &e) {
+        error = e.what();
+    } catch (...) {
+        error = "unknown exception";
+    }
+
+    if (!error.empty()) {
+        std::lock_guard<std::mutex> lock(error_mutex_);
+        error_ = error;
+    }
+    running_ = false;
+}
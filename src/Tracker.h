@@ -0,0 +1,123 @@
+#pragma once
+
+#include "Pipeline.h"
+#include "camux/FrameSource.h"
+#include "camux/GazeSample.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/**
+ * @brief The tracker for embedding in another process: runs the Pipeline on its own thread over
+ * a FrameSource, and hands every GazeSample to a callback and/or publishes the latest one for
+ * any number of threads to poll.
+ *
+ * Samples are delivered in process, straight from the tracking thread: nothing is serialized and
+ * no frame is copied. Polling never holds up the tracking thread. The tracker has no GUI.
+ *
+ *     Tracker tracker;
+ *     tracker.loadProfile("eye_mouse_calibration.yml");
+ *     tracker.setCallback([](const camux::GazeSample &sample) { ... });
+ *     camux::CameraSource camera;
+ *     camera.open(0);
+ *     tracker.start(camera);
+ */
+class Tracker {
+public:
+    /**
+     * @brief Called with every sample, on the tracking thread, before the next frame is read.
+     * Anything slow in here delays tracking. It mustn't call setCallback() or stop().
+     */
+    typedef std::function<void(const camux::GazeSample &sample)> Callback;
+
+    /**
+     * @param method The face detection method. Its model files are loaded here, relative to
+     * the working directory, and loading may throw.
+     */
+    explicit Tracker(Detector method = HaarCascade);
+    ~Tracker();
+
+    Tracker(const Tracker &) = delete;
+    Tracker & operator=(const Tracker &) = delete;
+
+    /**
+     * @brief Restore a calibration profile saved by eye_mouse: the eyes' thresholds and the gaze
+     * mapping. Only while stopped.
+     *
+     * @return true If the profile was read.
+     */
+    bool loadProfile(const std::string &path);
+
+    /**
+     * @brief Set (or with an empty callback, clear) the callback. May be called while running.
+     */
+    void setCallback(const Callback &callback);
+
+    /**
+     * @brief Start tracking on a source, on a new thread. The source must outlive the tracking
+     * (until stop() or the source runs out).
+     *
+     * @return false If the tracker is already running.
+     */
+    bool start(camux::FrameSource &source);
+
+    /**
+     * @brief Stop tracking and wait for the thread to finish the frame it's on.
+     */
+    void stop();
+
+    /**
+     * @brief Whether the tracking thread is running: false before start(), after stop(), once
+     * the source has run out of frames, and after an error (see lastError()).
+     */
+    bool isRunning() { return running_; }
+
+    /**
+     * @brief Why the tracking thread stopped by itself: what the pipeline or the callback threw,
+     * or the source delivering nothing for too long. Empty if it didn't (cleared by start()).
+     */
+    std::string lastError();
+
+    /**
+     * @brief Get the latest sample, if it's newer than the last one this caller saw. Safe from
+     * any number of threads, each with its own seen count.
+     *
+     * @param sample Set to the latest sample if there was a new one; untouched otherwise.
+     * @param seen The count (see latest()) of the last sample the caller saw; updated to the new
+     *  one's. Start it at 0.
+     * @return true If there was a new sample.
+     */
+    bool poll(camux::GazeSample &sample, uint64_t &seen);
+
+    /**
+     * @brief Get the latest sample, new or not. Safe from any thread.
+     *
+     * @return uint64_t How many samples there have been (0 if none yet, and sample is untouched).
+     */
+    uint64_t latest(camux::GazeSample &sample) { return pipeline_.getLatest().read(sample); }
+
+    /**
+     * @brief The pipeline, to configure before start(). Not safe to touch while running.
+     */
+    Pipeline & getPipeline() { return pipeline_; }
+
+private:
+    void _run(camux::FrameSource *source);
+
+    Pipeline pipeline_;
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_;
+
+    // The callback, guarded by callback_mutex_ so it can be swapped while running.
+    std::mutex callback_mutex_;
+    Callback callback_;
+
+    // What stopped the thread, guarded by error_mutex_.
+    std::mutex error_mutex_;
+    std::string error_;
+};
@@ -0,0 +1,110 @@
+#include "Blink.h"
+
+#include <cmath>
+
+// The eye is called closed when its openness falls below this fraction of the open baseline, and
+// open again once it climbs back above REOPEN_RATIO of it. EAR drops from ~.3 to <.15 on a blink,
+// so .65 sits comfortably between the two. The gap between the ratios stops us flickering.
+const double CLOSED_RATIO = .65;
+const double REOPEN_RATIO = .8;
+
+// Weight of the current frame in the running open baseline. Small so a slow squint doesn't drag
+// the baseline down with it.
+const double BASELINE_RATE = .05;
+// Frames of open eye to see before we trust the baseline enough to call anything closed.
+const int BASELINE_WARMUP_FRAMES = 10;
+
+// Closures lasting longer than this many frames (~400 ms at 30 fps) are the eyes being shut, not
+// a blink.
+const int MAX_BLINK_FRAMES = 12;
+
+// A pixel counts as "dark" for the intensity fallback if it's below this fraction of the mean
+// intensity of the crop.
+const double DARK_FRACTION_OF_MEAN = .6;
+
+static double distance(const cv::Point2u& a, const cv::Point2u& b) {
+    double dx = (double) a.x - b.x;
+    double dy = (double) a.y - b.y;
+    return std::sqrt(dx * dx + dy * dy);
+}
+
+double camux::eyeAspectRatio(const camux::Points& eye) {
+    if (eye.size() != 6) return -1;
+
+    double width = distance(eye[0], eye[3]);
+    if (width <= 0) return -1;
+
+    return (distance(eye[1], eye[5]) + distance(eye[2], eye[4])) / (2 * width);
+}
+
+double camux::darkPixelOpenness(const cv::Mat& eye) {
+    if (eye.empty()) return -1;
+
+    // Only look at the middle of the crop: Haar eye boxes often catch an eyebrow at the top and
+    // the corners are shadowed whether or not the eye is open.
+    cv::Rect center(eye.cols / 4, eye.rows / 4, eye.cols / 2, eye.rows / 2);
+    if (center.area() == 0) return -1;
+
+    cv::Mat gray;
+    if (eye.channels() == 3) {
+        cv::cvtColor(eye(center), gray, cv::COLOR_BGR2GRAY);
+    } else {
+        gray = eye(center);
+    }
+
+    double dark_threshold = cv::mean(gray)[0] * DARK_FRACTION_OF_MEAN;
+    int dark = 0;
+    for (int y = 0; y < gray.rows; ++y) {
+        const uchar* row = gray.ptr<uchar>(y);
+        for (int x = 0; x < gray.cols; ++x) {
+            dark += row[x] < dark_threshold;
+        }
+    }
+
+    return (double) dark / center.area();
+}
+
+bool camux::BlinkDetector::update(double openness) {
+    blinked_ = false;
+    if (openness < 0) return false;
+    openness_ = openness;
+
+    bool trusted = baseline_frames_ >= BASELINE_WARMUP_FRAMES;
+
+    if (!closed_) {
+        if (trusted && openness < baseline_ * CLOSED_RATIO) {
+            closed_ = true;
+            closed_frames_ = 1;
+            return false;
+        }
+
+        // Still open, fold this frame into the baseline. Plain average until warmed up, so the
+        // first frame doesn't dominate.
+        ++baseline_frames_;
+        double rate = trusted ? BASELINE_RATE : 1.0 / baseline_frames_;
+        baseline_ += (openness - baseline_) * rate;
+        return false;
+    }
+
+    if (openness > baseline_ * REOPEN_RATIO) {
+        closed_ = false;
+        if (closed_frames_ <= MAX_BLINK_FRAMES) {
+            blinked_ = true;
+            ++blink_count_;
+        }
+        closed_frames_ = 0;
+        return blinked_;
+    }
+
+    ++closed_frames_;
+    return false;
+}
+
+void camux::BlinkDetector::reset() {
+    baseline_ = 0;
+    baseline_frames_ = 0;
+    openness_ = -1;
+    closed_ = false;
+    blinked_ = false;
+    closed_frames_ = 0;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "geometry.hpp"
+
+namespace camux {
+
+    /**
+     * @brief Eye aspect ratio (EAR) of the six dlib eye landmarks, ordered as dlib gives them
+     *  (36-41 or 42-47): p1 and p4 are the corners, p2/p3 the upper lid and p5/p6 the lower lid.
+     *
+     *      EAR = (|p2 - p6| + |p3 - p5|) / (2 |p1 - p4|)
+     *
+     *  Roughly constant (~.3) while the eye is open and drops towards 0 as the lids close. See
+     *  Soukupova & Cech, "Real-Time Eye Blink Detection using Facial Landmarks" (2016).
+     *
+     * @param eye The six landmarks of one eye.
+     * @return double The eye aspect ratio, or -1 if there aren't exactly six landmarks.
+     */
+    double eyeAspectRatio(const Points& eye);
+
+    /**
+     * @brief Cheap openness estimate for when we have no landmarks (e.g HaarCascade). An open eye
+     *  has a dark iris/pupil in the middle of the crop; a closed eye is mostly skin. Returns the
+     *  fraction of pixels in the center of the crop that are much darker than the crop's mean.
+     *  The scale is arbitrary - it's only meaningful relative to the same eye's open baseline.
+     *
+     * @param eye The BGR (or grayscale) eye crop.
+     * @return double The dark pixel fraction in [0, 1], or -1 if the crop is empty.
+     */
+    double darkPixelOpenness(const cv::Mat& eye);
+
+    /**
+     * @brief Turns a per-frame openness measurement (EAR or dark pixel fraction) into an
+     *  open/closed state and blink events. Keeps a running baseline of the openness while the
+     *  eye is open, and calls the eye closed once the openness drops below a fraction of that
+     *  baseline (with hysteresis on the way back up). A closure short enough to be a blink is
+     *  reported as a blink event on the frame the eye reopens.
+     *
+     */
+    class BlinkDetector {
+    public:
+        BlinkDetector() {};
+
+        /**
+         * @brief Feed the openness of the current frame.
+         *
+         * @param openness The openness measurement. Negative values (no measurement) are ignored.
+         * @return true If a blink finished on this frame.
+         */
+        bool update(double openness);
+
+        /**
+         * @brief Forget the baseline, e.g because the face was lost or another person sat down.
+         */
+        void reset();
+
+        bool isClosed() { return closed_; }
+        bool blinked() { return blinked_; }
+        int getBlinkCount() { return blink_count_; }
+        double getOpenness() { return openness_; }
+        double getBaseline() { return baseline_; }
+
+    private:
+        // Running (exponential) average of the openness while the eye is open.
+        double baseline_ = 0;
+        // Number of open frames folded into the baseline. We don't call anything closed until
+        // the baseline has seen a few frames.
+        int baseline_frames_ = 0;
+        double openness_ = -1;
+
+        bool closed_ = false;
+        bool blinked_ = false;
+        // How many consecutive frames the eye has been closed for.
+        int closed_frames_ = 0;
+        int blink_count_ = 0;
+    };
+}
@@ -0,0 +1,34 @@
+#include "CalibrationProfile.h"
+
+bool camux::CalibrationProfile::save(const std::string& path) const {
+    cv::FileStorage fs(path, cv::FileStorage::WRITE);
+    if (!fs.isOpened()) return false;
+
+    fs << "forehead" << forehead;
+    fs << "left_eye" << left_eye;
+    fs << "right_eye" << right_eye;
+    fs << "left_thresholds" << left_thresholds;
+    fs << "right_thresholds" << right_thresholds;
+    fs << "gaze" << gaze;
+
+    return true;
+}
+
+bool camux::CalibrationProfile::load(const std::string& path) {
+    cv::FileStorage fs;
+    // FileStorage throws on malformed files; treat that the same as having no profile.
+    try {
+        if (!fs.open(path, cv::FileStorage::READ)) return false;
+    } catch (const cv::Exception&) {
+        return false;
+    }
+
+    if (!fs["forehead"].empty()) fs["forehead"] >> forehead;
+    if (!fs["left_eye"].empty()) fs["left_eye"] >> left_eye;
+    if (!fs["right_eye"].empty()) fs["right_eye"] >> right_eye;
+    left_thresholds.read(fs["left_thresholds"]);
+    right_thresholds.read(fs["right_thresholds"]);
+    gaze.read(fs["gaze"]);
+
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "geometry.hpp"
+#include "GazeMapper.h"
+#include "ThresholdController.h"
+
+#include <string>
+
+namespace camux {
+
+    /**
+     * @brief Everything calibration learns about a user, saved between sessions: the resting
+     *  positions of the forehead dot and pupils, each eye's adapted localizer thresholds, and the
+     *  gaze to screen mapping.
+     *  Stored as YAML with cv::FileStorage.
+     *
+     */
+    struct CalibrationProfile {
+        cv::Point forehead;
+        cv::Point left_eye;
+        cv::Point right_eye;
+
+        ThresholdController left_thresholds;
+        ThresholdController right_thresholds;
+
+        GazeMapper gaze;
+
+        /**
+         * @brief Write the profile to a file.
+         *
+         * @param path The file to write, e.g "eye_mouse_calibration.yml".
+         * @return true If the file was written.
+         */
+        bool save(const std::string& path) const;
+
+        /**
+         * @brief Read a profile written by save(). Fields missing from the file keep their values.
+         *
+         * @param path The file to read.
+         * @return true If the file was read.
+         */
+        bool load(const std::string& path);
+    };
+}
@@ -0,0 +1,422 @@
+#include "Cascade.h"
+
+#include <opencv2/core/persistence.hpp>
+#include <opencv2/core/utility.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char CASCADE_MAGIC[8] = { 'E', 'Y', 'E', 'C', 'A', 'S', 'C', 0 };
+static const uint32_t CASCADE_VERSION = 1;
+
+// OpenCV lowers every stage threshold by this when it reads a cascade; so do we, to match it.
+static const float THRESHOLD_EPS = 1e-5f;
+// Rectangle grouping tolerance used by cv::CascadeClassifier.
+static const double GROUP_EPS = 0.2;
+// Maximum rectangles in a Haar feature.
+static const int MAX_FEATURE_RECTS = 3;
+
+// The file is a Header followed by the arrays, in this order, all 4 byte fields.
+struct camux::BinaryCascade::Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t window_width;
+    uint32_t window_height;
+    uint32_t num_stages;
+    uint32_t num_classifiers;
+    uint32_t num_nodes;
+    uint32_t num_leaves;
+    uint32_t num_features;
+    uint32_t has_tilted;
+    uint32_t reserved;
+};
+
+struct camux::BinaryCascade::Stage {
+    uint32_t first_classifier;
+    uint32_t num_classifiers;
+    float threshold;
+};
+
+struct camux::BinaryCascade::Classifier {
+    uint32_t first_node;
+    uint32_t first_leaf;
+};
+
+// left/right > 0 is another node of the same classifier, <= 0 is leaf -left/-right.
+struct camux::BinaryCascade::Node {
+    int32_t left;
+    int32_t right;
+    uint32_t feature;
+    float threshold;
+};
+
+struct camux::BinaryCascade::Feature {
+    uint32_t tilted;
+    uint32_t num_rects;
+    struct {
+        int32_t x, y, width, height;
+        float weight;
+    } rects[MAX_FEATURE_RECTS];
+};
+
+template <typename T>
+static bool write_array(FILE* file, const std::vector<T>& values) {
+    return values.empty() || std::fwrite(values.data(), sizeof(T), values.size(), file) == values.size();
+}
+
+bool camux::BinaryCascade::compile(const std::string& xml_path, const std::string& binary_path) {
+    cv::FileStorage fs;
+    try {
+        if (!fs.open(xml_path, cv::FileStorage::READ)) return false;
+    } catch (const cv::Exception&) {
+        return false;
+    }
+
+    cv::FileNode root = fs.getFirstTopLevelNode();
+    if ((std::string) root["stageType"] != "BOOST" || (std::string) root["featureType"] != "HAAR") return false;
+
+    Header header = {};
+    std::memcpy(header.magic, CASCADE_MAGIC, sizeof(CASCADE_MAGIC));
+    header.version = CASCADE_VERSION;
+    header.window_width = (int) root["width"];
+    header.window_height = (int) root["height"];
+
+    std::vector<Stage> stages;
+    std::vector<Classifier> classifiers;
+    std::vector<Node> nodes;
+    std::vector<float> leaves;
+    std::vector<Feature> features;
+
+    cv::FileNode stage_nodes = root["stages"];
+    for (cv::FileNodeIterator s = stage_nodes.begin(); s != stage_nodes.end(); ++s) {
+        Stage stage;
+        stage.first_classifier = classifiers.size();
+        stage.threshold = (float) (*s)["stageThreshold"] - THRESHOLD_EPS;
+
+        cv::FileNode weak = (*s)["weakClassifiers"];
+        for (cv::FileNodeIterator w = weak.begin(); w != weak.end(); ++w) {
+            Classifier classifier;
+            classifier.first_node = nodes.size();
+            classifier.first_leaf = leaves.size();
+
+            // Each node is "left right feature threshold".
+            cv::FileNode internal = (*w)["internalNodes"];
+            for (cv::FileNodeIterator n = internal.begin(); n != internal.end(); ) {
+                Node node;
+                node.left = (int) *n; ++n;
+                node.right = (int) *n; ++n;
+                node.feature = (int) *n; ++n;
+                node.threshold = (float) *n; ++n;
+                nodes.push_back(node);
+            }
+
+            cv::FileNode leaf_values = (*w)["leafValues"];
+            for (cv::FileNodeIterator l = leaf_values.begin(); l != leaf_values.end(); ++l) {
+                leaves.push_back((float) *l);
+            }
+
+            classifiers.push_back(classifier);
+        }
+
+        stage.num_classifiers = classifiers.size() - stage.first_classifier;
+        stages.push_back(stage);
+    }
+
+    // Each rect is "x y width height weight".
+    cv::FileNode feature_nodes = root["features"];
+    for (cv::FileNodeIterator f = feature_nodes.begin(); f != feature_nodes.end(); ++f) {
+        Feature feature;
+        std::memset(&feature, 0, sizeof(feature));
+        feature.tilted = (int) (*f)["tilted"] != 0;
+        header.has_tilted |= feature.tilted;
+
+        cv::FileNode rects = (*f)["rects"];
+        for (cv::FileNodeIterator r = rects.begin(); r != rects.end() && feature.num_rects < MAX_FEATURE_RECTS; ++r) {
+            cv::FileNodeIterator v = (*r).begin();
+            feature.rects[feature.num_rects].x = (int) *v; ++v;
+            feature.rects[feature.num_rects].y = (int) *v; ++v;
+            feature.rects[feature.num_rects].width = (int) *v; ++v;
+            feature.rects[feature.num_rects].height = (int) *v; ++v;
+            feature.rects[feature.num_rects].weight = (float) *v;
+            ++feature.num_rects;
+        }
+        features.push_back(feature);
+    }
+
+    // Check the structure now so loading never has to.
+    for (size_t i = 0; i < nodes.size(); ++i) {
+        if (nodes[i].feature >= features.size()) return false;
+    }
+    if (stages.empty() || header.window_width < 3 || header.window_height < 3) return false;
+
+    header.num_stages = stages.size();
+    header.num_classifiers = classifiers.size();
+    header.num_nodes = nodes.size();
+    header.num_leaves = leaves.size();
+    header.num_features = features.size();
+
+    FILE* file = std::fopen(binary_path.c_str(), "wb");
+    if (!file) return false;
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              write_array(file, stages) && write_array(file, classifiers) && write_array(file, nodes) &&
+              write_array(file, leaves) && write_array(file, features);
+
+    return std::fclose(file) == 0 && ok;
+}
+
+bool camux::BinaryCascade::load(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(Header)) {
+        ::close(fd);
+        return false;
+    }
+
+    size_ = st.st_size;
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+    data_ = static_cast<unsigned char*>(map);
+
+    header_ = reinterpret_cast<const Header*>(data_);
+    size_t expected = sizeof(Header) + header_->num_stages * sizeof(Stage) +
+                      header_->num_classifiers * sizeof(Classifier) + header_->num_nodes * sizeof(Node) +
+                      header_->num_leaves * sizeof(float) + header_->num_features * sizeof(Feature);
+
+    if (std::memcmp(header_->magic, CASCADE_MAGIC, sizeof(CASCADE_MAGIC)) != 0 ||
+        header_->version != CASCADE_VERSION || expected != size_) {
+        close();
+        return false;
+    }
+
+    const unsigned char* p = data_ + sizeof(Header);
+    stages_ = reinterpret_cast<const Stage*>(p);
+    p += header_->num_stages * sizeof(Stage);
+    classifiers_ = reinterpret_cast<const Classifier*>(p);
+    p += header_->num_classifiers * sizeof(Classifier);
+    nodes_ = reinterpret_cast<const Node*>(p);
+    p += header_->num_nodes * sizeof(Node);
+    leaves_ = reinterpret_cast<const float*>(p);
+    p += header_->num_leaves * sizeof(float);
+    features_ = reinterpret_cast<const Feature*>(p);
+
+    return true;
+}
+
+void camux::BinaryCascade::close() {
+    if (data_) munmap(data_, size_);
+
+    data_ = nullptr;
+    size_ = 0;
+    header_ = nullptr;
+    stages_ = nullptr;
+    classifiers_ = nullptr;
+    nodes_ = nullptr;
+    leaves_ = nullptr;
+    features_ = nullptr;
+}
+
+void camux::BinaryCascade::detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, std::vector<int>& levels,
+                                            std::vector<double>& weights, double scale_factor, int min_neighbors,
+                                            cv::Size min_size, cv::Size max_size, bool output_reject_levels) {
+    objects.clear();
+    levels.clear();
+    weights.clear();
+    if (empty() || gray.empty() || scale_factor <= 1) return;
+
+    cv::Size original(header_->window_width, header_->window_height);
+    if (max_size.area() == 0) max_size = gray.size();
+
+    // Same pyramid as cv::CascadeClassifier: shrink the image, keep the window at its trained size.
+    for (double factor = 1; ; factor *= scale_factor) {
+        cv::Size window(cvRound(original.width * factor), cvRound(original.height * factor));
+        if (window.width > max_size.width || window.height > max_size.height ||
+            window.width > gray.cols || window.height > gray.rows) break;
+        if (window.width < min_size.width || window.height < min_size.height) continue;
+
+        cv::Size scaled(cvRound(gray.cols / factor), cvRound(gray.rows / factor));
+        if (scaled.width < original.width || scaled.height < original.height) break;
+
+        cv::resize(gray, scaled_, scaled, 0, 0, cv::INTER_LINEAR);
+        if (header_->has_tilted) {
+            cv::integral(scaled_, sum_, sqsum_, tilted_, CV_32S, CV_64F);
+        } else {
+            cv::integral(scaled_, sum_, sqsum_, CV_32S, CV_64F);
+        }
+
+        _detectAtScale(sum_, sqsum_, tilted_, factor, window, factor > 2 ? 1 : 2, objects, weights);
+    }
+
+    if (output_reject_levels) {
+        levels.assign(objects.size(), header_->num_stages);
+        cv::groupRectangles(objects, levels, weights, min_neighbors, GROUP_EPS);
+    } else {
+        weights.clear();
+        cv::groupRectangles(objects, min_neighbors, GROUP_EPS);
+    }
+}
+
+void camux::BinaryCascade::_detectAtScale(const cv::Mat& sum, const cv::Mat& sqsum, const cv::Mat& tilted, double factor,
+                                          cv::Size window, int step, std::vector<cv::Rect>& objects,
+                                          std::vector<double>& weights) {
+    // Scan the same positions OpenCV does: x in [0, scaled width - window width), so the last
+    // position a window would just fit at isn't tried. The integral image is one bigger than the
+    // scaled image.
+    int width = sum.cols - 1 - header_->window_width;
+    int height = sum.rows - 1 - header_->window_height;
+    if (width <= 0 || height <= 0) return;
+
+    int rows = (height + step - 1) / step;
+    size_t first = objects.size();
+    std::mutex mutex;
+
+    // Rows of windows are independent, so spread them over OpenCV's thread pool.
+    cv::parallel_for_(cv::Range(0, rows), [&](const cv::Range& range) {
+        std::vector<cv::Rect> found;
+        std::vector<double> found_weights;
+
+        for (int row = range.start; row < range.end; ++row) {
+            int y = row * step;
+            for (int x = 0; x < width; x += step) {
+                const int* s = sum.ptr<int>(y) + x;
+                const double* sq = sqsum.ptr<double>(y) + x;
+                const int* t = tilted.empty() ? nullptr : tilted.ptr<int>(y) + x;
+
+                double weight;
+                int stage = _evaluate(s, sq, t, (int) (sum.step1()), (int) (sqsum.step1()), weight);
+
+                if (stage == (int) header_->num_stages) {
+                    found.push_back(cv::Rect(cvRound(x * factor), cvRound(y * factor), window.width, window.height));
+                    found_weights.push_back(weight);
+                }
+                // Like OpenCV, take a bigger step past windows the first stage rejects outright.
+                if (stage == 0) x += step;
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        objects.insert(objects.end(), found.begin(), found.end());
+        weights.insert(weights.end(), found_weights.begin(), found_weights.end());
+    });
+
+    // Threads finish in any order; sort this scale's detections so the output is deterministic.
+    std::vector<size_t> order(objects.size() - first);
+    for (size_t i = 0; i < order.size(); ++i) order[i] = first + i;
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return objects[a].y != objects[b].y ? objects[a].y < objects[b].y : objects[a].x < objects[b].x;
+    });
+
+    std::vector<cv::Rect> sorted_objects;
+    std::vector<double> sorted_weights;
+    for (size_t i = 0; i < order.size(); ++i) {
+        sorted_objects.push_back(objects[order[i]]);
+        sorted_weights.push_back(weights[order[i]]);
+    }
+    std::copy(sorted_objects.begin(), sorted_objects.end(), objects.begin() + first);
+    std::copy(sorted_weights.begin(), sorted_weights.end(), weights.begin() + first);
+}
+
+int camux::BinaryCascade::_evaluate(const int* sum, const double* sqsum, const int* tilted, int step, int sqstep,
+                                    double& weight) {
+    // Variance normalization over the window shrunk by a pixel on each side, as OpenCV does.
+    int nw = header_->window_width - 2;
+    int nh = header_->window_height - 2;
+    int n0 = step + 1, n1 = step + 1 + nw, n2 = step * (1 + nh) + 1, n3 = step * (1 + nh) + 1 + nw;
+    int q0 = sqstep + 1, q1 = sqstep + 1 + nw, q2 = sqstep * (1 + nh) + 1, q3 = sqstep * (1 + nh) + 1 + nw;
+
+    double area = nw * nh;
+    double valsum = sum[n0] - sum[n1] - sum[n2] + sum[n3];
+    double valsqsum = sqsum[q0] - sqsum[q1] - sqsum[q2] + sqsum[q3];
+    double nf = area * valsqsum - valsum * valsum;
+    if (nf <= 0) return -1;
+
+    float norm_factor = (float) (1. / std::sqrt(nf));
+    if (area * norm_factor >= 1e-1) return -1;
+
+    for (uint32_t si = 0; si < header_->num_stages; ++si) {
+        const Stage& stage = stages_[si];
+        double stage_sum = 0;
+
+        for (uint32_t ci = 0; ci < stage.num_classifiers; ++ci) {
+            const Classifier& classifier = classifiers_[stage.first_classifier + ci];
+            int idx = 0;
+
+            do {
+                const Node& node = nodes_[classifier.first_node + idx];
+                const Feature& feature = features_[node.feature];
+
+                float value = 0;
+                for (uint32_t r = 0; r < feature.num_rects; ++r) {
+                    int x = feature.rects[r].x, y = feature.rects[r].y;
+                    int w = feature.rects[r].width, h = feature.rects[r].height;
+                    int rect_sum;
+
+                    if (feature.tilted) {
+                        rect_sum = tilted[x + step * y] - tilted[x - h + step * (y + h)] -
+                                   tilted[x + w + step * (y + w)] + tilted[x + w - h + step * (y + w + h)];
+                    } else {
+                        rect_sum = sum[x + step * y] - sum[x + w + step * y] -
+                                   sum[x + step * (y + h)] + sum[x + w + step * (y + h)];
+                    }
+                    value += feature.rects[r].weight * rect_sum;
+                }
+                value *= norm_factor;
+
+                idx = value < node.threshold ? node.left : node.right;
+            } while (idx > 0);
+
+            stage_sum += leaves_[classifier.first_leaf - idx];
+        }
+
+        if (stage_sum < stage.threshold) return si;
+        weight = stage_sum;
+    }
+
+    return header_->num_stages;
+}
+
+bool camux::Cascade::load(const std::string& path) {
+    std::string extension = ".bin";
+    use_binary_ = path.size() >= extension.size() &&
+                  path.compare(path.size() - extension.size(), extension.size(), extension) == 0;
+
+    return use_binary_ ? binary_.load(path) : classifier_.load(path);
+}
+
+void camux::Cascade::detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, double scale_factor,
+                                      int min_neighbors, cv::Size min_size, cv::Size max_size) {
+    if (use_binary_) {
+        std::vector<int> levels;
+        std::vector<double> weights;
+        binary_.detectMultiScale(gray, objects, levels, weights, scale_factor, min_neighbors, min_size, max_size, false);
+    } else {
+        classifier_.detectMultiScale(gray, objects, scale_factor, min_neighbors, 0, min_size, max_size);
+    }
+}
+
+void camux::Cascade::detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, std::vector<int>& levels,
+                                      std::vector<double>& weights, double scale_factor, int min_neighbors,
+                                      cv::Size min_size, cv::Size max_size) {
+    if (use_binary_) {
+        binary_.detectMultiScale(gray, objects, levels, weights, scale_factor, min_neighbors, min_size, max_size, true);
+    } else {
+        classifier_.detectMultiScale(gray, objects, levels, weights, scale_factor, min_neighbors, 0, min_size, max_size, true);
+    }
+}
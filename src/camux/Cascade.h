@@ -0,0 +1,151 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include "opencv2/objdetect/objdetect.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief A Haar cascade (OpenCV's "BOOST"/"HAAR" format, stumps or trees, upright or tilted
+     *  features) compiled to a flat binary file that is memory-mapped rather than parsed.
+     *
+     *  Parsing the XML cascades is most of our startup time on slow disks: the face cascade alone
+     *  is ~24k lines of text. The binary form is a header followed by flat arrays of stages,
+     *  classifiers, tree nodes, leaves and features; load() maps the file and points at the
+     *  arrays, no parsing and no copies.
+     *
+     *  OpenCV's CascadeClassifier can only be built from XML/YAML, so this also evaluates the
+     *  cascade itself. It follows OpenCV's evaluation exactly (same image pyramid, variance
+     *  normalization, step sizes and grouping), so it finds the same objects;
+     *  eye_mouse_cascade_check compares the two on recordings.
+     *
+     *  Compile cascades with eye_mouse_cascade_compile (or the `cascades` build target).
+     */
+    class BinaryCascade {
+    public:
+        BinaryCascade() {};
+        ~BinaryCascade() { close(); }
+
+        BinaryCascade(const BinaryCascade&) = delete;
+        BinaryCascade& operator=(const BinaryCascade&) = delete;
+
+        /**
+         * @brief Convert an OpenCV XML cascade to the binary format.
+         *
+         * @param xml_path The OpenCV cascade, e.g haarcascades/haarcascade_eye.xml
+         * @param binary_path Where to write the binary cascade.
+         * @return true If the cascade was converted. Fails on cascades that aren't Haar/BOOST.
+         */
+        static bool compile(const std::string& xml_path, const std::string& binary_path);
+
+        /**
+         * @brief Map a compiled cascade.
+         *
+         * @param path The binary cascade.
+         * @return true If the file is a binary cascade we can use.
+         */
+        bool load(const std::string& path);
+        void close();
+
+        bool empty() { return data_ == nullptr; }
+
+        /**
+         * @brief Same as cv::CascadeClassifier::detectMultiScale.
+         *
+         * @param gray The 8 bit grayscale image to search.
+         * @param objects The detections.
+         * @param levels If output_reject_levels, the stage each detection reached (all of them).
+         * @param weights If output_reject_levels, the final stage sum of each detection - the
+         *  detection's confidence.
+         * @param scale_factor How much the search window grows between scales.
+         * @param min_neighbors How many overlapping raw detections a detection needs to be kept.
+         * @param min_size The smallest window to try.
+         * @param max_size The largest window to try, or empty for no limit.
+         * @param output_reject_levels Whether to fill in levels and weights.
+         */
+        void detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, std::vector<int>& levels,
+                              std::vector<double>& weights, double scale_factor, int min_neighbors,
+                              cv::Size min_size, cv::Size max_size, bool output_reject_levels);
+
+    private:
+        // Layout of the mapped file, see Cascade.cpp.
+        struct Header;
+        struct Stage;
+        struct Classifier;
+        struct Node;
+        struct Feature;
+
+        /**
+         * @brief Run every window of one pyramid level through the cascade.
+         */
+        void _detectAtScale(const cv::Mat& sum, const cv::Mat& sqsum, const cv::Mat& tilted, double factor,
+                            cv::Size window, int step, std::vector<cv::Rect>& objects, std::vector<double>& weights);
+
+        /**
+         * @brief Evaluate the cascade on the window at (x, y) of the integral images.
+         *
+         * @return The number of stages passed (num_stages if the window is a detection, in which
+         *  case weight is set to the last stage's sum), or -1 if the window is too flat to test.
+         */
+        int _evaluate(const int* sum, const double* sqsum, const int* tilted, int step, int sqstep,
+                       double& weight);
+
+        unsigned char* data_ = nullptr;
+        size_t size_ = 0;
+
+        const Header* header_ = nullptr;
+        const Stage* stages_ = nullptr;
+        const Classifier* classifiers_ = nullptr;
+        const Node* nodes_ = nullptr;
+        const float* leaves_ = nullptr;
+        const Feature* features_ = nullptr;
+
+        // Pyramid buffers, reused between calls.
+        cv::Mat scaled_, sum_, sqsum_, tilted_;
+    };
+
+    /**
+     * @brief A Haar cascade loaded from either format: a compiled binary cascade (.bin) or an
+     *  OpenCV XML cascade. Both detect the same objects; the binary one loads much faster.
+     *
+     */
+    class Cascade {
+    public:
+        Cascade() {};
+
+        /**
+         * @brief Load a cascade. Files ending in .bin are loaded as compiled binary cascades,
+         *  anything else with cv::CascadeClassifier.
+         *
+         * @param path The cascade file.
+         * @return true If it loaded.
+         */
+        bool load(const std::string& path);
+
+        bool empty() { return use_binary_ ? binary_.empty() : classifier_.empty(); }
+        bool isBinary() { return use_binary_; }
+
+        /**
+         * @brief See cv::CascadeClassifier::detectMultiScale.
+         */
+        void detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, double scale_factor,
+                              int min_neighbors, cv::Size min_size, cv::Size max_size = cv::Size());
+
+        /**
+         * @brief See cv::CascadeClassifier::detectMultiScale. Always outputs reject levels.
+         */
+        void detectMultiScale(const cv::Mat& gray, std::vector<cv::Rect>& objects, std::vector<int>& levels,
+                              std::vector<double>& weights, double scale_factor, int min_neighbors,
+                              cv::Size min_size, cv::Size max_size = cv::Size());
+
+    private:
+        bool use_binary_ = false;
+        BinaryCascade binary_;
+        cv::CascadeClassifier classifier_;
+    };
+}
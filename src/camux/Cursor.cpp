@@ -0,0 +1,76 @@
+#include "Cursor.h"
+
+#include <csignal>
+#include <ctime>
+
+#include <pthread.h>
+
+namespace {
+    /**
+     * @brief Blocks SIGPIPE on this thread while it's in scope, so writing to a pipe whose reader
+     *  died fails with EPIPE rather than killing the process, without touching the process-wide
+     *  handler the host may rely on. A SIGPIPE raised in scope is discarded on the way out.
+     */
+    class SigpipeBlock {
+    public:
+        SigpipeBlock() {
+            sigemptyset(&pipe_);
+            sigaddset(&pipe_, SIGPIPE);
+
+            sigset_t pending;
+            sigpending(&pending);
+            was_pending_ = sigismember(&pending, SIGPIPE);
+            pthread_sigmask(SIG_BLOCK, &pipe_, &old_);
+        }
+
+        ~SigpipeBlock() {
+            sigset_t pending;
+            sigpending(&pending);
+            if (!was_pending_ && sigismember(&pending, SIGPIPE)) {
+                struct timespec zero = { 0, 0 };
+                sigtimedwait(&pipe_, nullptr, &zero);
+            }
+            pthread_sigmask(SIG_SETMASK, &old_, nullptr);
+        }
+
+    private:
+        sigset_t pipe_, old_;
+        bool was_pending_;
+    };
+}
+
+bool camux::XdotoolCursor::open() {
+    close();
+
+    // "xdotool -" runs commands from stdin as they arrive.
+    pipe_ = popen("xdotool -", "w");
+    return pipe_ != nullptr;
+}
+
+void camux::XdotoolCursor::close() {
+    if (pipe_) {
+        // Flushes what's left, which fails if xdotool has died.
+        SigpipeBlock block;
+        pclose(pipe_);
+    }
+    pipe_ = nullptr;
+    last_ = cv::Point(-1, -1);
+}
+
+bool camux::XdotoolCursor::move(const cv::Point& screen) {
+    if (!pipe_) return false;
+    if (screen == last_) return true;
+
+    // If xdotool dies, fail the write rather than being killed by SIGPIPE.
+    bool written;
+    {
+        SigpipeBlock block;
+        written = std::fprintf(pipe_, "mousemove %d %d\n", screen.x, screen.y) >= 0 && std::fflush(pipe_) == 0;
+    }
+    if (!written) {
+        close();
+        return false;
+    }
+    last_ = screen;
+    return true;
+}
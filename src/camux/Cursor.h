@@ -0,0 +1,54 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <cstdio>
+
+namespace camux {
+
+    /**
+     * @brief Where gaze points end up: the system cursor, or anything standing in for it.
+     */
+    class CursorSink {
+    public:
+        virtual ~CursorSink() {};
+
+        /**
+         * @brief Move the cursor. Returns once the move has been handed to whatever carries it
+         *  out, which is the point end-to-end latency is measured to.
+         *
+         * @param screen The point on the screen, in pixels.
+         * @return true If the move was handed off.
+         */
+        virtual bool move(const cv::Point& screen) = 0;
+    };
+
+    /**
+     * @brief Moves the X cursor through one long running xdotool process reading commands from a
+     *  pipe, so a move costs a write() rather than starting a process (as the sample app's
+     *  system("xdotool ...") did).
+     */
+    class XdotoolCursor : public CursorSink {
+    public:
+        XdotoolCursor() {};
+        ~XdotoolCursor() { close(); }
+
+        XdotoolCursor(const XdotoolCursor&) = delete;
+        XdotoolCursor& operator=(const XdotoolCursor&) = delete;
+
+        /**
+         * @brief Start xdotool.
+         *
+         * @return true If it started.
+         */
+        bool open();
+        void close();
+        bool isOpen() { return pipe_ != nullptr; }
+
+        bool move(const cv::Point& screen) override;
+
+    private:
+        FILE* pipe_ = nullptr;
+        cv::Point last_ = cv::Point(-1, -1);
+    };
+}
@@ -1,15 +1,40 @@
 #include "Eye.h"
+#include "PupilObjective.h"
 
-#include <opencv2/highgui.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
 
 // For pupil isolation. The pupil boundaries will have a relatively large gradient. We threshold out
-// any gradients too small, and we define too small as a multiple of the mean gradient. This parameter defines
-// the constant of proportionality. The higher it is, the more pixels we threshold out (meaning we check fewer) for
-// being the pupil. This decreases runtime dramatically. But, too high and you risk filtering out the pupil and
-// increasing your false detection rate. Right now it is defined statically, in the future it should start out very
-// low and be updated/learned to increase over the course of the calibration process.
-const double STRONG_GRADIENT_THRESHOLD = 2.5;
-const double DARK_PIXEL_THRESHOLD = .8;
+// any gradients too small, and we define too small as a multiple of the mean gradient. The constant of
+// proportionality (and the one for the dark pixel threshold) is adapted per eye by the ThresholdController:
+// the higher it is, the more pixels we threshold out (meaning we check fewer) for being the pupil. This
+// decreases runtime dramatically. But, too high and you risk filtering out the pupil and increasing your
+// false detection rate, so the controller keeps the number of strong gradients inside a target range.
+
+// Warm start: the window around the last center is this fraction of the crop width either side of
+// it, but at least WARM_MIN_RADIUS pixels.
+const double WARM_RADIUS = 0.125;
+const int WARM_MIN_RADIUS = 3;
+// The window's best is kept if its score is at least this fraction of the last full search's.
+const double WARM_MIN_CONFIDENCE = 0.75;
+// Search the whole crop at least this often, so the reference score follows lighting and gaze.
+const int WARM_FULL_INTERVAL = 15;
+// The eye box moved more than this fraction of its size since the last frame (re-detected, or the
+// head moved fast), or the crop was resized by more than this: the last center says little.
+const double WARM_MAX_BOX_CHANGE = 0.25;
+const double WARM_MAX_CROP_CHANGE = 0.1;
+// The center moved more than this fraction of the window radius last frame: a saccade is under way.
+const double WARM_SACCADE = 0.5;
+
+// Searches of more than this many candidate x gradient evaluations (a few milliseconds on one core)
+// are spread over OpenCV's threads. Webcam crops stay well under it; near-eye crops are far over.
+const double PARALLEL_MIN_WORK = 2e6;
+
+static int64_t elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
 
 cv::Point2u camux::Eye::findPupilCenter(cv::Mat& eye) {
     cv::Mat sobel_x, sobel_y;
@@ -17,7 +42,17 @@ cv::Point2u camux::Eye::findPupilCenter(cv::Mat& eye) {
 
     std::vector<cv::Vec3f> circles;
 
-    if (eye.empty()) return center_;
+    if (eye.empty()) {
+        has_last_ = false;
+        return center_;
+    }
+
+    // No point localizing a pupil behind a closed lid - it'd just be noise.
+    _updateBlinkState(eye);
+    if (_blink().isClosed()) {
+        has_last_ = false;
+        return center_;
+    }
 
     cv::Point2u center = _gradientIntersectionIsolation(eye); 
 
@@ -41,7 +76,7 @@ cv::Point2u camux::Eye::findPupilCenter(cv::Mat& eye) {
 
     // cv::imshow("Homogeneous Blur", eye_homogeneous_blur);
     // cv::imshow("Gaussian Blur", eye_gaussian);
-    cv::imshow("Median Blur", eye_median);
+    _show("Median Blur", eye_median);
     // cv::imshow("Bilateral filter", eye_bilateral);
 
     // Threshold the eye image to only select the darker parts of the image. TODO:
@@ -56,9 +91,9 @@ cv::Point2u camux::Eye::findPupilCenter(cv::Mat& eye) {
     cv::threshold(eye_median, threshold_1, 1, 255, 1);
     cv::threshold(eye_median, threshold_3, 3, 255, 1);
     cv::threshold(eye_median, threshold_5, 5, 255, 1);
-    cv::imshow("Median threshold 1", threshold_1);
-    cv::imshow("Median threshold 3", threshold_3);
-    cv::imshow("Median threshold 5", threshold_5);
+    _show("Median threshold 1", threshold_1);
+    _show("Median threshold 3", threshold_3);
+    _show("Median threshold 5", threshold_5);
 
     // Experiment: Active thresholding (make sure to disable equalizing histogram)
     // Conclusion: Adaptive thresholding finds the contours/boundaries of the eyes well. It does not work when
@@ -72,7 +107,7 @@ cv::Point2u camux::Eye::findPupilCenter(cv::Mat& eye) {
     // cv::imshow("C=5 Adaptive", adaptive_threshold_C5);
 
     cv::dilate(threshold_3, result, cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5)));
-    cv::imshow("Dilation", result);
+    _show("Dilation", result);
 
     // Approximates the image gradients. Useful for the pupil isolation approach of maximizing the dot 
     // product of an image location->gradient vector with that of the unit gradient vector 
@@ -109,33 +144,11 @@ cv::Point2u camux::Eye::_gradientIntersectionIsolation(cv::Mat & eye) {
     //      direction. Get the total gradient magnitudes. Find the mean of the magnitude squared
     //      of the total gradients. Choose a threshold as some proportion of that mean 
     //      (try sqrt(.6) from Optimeyes). Get normalized gradients in the x and y direction
-    cv::Mat gray, sobel_x, sobel_y, sobel_magnitude;
-    cv::Mat abs_sobel_x, abs_sobel_y, abs_sobel_magnitude;
-
-    cv::cvtColor(eye, gray, cv::COLOR_BGR2GRAY);
-
-    cv::Sobel(gray, sobel_x, CV_32F, 1, 0);
-    cv::Sobel(gray, sobel_y, CV_32F, 0, 1);
-    
-    cv::magnitude(sobel_x, sobel_y, sobel_magnitude);
-
-    // Convert to 8 bit to display. CV_32 if a float value; if you try to display it will cast any
-    // binary number equivalently above 255 in unsigned 8 bit to white.
-    cv::convertScaleAbs(sobel_x, abs_sobel_x);
-    cv::convertScaleAbs(sobel_y, abs_sobel_y);
-    cv::convertScaleAbs(sobel_magnitude, abs_sobel_magnitude);
-
-    // cv::normalize(abs_sobel_x, abs_sobel_x, 1, cv::NORM_L2);
-    // cv::normalize(abs_sobel_y, abs_sobel_y, 1, cv::NORM_L2);
-
-    cv::imshow("X sobel", abs_sobel_x);
-    cv::imshow("Y Sobel", abs_sobel_y);
-    cv::imshow("Sobel magnitude", abs_sobel_magnitude);
-
-    // 2. Create a boolean 2d array that can index into the image (same width and height). An index
-    //      in the bool area is true iff the gradient at the corresponding image index is greater than
-    //      the threshold we defined. This step severly decreases computational complexity later. We only 
-    //      care about strong gradients because these are close to borders of dark areas. 
+    //
+    // 2. Only keep the strong gradients, over that threshold. This step severly decreases computational
+    //      complexity later. We only care about strong gradients because these are close to borders of
+    //      dark areas. I tried adaptive thresholding here; it was slower and had no better / slightly worse
+    //      ability to always show the pupil than the "dumb" thresholding.
     //
     //    Remember we observe that the pupil center is the point at which all of the gradient
     //      of the pupil edge intersect. 
@@ -148,37 +161,130 @@ cv::Point2u camux::Eye::_gradientIntersectionIsolation(cv::Mat & eye) {
     //       *  /  \  *     That's true generally of the relationship between points on the outside of the ellipse
     //         *    *       and the center.
     //           **
-    cv::Mat grads_to_use, abs_grads_to_use;
-    cv::Mat grad_X, grad_Y;
-
-    // I tried adaptive thresholding here; it was slower and had no better / slightly worse ability to always
-    // show the pupil than the "dumb" thresholding.
-    cv::Scalar magnitude_threshold = cv::mean(sobel_magnitude) * STRONG_GRADIENT_THRESHOLD;     
-    cv::threshold(sobel_magnitude, grads_to_use, magnitude_threshold[0], 255, cv::THRESH_TOZERO);
-    
-    cv::convertScaleAbs(grads_to_use, abs_grads_to_use);
-    cv::imshow("Gradients to check", abs_grads_to_use);
-
-    cv::divide(sobel_x, grads_to_use, grad_X);
-    cv::divide(sobel_x, grads_to_use, grad_Y);
-
+    //
     // 3. Perform a binary threshold on the greyscale image as a certain percentage of the mean. Dilate this to
     //      remove bright reflections in the dark ellipse.
-    cv::Mat dark_eye;
+    //
+    // 4. Get a list of the coordinates of the gradients to use. Every candidate center is checked against
+    //      every one of these, so this list is what the thresholds are really controlling.
+    //
+    // The preprocessor does all four in two passes over the crop (see EyePreprocessor).
+    preprocessor_.run(eye, threshold_controller_.getGradientThreshold(), threshold_controller_.getDarkThreshold(),
+                      gradients_);
+    const cv::Mat & weights = preprocessor_.getWeights();
+    const cv::Mat & dark_eye = preprocessor_.getDark();
+
+    if (debug_view_) {
+        // Convert to 8 bit to display. CV_32 if a float value; if you try to display it will cast any
+        // binary number equivalently above 255 in unsigned 8 bit to white.
+        cv::Mat abs_sobel_x, abs_sobel_y, abs_sobel_magnitude, grads_to_use, abs_grads_to_use;
+        cv::convertScaleAbs(preprocessor_.getGradientX(), abs_sobel_x);
+        cv::convertScaleAbs(preprocessor_.getGradientY(), abs_sobel_y);
+        cv::convertScaleAbs(preprocessor_.getMagnitude(), abs_sobel_magnitude);
+
+        _show("X sobel", abs_sobel_x);
+        _show("Y Sobel", abs_sobel_y);
+        _show("Sobel magnitude", abs_sobel_magnitude);
+
+        cv::threshold(preprocessor_.getMagnitude(), grads_to_use, preprocessor_.getMagnitudeThreshold(), 255,
+                      cv::THRESH_TOZERO);
+        cv::convertScaleAbs(grads_to_use, abs_grads_to_use);
+        _show("Gradients to check", abs_grads_to_use);
+    }
+
+    _show("Dark parts of eye", dark_eye);
+
+    // 5. Evaluate the objective at each dark pixel, weighting by darkness (the pupil is the darkest
+    //      part of the eye), and take the best as the center. Near the last center first, if it's
+    //      worth trying (see setWarmStart()).
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    cv::Point previous = has_last_ ? cv::Point(cvRound(center_.x * (double) eye.cols / last_crop_.width),
+                                               cvRound(center_.y * (double) eye.rows / last_crop_.height)) : center_;
+    double score = 0;
+    cv::Point best(-1, -1);
+    cv::Rect window;
+
+    if (_warmWindow(eye.size(), window)) {
+        ++search_stats_.attempts;
+        best = _maximizeObjective(weights, dark_eye, window, score);
+
+        // On an edge of the window that isn't the crop's, the pupil has probably moved out of it.
+        bool on_edge = (best.x == window.x && window.x > 0) || (best.y == window.y && window.y > 0) ||
+                       (best.x == window.br().x - 1 && window.br().x < eye.cols) ||
+                       (best.y == window.br().y - 1 && window.br().y < eye.rows);
+        if (best.x >= 0 && !on_edge && score >= WARM_MIN_CONFIDENCE * reference_score_) {
+            ++search_stats_.hits;
+        } else {
+            best = cv::Point(-1, -1);
+        }
+    }
 
-    cv::Scalar dark_threshold = cv::mean(gray) * DARK_PIXEL_THRESHOLD;
-    cv::threshold(gray, dark_eye, dark_threshold[0], 255, cv::THRESH_BINARY);
-    cv::dilate(dark_eye, dark_eye, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3))); 
+    if (best.x < 0) {
+        std::chrono::steady_clock::time_point full_start = std::chrono::steady_clock::now();
+        best = _maximizeObjective(weights, dark_eye, cv::Rect(0, 0, eye.cols, eye.rows), score);
+        ++search_stats_.full_searches;
+        search_stats_.full_us += elapsed_us(full_start);
+        reference_score_ = score;
+        searches_since_full_ = 0;
+    } else {
+        ++searches_since_full_;
+    }
+    ++search_stats_.searches;
+    search_stats_.total_us += elapsed_us(start);
 
-    cv::imshow("Dark parts of eye", dark_eye);
+    last_motion_ = has_last_ && best.x >= 0 ? cv::norm(best - previous) : 0;
+    has_last_ = best.x >= 0;
+    last_crop_ = eye.size();
+    last_coords_ = coords_;
 
-    // 4. Get a list of the coordinates of the gradients to use
+    if (best.x >= 0) {
+        center_ = best;
+        pupil_score_ = score;
+    }
 
-    // 5. 
+    threshold_controller_.update(gradients_.size(), cv::countNonZero(dark_eye), eye.total(), center_);
 
     return center_;
 }
 
+cv::Point camux::Eye::_maximizeObjective(const cv::Mat & weights, const cv::Mat & candidates, const cv::Rect & window,
+                                         double & score) {
+    if ((double) window.area() * gradients_.size() < PARALLEL_MIN_WORK) {
+        return camux::maximizePupilObjective(gradients_, weights, candidates, window, score);
+    }
+    return camux::maximizePupilObjectiveParallel(gradients_, weights, candidates, window, score);
+}
+
+bool camux::Eye::_warmWindow(const cv::Size & crop, cv::Rect & window) {
+    if (!warm_start_ || !has_last_ || searches_since_full_ >= WARM_FULL_INTERVAL) return false;
+
+    // The crop is in a different scale, or the box jumped rather than followed the head.
+    double scale_x = (double) crop.width / last_crop_.width, scale_y = (double) crop.height / last_crop_.height;
+    if (std::abs(scale_x - 1) > WARM_MAX_CROP_CHANGE || std::abs(scale_y - 1) > WARM_MAX_CROP_CHANGE) return false;
+    if (std::abs(coords_.x - last_coords_.x) > WARM_MAX_BOX_CHANGE * coords_.width ||
+        std::abs(coords_.y - last_coords_.y) > WARM_MAX_BOX_CHANGE * coords_.height ||
+        std::abs(coords_.width - last_coords_.width) > WARM_MAX_BOX_CHANGE * coords_.width) {
+        return false;
+    }
+
+    int radius = std::max(WARM_MIN_RADIUS, cvRound(crop.width * WARM_RADIUS));
+    if (last_motion_ > WARM_SACCADE * radius) return false;
+
+    // The box follows the head, so a pupil that hasn't moved in the head is where it was in the box:
+    // the last center, scaled with the crop.
+    cv::Point center(cvRound(center_.x * scale_x), cvRound(center_.y * scale_y));
+    window = cv::Rect(center.x - radius, center.y - radius, 2 * radius + 1, 2 * radius + 1) & cv::Rect(cv::Point(), crop);
+    return window.area() > 0;
+}
+
+void camux::Eye::_updateBlinkState(const cv::Mat & eye) {
+    // Switch measure without resetting: the other detector keeps its baseline for when we switch
+    // back, and this one picks up where it left off.
+    landmark_openness_ = landmarks_.size() == 6;
+    _blink().update(landmark_openness_ ? camux::eyeAspectRatio(landmarks_) : camux::darkPixelOpenness(eye));
+    landmarks_.clear();
+}
+
 double camux::Eye::_estimateCenterProbabilityHist() {
  
     return 10;
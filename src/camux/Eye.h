@@ -1,9 +1,46 @@
 #pragma once
 
 #include "geometry.hpp"
+#include "Blink.h"
+#include "EyePreprocessor.h"
+#include "PupilObjective.h"
+#include "ThresholdController.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
 
 namespace camux {
+
+    /**
+     * @brief Somewhere to show a named intermediate image, e.g cv::imshow.
+     */
+    typedef std::function<void(const std::string& name, const cv::Mat& image)> DebugView;
     
+    /**
+     * @brief Counters of an eye's pupil searches, to see what the warm start (see
+     *  Eye::setWarmStart()) is worth.
+     */
+    struct PupilSearchStats {
+        // Searches (frames with the eye open), ones that tried the window around the last center
+        // first, and ones whose window result was kept.
+        uint64_t searches = 0;
+        uint64_t attempts = 0;
+        uint64_t hits = 0;
+        // Full searches of the crop, and the time (microseconds) spent in them and in all searches.
+        uint64_t full_searches = 0;
+        int64_t full_us = 0;
+        int64_t total_us = 0;
+
+        double hitRate() const { return attempts ? (double) hits / attempts : 0; }
+        // The mean full search's time over the mean search's: how much faster searching is than if
+        // every frame searched the whole crop.
+        double speedup() const {
+            if (!full_searches || !searches || total_us <= 0) return 1;
+            return ((double) full_us / full_searches) / ((double) total_us / searches);
+        }
+    };
+
     // EyeType enum useful for
     enum EyeType {
         Left,
@@ -29,13 +66,68 @@ namespace camux {
         cv::Rect getCoords() { return coords_; }
         int getPupilRadius() { return pupil_radius_; }
 
+        /**
+         * @brief Find the center of the pupil in a crop of this eye. Also updates the blink state
+         *  first; if the eye is closed the pupil search is skipped and the last center is returned.
+         *
+         * @param eye The crop of the frame bounded by this eye's coordinates.
+         * @return cv::Point2u The pupil center, relative to the crop.
+         */
         cv::Point2u findPupilCenter(cv::Mat& eye);
 
+        /**
+         * @brief Set the six landmarks around this eye for the current frame (Dlib_68 only). They're
+         *  used for the eye aspect ratio on the next findPupilCenter() call and then dropped, so
+         *  detectors that don't provide landmarks fall back to the intensity estimate.
+         *
+         * @param landmarks The six eye landmarks, in frame coordinates.
+         */
+        void setLandmarks(const Points& landmarks) { landmarks_ = landmarks; }
+
+        // Blink/closure state as of the last findPupilCenter() call.
+        bool isClosed() { return _blink().isClosed(); }
+        bool blinked() { return _blink().blinked(); }
+        int getBlinkCount() { return landmark_blink_.getBlinkCount() + intensity_blink_.getBlinkCount(); }
+        double getOpenness() { return _blink().getOpenness(); }
+
+        /**
+         * @brief The controller adapting this eye's pupil localizer thresholds. Saved and restored
+         *  with the calibration profile.
+         */
+        ThresholdController & getThresholdController() { return threshold_controller_; }
+
+        /**
+         * @brief Search for the pupil in a window around the last center first, falling back to the
+         *  whole crop when that result isn't convincing (the default), or always search the whole
+         *  crop.
+         *
+         *  Pupils move a few pixels a frame except in saccades, and the objective costs candidates x
+         *  gradients, so a window a fraction of the crop's size is most of the search's time saved.
+         *  The window's result is kept only if its score is close to the last full search's and it
+         *  isn't on the window's edge (the pupil may have left it). The whole crop is searched
+         *  instead after a blink, a jump of the eye box, a saccade, and every so often anyway, to
+         *  keep the reference score fresh.
+         */
+        void setWarmStart(bool warm_start) { warm_start_ = warm_start; }
+        bool isWarmStart() { return warm_start_; }
+        const PupilSearchStats & getSearchStats() { return search_stats_; }
+
+        // The weighted objective of the last localized center, and how many strong gradients fed it.
+        double getPupilScore() { return pupil_score_; }
+        int getStrongGradientCount() { return gradients_.size(); }
+
         int getEyeArea() { return coords_.height * coords_.width; }
 
         void setConfidence(double conf) { confidence_ = conf; }
         double getConfidence() { return confidence_; }
 
+        /**
+         * @brief Where findPupilCenter() shows its intermediate images. None by default, so the
+         *  tracker itself needs no GUI. Only give a HighGUI view to an eye processed on the main
+         *  thread (HighGUI isn't thread safe).
+         */
+        void setDebugView(const DebugView& view) { debug_view_ = view; }
+
     private:
         /**
          * @brief A method of finding a dark ellipse in an image (e.g a pupil in an eye) via
@@ -60,14 +152,74 @@ namespace camux {
          */
         cv::Point2u _gradientIntersectionIsolation(cv::Mat & eye);
 
+        /**
+         * @brief Where to look first for the pupil in this crop: around the last center, carried
+         *  along with the eye box.
+         *
+         * @param crop The size of the crop.
+         * @param window Set to the window, clipped to the crop.
+         * @return true If there's a window worth trying, false for a full search.
+         */
+        bool _warmWindow(const cv::Size & crop, cv::Rect & window);
+
+        /**
+         * @brief maximizePupilObjective() over the strong gradients, on OpenCV's threads if the
+         *  window is big enough to be worth it (same result either way).
+         */
+        cv::Point _maximizeObjective(const cv::Mat & weights, const cv::Mat & candidates, const cv::Rect & window,
+                                     double & score);
+
         double _estimateCenterProbabilityHist();
 
+        /**
+         * @brief Measure how open the eye is (EAR from the landmarks if we were given any this
+         *  frame, otherwise the dark pixel fraction of the crop) and feed it to the blink detector.
+         *
+         * @param eye The crop of the frame bounded by this eye's coordinates.
+         */
+        void _updateBlinkState(const cv::Mat & eye);
+
+        // The blink detector for the openness measure in use.
+        BlinkDetector & _blink() { return landmark_openness_ ? landmark_blink_ : intensity_blink_; }
+
+        // Show an intermediate image, if there's a debug view.
+        void _show(const std::string & name, const cv::Mat & image) { if (debug_view_) debug_view_(name, image); }
+
 
         EyeType type_;
         cv::Rect coords_;
         cv::Point center_;
-        int pupil_radius_;
-        double confidence_;
+        int pupil_radius_ = 0;
+        double confidence_ = 0;
+
+        // Landmarks for the current frame, empty unless the detector provides them.
+        Points landmarks_;
+        // Whether the last openness came from landmarks or intensity. The two measurements have
+        // different scales, so each keeps its own baseline; a frame without landmarks in Dlib
+        // mode then doesn't cost the calibrated landmark baseline.
+        bool landmark_openness_ = false;
+        BlinkDetector landmark_blink_;
+        BlinkDetector intensity_blink_;
+
+        ThresholdController threshold_controller_;
+        // The strong gradients of the last crop. Kept to reuse the allocation.
+        std::vector<GradientSample> gradients_;
+        // Its buffers are kept between crops too.
+        EyePreprocessor preprocessor_;
+        double pupil_score_ = 0;
+
+        // Warm start state: whether center_ came from a search on the last frame, the crop and eye
+        // box it was found in, how far it moved, and the score of the last full search.
+        bool warm_start_ = true;
+        bool has_last_ = false;
+        cv::Size last_crop_;
+        cv::Rect last_coords_;
+        double last_motion_ = 0;
+        double reference_score_ = 0;
+        int searches_since_full_ = 0;
+        PupilSearchStats search_stats_;
+
+        DebugView debug_view_;
     };
 }
 
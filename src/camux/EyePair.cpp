@@ -0,0 +1,114 @@
+#include "EyePair.h"
+
+#include <chrono>
+
+static int64_t elapsed_us(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+}
+
+camux::EyePair::EyePair(camux::Eye& left, camux::Eye& right) : left_(left), right_(right) {
+    setConcurrent(std::thread::hardware_concurrency() > 1);
+}
+
+camux::EyePair::~EyePair() {
+    _stopWorker();
+}
+
+void camux::EyePair::setConcurrent(bool concurrent) {
+    if (concurrent == concurrent_) return;
+
+    if (concurrent) {
+        stop_ = false;
+        worker_ = std::thread(&camux::EyePair::_worker, this);
+    } else {
+        _stopWorker();
+    }
+
+    if (concurrent) right_.setDebugView(DebugView());
+    concurrent_ = concurrent;
+}
+
+void camux::EyePair::findPupilCenters(cv::Mat& left_crop, cv::Mat& right_crop, cv::Point& left_center,
+                                      cv::Point& right_center) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    if (!concurrent_) {
+        left_center = left_.findPupilCenter(left_crop);
+        left_us_ = elapsed_us(start);
+
+        std::chrono::steady_clock::time_point right_start = std::chrono::steady_clock::now();
+        right_center = right_.findPupilCenter(right_crop);
+        right_us_ = elapsed_us(right_start);
+
+        latency_us_ = elapsed_us(start);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        right_crop_ = &right_crop;
+        pending_ = true;
+    }
+    wake_.notify_one();
+
+    // The worker still has the right crop until it's done, so wait for it even if this eye throws.
+    std::exception_ptr left_error;
+    try {
+        left_center = left_.findPupilCenter(left_crop);
+    } catch (...) {
+        left_error = std::current_exception();
+    }
+    left_us_ = elapsed_us(start);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return !pending_; });
+    right_center = right_center_;
+    std::exception_ptr right_error = right_error_;
+    right_error_ = nullptr;
+    lock.unlock();
+
+    latency_us_ = elapsed_us(start);
+    if (left_error) std::rethrow_exception(left_error);
+    if (right_error) std::rethrow_exception(right_error);
+}
+
+void camux::EyePair::_worker() {
+    std::unique_lock<std::mutex> lock(mutex_);
+
+    for (;;) {
+        wake_.wait(lock, [this] { return pending_ || stop_; });
+        if (stop_) return;
+
+        cv::Mat* crop = right_crop_;
+        lock.unlock();
+
+        // Thrown here, it would terminate the process; findPupilCenters() rethrows it instead.
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        cv::Point center;
+        std::exception_ptr error;
+        try {
+            center = right_.findPupilCenter(*crop);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        int64_t us = elapsed_us(start);
+
+        lock.lock();
+        right_center_ = center;
+        right_error_ = error;
+        right_us_ = us;
+        pending_ = false;
+        done_.notify_one();
+    }
+}
+
+void camux::EyePair::_stopWorker() {
+    if (!worker_.joinable()) return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_one();
+    worker_.join();
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Eye.h"
+
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+
+namespace camux {
+
+    /**
+     * @brief Localizes the pupils of both eyes of a face in one call, running the two eyes
+     *  concurrently: the right eye on a worker thread that lives as long as the pair, the left eye
+     *  on the calling thread.
+     *
+     *  The two crops are small and independent, and each one's pipeline (grayscale, Sobel, means,
+     *  thresholds, the objective) is a chain of short OpenCV calls that doesn't parallelize well by
+     *  itself, so overlapping the eyes is the cheap way to use a second core. The worker is started
+     *  once and woken per frame, so there's no thread creation per frame.
+     *
+     *  The eye run on the worker has its debug view cleared, since HighGUI may only be used from
+     *  the main thread. On a single core machine both eyes run on the calling thread.
+     */
+    class EyePair {
+    public:
+        EyePair(Eye& left, Eye& right);
+        ~EyePair();
+
+        EyePair(const EyePair&) = delete;
+        EyePair& operator=(const EyePair&) = delete;
+
+        /**
+         * @brief Find both pupil centers, as Eye::findPupilCenter() does for each. If either eye
+         *  throws, the exception is rethrown here, once both eyes are done with their crops.
+         *
+         * @param left_crop The crop of the frame bounded by the left eye's coordinates.
+         * @param right_crop The crop of the frame bounded by the right eye's coordinates.
+         * @param left_center Set to the left pupil center, relative to its crop.
+         * @param right_center Set to the right pupil center, relative to its crop.
+         */
+        void findPupilCenters(cv::Mat& left_crop, cv::Mat& right_crop, cv::Point& left_center, cv::Point& right_center);
+
+        /**
+         * @brief Run both eyes on the calling thread (e.g to compare against), or concurrently.
+         */
+        void setConcurrent(bool concurrent);
+        bool isConcurrent() { return concurrent_; }
+
+        // Timings of the last findPupilCenters() call, in microseconds: the whole call (what the
+        // frame actually waited) and each eye on its own.
+        int64_t getLatencyUs() { return latency_us_; }
+        int64_t getLeftUs() { return left_us_; }
+        int64_t getRightUs() { return right_us_; }
+
+    private:
+        void _worker();
+        void _stopWorker();
+
+        Eye& left_;
+        Eye& right_;
+
+        bool concurrent_ = false;
+
+        std::thread worker_;
+        std::mutex mutex_;
+        std::condition_variable wake_, done_;
+
+        // The job handed to the worker, guarded by mutex_.
+        cv::Mat* right_crop_ = nullptr;
+        cv::Point right_center_;
+        // What the worker's eye threw, if it did.
+        std::exception_ptr right_error_;
+        bool pending_ = false;
+        bool stop_ = false;
+
+        int64_t latency_us_ = 0;
+        int64_t left_us_ = 0;
+        int64_t right_us_ = 0;
+    };
+}
@@ -0,0 +1,256 @@
+#include "EyePreprocessor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// cv::COLOR_BGR2GRAY's fixed point weights for 8 bit images (15 bit), so the grayscale matches it exactly.
+const int GRAY_SHIFT = 15;
+const int B_TO_GRAY = 3735;
+const int G_TO_GRAY = 19235;
+const int R_TO_GRAY = 9798;
+
+// Row or column i (-1 <= i <= n) of n, reflected at the edges without repeating the edge pixel:
+// OpenCV's default border (cv::BORDER_REFLECT_101), which Sobel uses.
+static inline int reflect101(int i, int n) {
+    if (n == 1) return 0;
+    if (i < 0) return -i;
+    if (i >= n) return 2 * n - i - 2;
+    return i;
+}
+
+static inline void sobel_at(const uchar* up, const uchar* mid, const uchar* down, int x, int cols,
+                            short* gx, short* gy, float* magnitude) {
+    int l = reflect101(x - 1, cols);
+    int r = reflect101(x + 1, cols);
+
+    int dx = (up[r] - up[l]) + 2 * (mid[r] - mid[l]) + (down[r] - down[l]);
+    int dy = (down[l] + 2 * down[x] + down[r]) - (up[l] + 2 * up[x] + up[r]);
+
+    gx[x] = (short) dx;
+    gy[x] = (short) dy;
+    // The sum is exact in float (at most 2 * 1020^2), and the root correctly rounded, like _mm_sqrt_ps.
+    magnitude[x] = std::sqrt((float) (dx * dx + dy * dy));
+}
+
+bool camux::EyePreprocessor::hasVectorized() {
+#if defined(__SSE2__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+void camux::EyePreprocessor::run(const cv::Mat& eye, double gradient_threshold, double dark_threshold,
+                                 std::vector<GradientSample>& gradients) {
+    gradients.clear();
+
+    int rows = eye.rows, cols = eye.cols;
+    gray_.create(rows, cols, CV_8U);
+    gx_.create(rows, cols, CV_16S);
+    gy_.create(rows, cols, CV_16S);
+    magnitude_.create(rows, cols, CV_32F);
+    dark_raw_.create(rows, cols, CV_8U);
+    dark_.create(rows, cols, CV_8U);
+    weights_.create(rows, cols, CV_32F);
+    if (eye.empty()) return;
+
+    // Pass 1: grayscale, gradients and magnitudes, one row behind the grayscale since each row's
+    // gradients need the row below.
+    int64_t gray_sum = 0;
+    double magnitude_sum = 0;
+    for (int y = 0; y < rows; ++y) {
+        _grayRow(eye, y);
+        const uchar* gray = gray_.ptr<uchar>(y);
+        for (int x = 0; x < cols; ++x) gray_sum += gray[x];
+
+        if (y > 0) magnitude_sum += _gradientRow(y - 1);
+    }
+    magnitude_sum += _gradientRow(rows - 1);
+
+    // Like cv::mean, multiply by the reciprocal rather than divide, so the thresholds come out the same.
+    double scale = 1.0 / ((double) rows * cols);
+    mean_gray_ = gray_sum * scale;
+    mean_magnitude_ = magnitude_sum * scale;
+    // cv::threshold compares floats to a float threshold, and 8 bit images to its floor.
+    magnitude_threshold_ = (float) (mean_magnitude_ * gradient_threshold);
+    dark_threshold_ = cvFloor(mean_gray_ * dark_threshold);
+
+    // Pass 2: the dark mask, dilated one row behind (it needs the row below), then the weights and
+    // strong gradients of that row.
+    for (int y = 0; y < rows; ++y) {
+        _darkRow(y);
+        if (y == 0) continue;
+        _dilateRow(y - 1);
+        _finishRow(y - 1, gradients);
+    }
+    _dilateRow(rows - 1);
+    _finishRow(rows - 1, gradients);
+}
+
+void camux::EyePreprocessor::_grayRow(const cv::Mat& eye, int y) {
+    const uchar* src = eye.ptr<uchar>(y);
+    uchar* gray = gray_.ptr<uchar>(y);
+    int cols = eye.cols, channels = eye.channels();
+
+    if (channels == 1) {
+        std::memcpy(gray, src, cols);
+        return;
+    }
+
+    for (int x = 0; x < cols; ++x, src += channels) {
+        gray[x] = (uchar) ((src[0] * B_TO_GRAY + src[1] * G_TO_GRAY + src[2] * R_TO_GRAY + (1 << (GRAY_SHIFT - 1))) >> GRAY_SHIFT);
+    }
+}
+
+double camux::EyePreprocessor::_gradientRow(int y) {
+    int rows = gray_.rows, cols = gray_.cols;
+    const uchar* up = gray_.ptr<uchar>(reflect101(y - 1, rows));
+    const uchar* mid = gray_.ptr<uchar>(y);
+    const uchar* down = gray_.ptr<uchar>(reflect101(y + 1, rows));
+    short* gx = gx_.ptr<short>(y);
+    short* gy = gy_.ptr<short>(y);
+    float* magnitude = magnitude_.ptr<float>(y);
+
+    sobel_at(up, mid, down, 0, cols, gx, gy, magnitude);
+    int x = 1;
+
+#if defined(__SSE2__)
+    if (vectorized_) {
+        const __m128i zero = _mm_setzero_si128();
+
+        // Eight pixels at a time, as long as their right neighbours are inside the row.
+        for (; x + 8 < cols; x += 8) {
+            __m128i ul = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (up + x - 1)), zero);
+            __m128i uc = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (up + x)), zero);
+            __m128i ur = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (up + x + 1)), zero);
+            __m128i ml = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (mid + x - 1)), zero);
+            __m128i mr = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (mid + x + 1)), zero);
+            __m128i dl = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (down + x - 1)), zero);
+            __m128i dc = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (down + x)), zero);
+            __m128i dr = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*) (down + x + 1)), zero);
+
+            __m128i m = _mm_sub_epi16(mr, ml);
+            __m128i dx = _mm_add_epi16(_mm_add_epi16(_mm_sub_epi16(ur, ul), _mm_sub_epi16(dr, dl)), _mm_add_epi16(m, m));
+            __m128i below = _mm_add_epi16(_mm_add_epi16(dl, dr), _mm_add_epi16(dc, dc));
+            __m128i above = _mm_add_epi16(_mm_add_epi16(ul, ur), _mm_add_epi16(uc, uc));
+            __m128i dy = _mm_sub_epi16(below, above);
+
+            _mm_storeu_si128((__m128i*) (gx + x), dx);
+            _mm_storeu_si128((__m128i*) (gy + x), dy);
+
+            // dx^2 + dy^2 per pixel, from pairs of (dx, dy).
+            __m128i lo = _mm_unpacklo_epi16(dx, dy);
+            __m128i hi = _mm_unpackhi_epi16(dx, dy);
+            _mm_storeu_ps(magnitude + x, _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo))));
+            _mm_storeu_ps(magnitude + x + 4, _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi))));
+        }
+    }
+#endif
+
+    for (; x < cols; ++x) sobel_at(up, mid, down, x, cols, gx, gy, magnitude);
+
+    // Summed in order in both paths, so they agree exactly.
+    double sum = 0;
+    for (x = 0; x < cols; ++x) sum += magnitude[x];
+    return sum;
+}
+
+void camux::EyePreprocessor::_darkRow(int y) {
+    const uchar* gray = gray_.ptr<uchar>(y);
+    uchar* dark = dark_raw_.ptr<uchar>(y);
+    int cols = gray_.cols;
+    int x = 0;
+
+#if defined(__SSE2__)
+    if (vectorized_ && dark_threshold_ >= 0 && dark_threshold_ < 255) {
+        const __m128i above = _mm_set1_epi8((char) (dark_threshold_ + 1));
+        const __m128i ones = _mm_set1_epi8((char) 0xff);
+
+        for (; x + 16 <= cols; x += 16) {
+            __m128i g = _mm_loadu_si128((const __m128i*) (gray + x));
+            // g >= threshold + 1 (unsigned), i.e not dark.
+            __m128i bright = _mm_cmpeq_epi8(_mm_max_epu8(g, above), g);
+            _mm_storeu_si128((__m128i*) (dark + x), _mm_andnot_si128(bright, ones));
+        }
+    }
+#endif
+
+    for (; x < cols; ++x) dark[x] = gray[x] > dark_threshold_ ? 0 : 255;
+}
+
+void camux::EyePreprocessor::_dilateRow(int y) {
+    // A 3x3 cv::MORPH_ELLIPSE is a cross: each pixel and its four neighbours. Outside the crop
+    // doesn't count (cv::dilate's default border).
+    int rows = dark_raw_.rows, cols = dark_raw_.cols;
+    const uchar* mid = dark_raw_.ptr<uchar>(y);
+    const uchar* up = dark_raw_.ptr<uchar>(y > 0 ? y - 1 : y);
+    const uchar* down = dark_raw_.ptr<uchar>(y < rows - 1 ? y + 1 : y);
+    uchar* dark = dark_.ptr<uchar>(y);
+
+    uchar value = std::max(std::max(mid[0], up[0]), down[0]);
+    dark[0] = cols > 1 ? std::max(value, mid[1]) : value;
+    int x = 1;
+
+#if defined(__SSE2__)
+    if (vectorized_) {
+        for (; x + 16 < cols; x += 16) {
+            __m128i v = _mm_max_epu8(_mm_loadu_si128((const __m128i*) (mid + x - 1)),
+                                     _mm_loadu_si128((const __m128i*) (mid + x)));
+            v = _mm_max_epu8(v, _mm_loadu_si128((const __m128i*) (mid + x + 1)));
+            v = _mm_max_epu8(v, _mm_loadu_si128((const __m128i*) (up + x)));
+            v = _mm_max_epu8(v, _mm_loadu_si128((const __m128i*) (down + x)));
+            _mm_storeu_si128((__m128i*) (dark + x), v);
+        }
+    }
+#endif
+
+    for (; x < cols; ++x) {
+        uchar v = std::max(std::max(mid[x - 1], mid[x]), std::max(up[x], down[x]));
+        dark[x] = x + 1 < cols ? std::max(v, mid[x + 1]) : v;
+    }
+}
+
+void camux::EyePreprocessor::_finishRow(int y, std::vector<GradientSample>& gradients) {
+    const uchar* gray = gray_.ptr<uchar>(y);
+    const short* gx = gx_.ptr<short>(y);
+    const short* gy = gy_.ptr<short>(y);
+    const float* magnitude = magnitude_.ptr<float>(y);
+    float* weights = weights_.ptr<float>(y);
+    int cols = gray_.cols;
+    float threshold = magnitude_threshold_;
+
+    for (int x = 0; x < cols; ++x) weights[x] = 255 - gray[x];
+
+    int x = 0;
+#if defined(__SSE2__)
+    if (vectorized_) {
+        const __m128 limit = _mm_set1_ps(threshold > 0 ? threshold : 0);
+
+        for (; x + 8 <= cols; x += 8) {
+            // Only strong gradients are kept, and only a few percent are strong, so the compaction
+            // skips eight at a time past weak ones.
+            __m128 a = _mm_loadu_ps(magnitude + x);
+            __m128 b = _mm_loadu_ps(magnitude + x + 4);
+            // Over the threshold and over 0, as cv::threshold(THRESH_TOZERO) then a > 0 test gives.
+            int strong = _mm_movemask_ps(_mm_cmpgt_ps(a, limit)) | (_mm_movemask_ps(_mm_cmpgt_ps(b, limit)) << 4);
+            for (; strong; strong &= strong - 1) {
+                int i = x + __builtin_ctz(strong);
+                GradientSample g = { (float) i, (float) y, gx[i] / magnitude[i], gy[i] / magnitude[i] };
+                gradients.push_back(g);
+            }
+        }
+    }
+#endif
+
+    for (; x < cols; ++x) {
+        if (!(magnitude[x] > threshold) || !(magnitude[x] > 0)) continue;
+        GradientSample g = { (float) x, (float) y, gx[x] / magnitude[x], gy[x] / magnitude[x] };
+        gradients.push_back(g);
+    }
+}
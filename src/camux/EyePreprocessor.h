@@ -0,0 +1,86 @@
+#pragma once
+
+#include "geometry.hpp"
+#include "PupilObjective.h"
+
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief Turns an eye crop into what the gradient pupil localizer needs: its grayscale, Sobel
+     *  gradients and their magnitude, the dark pixel mask, the darkness weights, and the list of
+     *  strong unit gradients.
+     *
+     *  It gives the same results as the OpenCV call sequence it replaces (cvtColor, two Sobels,
+     *  magnitude, mean, threshold, two divides, mean, threshold, dilate, convertTo), up to the
+     *  rounding of the magnitudes and their mean, but in two passes over the crop instead of a
+     *  dozen. Everything but the inputs is integer until the magnitude, and a crop's rows stay in
+     *  L1 between the steps that use them. The first pass converts to grayscale and works out the
+     *  int16 gradients and their magnitudes, summing intensity and magnitude as it goes. The second
+     *  thresholds, dilates and compacts the strong gradients, since both thresholds are relative to
+     *  the first pass's means. The buffers are kept between crops.
+     *
+     *  Sobel, magnitude, thresholds and dilation are SSE2 where it's available; the scalar path
+     *  gives bit-identical results (see eye_mouse_preprocess_check).
+     */
+    class EyePreprocessor {
+    public:
+        /**
+         * @brief Preprocess an eye crop.
+         *
+         * @param eye The crop, BGR or grayscale, CV_8U.
+         * @param gradient_threshold Strong gradients have a magnitude over this multiple of the mean
+         *  magnitude.
+         * @param dark_threshold Dark pixels are no brighter than this multiple of the mean
+         *  intensity.
+         * @param gradients Set to the strong gradients, as unit vectors, in row-major order.
+         */
+        void run(const cv::Mat& eye, double gradient_threshold, double dark_threshold,
+                 std::vector<GradientSample>& gradients);
+
+        /**
+         * @brief Use the SSE2 kernels (the default, where they were compiled in) or the scalar ones.
+         */
+        void setVectorized(bool vectorized) { vectorized_ = vectorized && hasVectorized(); }
+        bool isVectorized() { return vectorized_; }
+        static bool hasVectorized();
+
+        // Results of the last run(), crop sized.
+        // Grayscale (CV_8U) and its Sobel derivatives (CV_16S).
+        const cv::Mat & getGray() { return gray_; }
+        const cv::Mat & getGradientX() { return gx_; }
+        const cv::Mat & getGradientY() { return gy_; }
+        // Gradient magnitude (CV_32F).
+        const cv::Mat & getMagnitude() { return magnitude_; }
+        // 255 for pixels that are dark or next to one (CV_8U).
+        const cv::Mat & getDark() { return dark_; }
+        // 255 - intensity (CV_32F), the objective's prior that the pupil is dark.
+        const cv::Mat & getWeights() { return weights_; }
+
+        double getMeanMagnitude() { return mean_magnitude_; }
+        double getMeanGray() { return mean_gray_; }
+        // The magnitude a gradient had to be over to count as strong.
+        float getMagnitudeThreshold() { return magnitude_threshold_; }
+        // The intensity a pixel had to be at or under to count as dark.
+        int getDarkThreshold() { return dark_threshold_; }
+
+    private:
+        // Pass 1, for one row: grayscale of row y, and the gradients of row y - 1 once its
+        // neighbours are in.
+        void _grayRow(const cv::Mat& eye, int y);
+        double _gradientRow(int y);
+        // Pass 2, for one row.
+        void _darkRow(int y);
+        void _dilateRow(int y);
+        void _finishRow(int y, std::vector<GradientSample>& gradients);
+
+        bool vectorized_ = hasVectorized();
+
+        cv::Mat gray_, gx_, gy_, magnitude_, dark_raw_, dark_, weights_;
+        double mean_magnitude_ = 0;
+        double mean_gray_ = 0;
+        float magnitude_threshold_ = 0;
+        int dark_threshold_ = 0;
+    };
+}
@@ -73,13 +73,14 @@ namespace camux {
         void setConfidence(const float conf);
 
         cv::Rect getCoords() { return coords_; }
+        float getConfidence() { return confidence_; }
 
     private:
         // The rectangle bounding box of the face. Coordinates on the screen
         cv::Rect coords_;
         // The confidence level of the detected face. 0 if no face, negative if no confidence
         // computed.
-        float confidence_;
+        float confidence_ = 0;
         // Two eyes on the face. The eyes are bounded by [(0,0), (0,0)] if none was detected. 
         Eye left_eye_, right_eye_;
     };
@@ -0,0 +1,283 @@
+#include "FlightRecorder.h"
+#include "FrameArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+
+// How far a pupil may move within its eye box between frames, as a fraction of the box's width.
+// A saccade can cross a good part of the eye in one frame at 30 fps, so only more than that counts.
+const double DEFAULT_PUPIL_JUMP = 0.5;
+// Frames recorded after a trigger before dumping, half a second at 30 fps.
+const int DEFAULT_POST_FRAMES = 15;
+// The most dumps one session writes.
+const int DEFAULT_MAX_DUMPS = 20;
+// Each slot's pixels start on their own cache line.
+const size_t SLOT_ALIGNMENT = 64;
+// How often the dump thread checks for a handed off dump. Waking it would cost record() a system
+// call, and a dump only needs to start well before the ring wraps.
+const int DUMPER_POLL_MS = 10;
+
+static const char *TRIGGER_NAMES[] = { "face-lost", "pupil-jump", "eyes-missed", "requested" };
+
+camux::FlightRecorder::FlightRecorder()
+    : pupil_jump_(DEFAULT_PUPIL_JUMP), post_frames_(DEFAULT_POST_FRAMES), max_dumps_(DEFAULT_MAX_DUMPS),
+      requested_(false), dumping_(false), dumps_(0), torn_frames_(0), ready_(false), stop_(false) {}
+
+bool camux::FlightRecorder::open(const std::string& dir, int slots, size_t slot_bytes, FlightContent content) {
+    close();
+    if (slots <= 0 || slot_bytes == 0) return false;
+
+    dir_ = dir;
+    content_ = content;
+    slot_bytes_ = slot_bytes;
+    size_t stride = (slot_bytes + SLOT_ALIGNMENT - 1) / SLOT_ALIGNMENT * SLOT_ALIGNMENT;
+
+    // Zero filled, so every page is faulted in now rather than on the first frames.
+    pixels_.assign(stride * slots + SLOT_ALIGNMENT, 0);
+    unsigned char* base = pixels_.data() +
+                          (SLOT_ALIGNMENT - (uintptr_t) pixels_.data() % SLOT_ALIGNMENT) % SLOT_ALIGNMENT;
+
+    slots_.reset(new Slot[slots]);
+    for (int i = 0; i < slots; ++i) {
+        Slot& slot = slots_[i];
+        slot.sequence.store(0, std::memory_order_relaxed);
+        slot.rows = slot.cols = 0;
+        slot.pixels = base + stride * i;
+    }
+    count_ = slots;
+
+    written_ = 0;
+    has_last_ = false;
+    last_roi_ = cv::Rect();
+    pending_ = false;
+    dumps_started_ = 0;
+    dropped_triggers_ = 0;
+    requested_.store(false);
+    dumping_.store(false);
+    dumps_.store(0);
+    torn_frames_.store(0);
+
+    stop_.store(false);
+    ready_.store(false);
+    dumper_ = std::thread(&camux::FlightRecorder::_dumper, this);
+    return true;
+}
+
+void camux::FlightRecorder::close() {
+    if (!count_) return;
+
+    if (pending_ && written_ > 0) _handOff(written_ - 1);
+
+    stop_.store(true, std::memory_order_release);
+    dumper_.join();
+
+    slots_.reset();
+    std::vector<unsigned char>().swap(pixels_);
+    count_ = 0;
+}
+
+void camux::FlightRecorder::record(const cv::Mat& image, const GazeSample& sample) {
+    if (!count_) return;
+
+    uint32_t triggers = _triggers(sample);
+    if (requested_.exchange(false, std::memory_order_relaxed)) triggers |= FlightRequested;
+    last_ = sample;
+    has_last_ = true;
+
+    // The slot's sequence is 0 while it's written, so the dump thread can tell it changed under it.
+    uint64_t frame = written_++;
+    Slot& slot = slots_[frame % count_];
+    slot.sequence.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.sample = sample;
+    slot.triggers = triggers;
+    _store(image, sample, slot);
+    slot.sequence.store(frame + 1, std::memory_order_release);
+
+    if (triggers) {
+        if (pending_) {
+            pending_triggers_ |= triggers;
+        } else if (dumping_.load(std::memory_order_acquire) || dumps_started_ >= max_dumps_) {
+            ++dropped_triggers_;
+        } else {
+            pending_ = true;
+            pending_triggers_ = triggers;
+            // The trigger frame itself must still be in the ring when the dump starts.
+            pending_last_ = frame + std::min<uint64_t>(std::max(post_frames_, 0), count_ - 1);
+        }
+    }
+
+    if (pending_ && frame >= pending_last_) _handOff(frame);
+}
+
+uint32_t camux::FlightRecorder::_triggers(const GazeSample& sample) {
+    uint32_t triggers = sample.eyes_missed ? FlightEyesMissed : 0;
+    if (!has_last_) return triggers;
+
+    if (last_.face_found && !sample.face_found) triggers |= FlightFaceLost;
+    if (!last_.face_found || !sample.face_found) return triggers;
+
+    // The pupil relative to its eye box, so the head (and box) moving doesn't count.
+    bool jumped = false;
+    if (!last_.left_closed && !sample.left_closed && sample.left_eye.width > 0) {
+        cv::Point2f move = cv::Point2f(sample.left_pupil - sample.left_eye.tl()) -
+                           cv::Point2f(last_.left_pupil - last_.left_eye.tl());
+        jumped |= std::hypot(move.x, move.y) > pupil_jump_ * sample.left_eye.width;
+    }
+    if (!last_.right_closed && !sample.right_closed && sample.right_eye.width > 0) {
+        cv::Point2f move = cv::Point2f(sample.right_pupil - sample.right_eye.tl()) -
+                           cv::Point2f(last_.right_pupil - last_.right_eye.tl());
+        jumped |= std::hypot(move.x, move.y) > pupil_jump_ * sample.right_eye.width;
+    }
+    if (jumped) triggers |= FlightPupilJump;
+
+    return triggers;
+}
+
+void camux::FlightRecorder::_store(const cv::Mat& image, const GazeSample& sample, Slot& slot) {
+    cv::Rect bounds(0, 0, image.cols, image.rows);
+    cv::Rect roi = bounds;
+    if (content_ == FlightRois) {
+        // Once the face is lost, keep recording where it was.
+        if (sample.face_found) last_roi_ = sample.face | sample.left_eye | sample.right_eye;
+        roi = last_roi_ & bounds;
+    }
+
+    slot.roi = roi;
+    slot.type = image.type();
+    slot.rows = slot.cols = 0;
+    slot.step = 1;
+    if (image.empty() || image.dims != 2 || roi.area() == 0) return;
+
+    size_t elem = image.elemSize();
+    int step = 1;
+    while ((size_t) ((roi.width + step - 1) / step) * ((roi.height + step - 1) / step) * elem > slot_bytes_) ++step;
+    int rows = (roi.height + step - 1) / step;
+    int cols = (roi.width + step - 1) / step;
+    size_t row_bytes = cols * elem;
+
+    for (int y = 0; y < rows; ++y) {
+        const unsigned char* src = image.ptr(roi.y + y * step) + roi.x * elem;
+        unsigned char* dst = slot.pixels + y * row_bytes;
+        if (step == 1) {
+            std::memcpy(dst, src, row_bytes);
+        } else {
+            for (int x = 0; x < cols; ++x) std::memcpy(dst + x * elem, src + x * step * elem, elem);
+        }
+    }
+
+    slot.step = step;
+    slot.rows = rows;
+    slot.cols = cols;
+}
+
+void camux::FlightRecorder::_handOff(uint64_t last) {
+    // Everything still in the ring, oldest first. The oldest is overwritten by the next frame, but
+    // the dump thread starts there and is usually well ahead of it.
+    uint64_t first = last + 1 >= count_ ? last + 1 - count_ : 0;
+
+    // No dump is running (or we wouldn't be handing one off), so the dump thread isn't reading
+    // these; ready_ publishes them.
+    dumping_.store(true, std::memory_order_release);
+    dump_first_ = first;
+    dump_last_ = last;
+    dump_triggers_ = pending_triggers_;
+    ready_.store(true, std::memory_order_release);
+
+    pending_ = false;
+    ++dumps_started_;
+}
+
+void camux::FlightRecorder::_dumper() {
+    for (;;) {
+        // A dump handed off by close() is written before stopping.
+        if (!ready_.load(std::memory_order_acquire)) {
+            if (stop_.load(std::memory_order_acquire)) return;
+            std::this_thread::sleep_for(std::chrono::milliseconds(DUMPER_POLL_MS));
+            continue;
+        }
+
+        uint64_t first = dump_first_, last = dump_last_;
+        uint32_t triggers = dump_triggers_;
+        ready_.store(false, std::memory_order_relaxed);
+
+        if (_dump(first, last, triggers)) dumps_.fetch_add(1, std::memory_order_relaxed);
+        dumping_.store(false, std::memory_order_release);
+    }
+}
+
+bool camux::FlightRecorder::_dump(uint64_t first, uint64_t last, uint32_t triggers) {
+    // flight_<local time>_<last frame>_<triggers>.archive/.csv
+    char when[32];
+    std::time_t now = std::time(nullptr);
+    std::tm local;
+    localtime_r(&now, &local);
+    std::strftime(when, sizeof(when), "%Y%m%d-%H%M%S", &local);
+
+    std::string name = dir_ + "/flight_" + when + "_" + std::to_string(last);
+    for (int i = 0; i < 4; ++i) {
+        if (triggers & (1 << i)) name += std::string("_") + TRIGGER_NAMES[i];
+    }
+
+    FrameArchiveWriter archive;
+    FILE* csv = std::fopen((name + ".csv").c_str(), "w");
+    if (!archive.open(name + ".archive") || !csv) {
+        if (csv) std::fclose(csv);
+        return false;
+    }
+
+    std::fprintf(csv, "frame,timestamp_us,triggers,archive_frame,roi_x,roi_y,roi_width,roi_height,roi_step,"
+                      "face_found,ran_detector,eyes_missed,face_x,face_y,face_width,face_height,face_confidence,"
+                      "leye_x,leye_y,leye_width,leye_height,leye_confidence,reye_x,reye_y,reye_width,reye_height,"
+                      "reye_confidence,lpupil_x,lpupil_y,rpupil_x,rpupil_y,leye_closed,reye_closed,forehead_found,"
+                      "forehead_x,forehead_y,detect_us,forehead_us,pupil_us\n");
+
+    cv::Mat pixels;
+    for (uint64_t frame = first; frame <= last; ++frame) {
+        const Slot& slot = slots_[frame % count_];
+        if (slot.sequence.load(std::memory_order_acquire) != frame + 1) {
+            torn_frames_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        GazeSample s = slot.sample;
+        uint32_t slot_triggers = slot.triggers;
+        cv::Rect roi = slot.roi;
+        int step = slot.step;
+        int rows = slot.rows, cols = slot.cols, type = slot.type;
+
+        // rows and cols may be mid-change if the slot is being overwritten, so never copy more than
+        // the slot holds; the check below throws the copy away then anyway.
+        bool has_pixels = rows > 0 && cols > 0 && (size_t) rows * cols * CV_ELEM_SIZE(type) <= slot_bytes_;
+        if (has_pixels) {
+            pixels.create(rows, cols, type);
+            std::memcpy(pixels.data, slot.pixels, pixels.total() * pixels.elemSize());
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != frame + 1) {
+            torn_frames_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+
+        long archive_frame = -1;
+        if (has_pixels && archive.write(pixels, s.timestamp_us)) archive_frame = (long) archive.size() - 1;
+
+        std::fprintf(csv, "%llu,%lld,%u,%ld,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%g,%d,%d,%d,%d,%g,%d,%d,%d,%d,%g,"
+                          "%d,%d,%d,%d,%d,%d,%d,%d,%d,%g,%g,%g\n",
+                     (unsigned long long) s.frame, (long long) s.timestamp_us, slot_triggers, archive_frame, roi.x, roi.y,
+                     roi.width, roi.height, step, s.face_found, s.ran_detector, s.eyes_missed, s.face.x, s.face.y,
+                     s.face.width, s.face.height, s.face_confidence, s.left_eye.x, s.left_eye.y, s.left_eye.width,
+                     s.left_eye.height, s.left_eye_confidence, s.right_eye.x, s.right_eye.y, s.right_eye.width,
+                     s.right_eye.height, s.right_eye_confidence, s.left_pupil.x, s.left_pupil.y, s.right_pupil.x,
+                     s.right_pupil.y, s.left_closed, s.right_closed, s.forehead_found, s.forehead.x, s.forehead.y,
+                     s.detect_us, s.forehead_us, s.pupil_us);
+    }
+
+    return std::fclose(csv) == 0;
+}
@@ -0,0 +1,190 @@
+#pragma once
+
+#include "GazeSample.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace camux {
+
+    // Why a flight recorder dump was written. Bits of FlightRecorder's triggers.
+    enum FlightTrigger {
+        // The face was found in the last frame but not this one.
+        FlightFaceLost   = 1 << 0,
+        // A pupil moved further within its eye box in one frame than an eye can.
+        FlightPupilJump  = 1 << 1,
+        // The detector found the face but not both eyes (see GazeSample::eyes_missed).
+        FlightEyesMissed = 1 << 2,
+        // FlightRecorder::trigger() was called, e.g by the user.
+        FlightRequested  = 1 << 3
+    };
+
+    // What of each frame a FlightRecorder keeps.
+    enum FlightContent {
+        // The whole frame.
+        FlightFrames,
+        // Just the face and eye rectangles (their bounding box), or where the face last was when
+        // it's lost.
+        FlightRois
+    };
+
+    /**
+     * @brief Keeps the last few frames and what the pipeline found in them, and writes them out
+     *  when tracking goes wrong: the face is lost, a pupil jumps, or the detector misses an eye.
+     *  Those failures are intermittent and the frames that caused them are gone by the time anyone
+     *  notices, so they're kept just in case.
+     *
+     *  Every slot is allocated (and its pages faulted in) by open(). record() copies the frame's
+     *  pixels into the oldest slot and checks the triggers - no allocation, system calls or disk
+     *  I/O. When a trigger fires, a few more frames are recorded to show what happened next, then
+     *  the slots are handed to a background thread that writes them as a FrameArchive (replayable
+     *  with eye_mouse --replay) and a CSV of the samples, one row per frame. The hand off is a flag
+     *  the thread polls, so it costs record() no system call either. Recording carries on
+     *  meanwhile; each slot is sequence-numbered, so a slot overwritten while it was being copied
+     *  out is skipped rather than dumped torn.
+     *
+     *  Only one dump runs at a time. Triggers while one is pending or running are merged into it
+     *  or dropped, and a session writes at most setMaxDumps() of them.
+     */
+    class FlightRecorder {
+    public:
+        FlightRecorder();
+        ~FlightRecorder() { close(); }
+
+        FlightRecorder(const FlightRecorder&) = delete;
+        FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+        /**
+         * @brief Allocate the slots and start the dump thread.
+         *
+         * @param dir Where dumps are written. Must exist.
+         * @param slots How many frames to keep.
+         * @param slot_bytes The most pixel bytes a slot holds. Images (or ROIs) bigger than this are
+         *  stored subsampled by the smallest whole step that fits.
+         * @param content Whole frames or just the face and eyes.
+         * @return true If the recorder is ready.
+         */
+        bool open(const std::string& dir, int slots, size_t slot_bytes, FlightContent content);
+
+        /**
+         * @brief Write out any pending dump with the frames recorded so far, wait for the dump
+         *  thread to finish and free the slots. Called by the destructor.
+         */
+        void close();
+
+        bool isOpen() { return count_ > 0; }
+
+        /**
+         * @brief Keep a frame, overwriting the oldest one, and check it for anomalies. Does nothing
+         *  if the recorder isn't open. Only call from one thread.
+         *
+         * @param image The frame the sample is from, before anything is drawn on it.
+         * @param sample What the pipeline found in it.
+         */
+        void record(const cv::Mat& image, const GazeSample& sample);
+
+        /**
+         * @brief Dump the recorder on the next record(), as if an anomaly had been seen. Safe to
+         *  call from any thread.
+         */
+        void trigger() { requested_.store(true, std::memory_order_relaxed); }
+
+        /**
+         * @brief How far (a fraction of the eye box's width) a pupil may move within its eye box
+         *  between two frames before it counts as a jump.
+         */
+        void setPupilJump(double fraction) { pupil_jump_ = fraction; }
+        // Frames recorded after a trigger before the dump is handed off.
+        void setPostFrames(int frames) { post_frames_ = frames; }
+        // The most dumps to write, so a camera that keeps losing the face can't fill the disk.
+        void setMaxDumps(int dumps) { max_dumps_ = dumps; }
+
+        // Dumps written, triggers that didn't start a dump (one was already pending or running, or
+        // the limit was reached), and frames left out of dumps for being overwritten mid-copy.
+        uint64_t getDumps() { return dumps_.load(std::memory_order_relaxed); }
+        uint64_t getDroppedTriggers() { return dropped_triggers_; }
+        uint64_t getTornFrames() { return torn_frames_.load(std::memory_order_relaxed); }
+
+    private:
+        struct Slot {
+            // The frame's number + 1 once the slot holds it, 0 while it's being written.
+            std::atomic<uint64_t> sequence;
+            GazeSample sample;
+            // FlightTrigger bits that fired on this frame.
+            uint32_t triggers;
+            // The part of the frame stored, in frame pixels, and the subsampling step it was
+            // stored at.
+            cv::Rect roi;
+            int step;
+            // The stored pixels: rows x cols of type, packed.
+            int rows, cols, type;
+            unsigned char* pixels;
+        };
+
+        /**
+         * @brief The FlightTrigger bits a sample fires, given the one before it.
+         */
+        uint32_t _triggers(const GazeSample& sample);
+
+        /**
+         * @brief Copy the frame (or its ROI) into a slot, subsampled if it doesn't fit.
+         */
+        void _store(const cv::Mat& image, const GazeSample& sample, Slot& slot);
+
+        /**
+         * @brief Give the pending dump, ending at frame last, to the dump thread.
+         */
+        void _handOff(uint64_t last);
+
+        void _dumper();
+
+        /**
+         * @brief Write frames [first, last] to an archive and CSV in dir_ named after triggers.
+         *  Returns whether both were written.
+         */
+        bool _dump(uint64_t first, uint64_t last, uint32_t triggers);
+
+        std::string dir_;
+        FlightContent content_ = FlightFrames;
+        size_t slot_bytes_ = 0;
+        uint64_t count_ = 0;
+        std::unique_ptr<Slot[]> slots_;
+        std::vector<unsigned char> pixels_;
+
+        double pupil_jump_;
+        int post_frames_;
+        int max_dumps_;
+
+        // Only touched by record().
+        uint64_t written_ = 0;
+        GazeSample last_;
+        bool has_last_ = false;
+        cv::Rect last_roi_;
+        // A dump waiting for its post trigger frames: the triggers so far and its last frame.
+        bool pending_ = false;
+        uint32_t pending_triggers_ = 0;
+        uint64_t pending_last_ = 0;
+        int dumps_started_ = 0;
+        uint64_t dropped_triggers_ = 0;
+
+        std::atomic<bool> requested_;
+        // From hand off until the dump thread has written the dump.
+        std::atomic<bool> dumping_;
+        std::atomic<uint64_t> dumps_;
+        std::atomic<uint64_t> torn_frames_;
+
+        std::thread dumper_;
+
+        // The dump handed to the thread: record() sets the rest, then ready_; the thread reads them
+        // and clears it.
+        std::atomic<bool> ready_;
+        std::atomic<bool> stop_;
+        uint64_t dump_first_ = 0;
+        uint64_t dump_last_ = 0;
+        uint32_t dump_triggers_ = 0;
+    };
+}
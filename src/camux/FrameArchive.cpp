@@ -0,0 +1,226 @@
+#include "FrameArchive.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char ARCHIVE_MAGIC[8] = { 'E', 'Y', 'E', 'F', 'R', 'A', 'M', 'E' };
+static const char TRAILER_MAGIC[8] = { 'E', 'Y', 'E', 'I', 'N', 'D', 'E', 'X' };
+static const uint32_t FRAME_MAGIC = 0x4D524646; // "FFRM"
+static const uint32_t ARCHIVE_VERSION = 1;
+
+// Pixel data starts on a 64 byte boundary so frames are cache line (and SIMD) aligned.
+static const uint64_t ALIGNMENT = 64;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+};
+
+// Written just before each frame's pixels, so the index can be rebuilt if it's missing.
+struct FrameHeader {
+    uint32_t magic;
+    uint32_t step;
+    int32_t rows;
+    int32_t cols;
+    int32_t type;
+    uint32_t padding;
+    int64_t timestamp_us;
+    uint64_t data_size;
+};
+
+struct Trailer {
+    uint64_t index_offset;
+    uint64_t count;
+    char magic[8];
+};
+
+static uint64_t align(uint64_t offset) {
+    return (offset + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT;
+}
+
+bool camux::FrameArchiveWriter::open(const std::string& path) {
+    close();
+
+    file_ = std::fopen(path.c_str(), "wb");
+    if (!file_) return false;
+
+    FileHeader header = {};
+    std::memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+    header.version = ARCHIVE_VERSION;
+
+    if (std::fwrite(&header, sizeof(header), 1, file_) != 1) {
+        close();
+        return false;
+    }
+    offset_ = sizeof(header);
+    return true;
+}
+
+bool camux::FrameArchiveWriter::write(const cv::Mat& frame, int64_t timestamp_us) {
+    if (!file_ || frame.empty() || frame.dims != 2) return false;
+
+    size_t row_bytes = frame.cols * frame.elemSize();
+
+    // Pad so the pixels that follow the frame header are aligned.
+    static const char zeros[ALIGNMENT] = {};
+    uint64_t data_offset = align(offset_ + sizeof(FrameHeader));
+    uint64_t header_offset = data_offset - sizeof(FrameHeader);
+    if (std::fwrite(zeros, 1, header_offset - offset_, file_) != header_offset - offset_) return false;
+
+    FrameHeader header = {};
+    header.magic = FRAME_MAGIC;
+    header.step = row_bytes;
+    header.rows = frame.rows;
+    header.cols = frame.cols;
+    header.type = frame.type();
+    header.timestamp_us = timestamp_us;
+    header.data_size = row_bytes * frame.rows;
+    if (std::fwrite(&header, sizeof(header), 1, file_) != 1) return false;
+
+    // Rows are written tightly packed, whatever the step of the source.
+    if (frame.isContinuous()) {
+        if (std::fwrite(frame.data, header.data_size, 1, file_) != 1) return false;
+    } else {
+        for (int y = 0; y < frame.rows; ++y) {
+            if (std::fwrite(frame.ptr(y), row_bytes, 1, file_) != 1) return false;
+        }
+    }
+
+    FrameIndexEntry entry;
+    entry.offset = data_offset;
+    entry.timestamp_us = timestamp_us;
+    entry.rows = frame.rows;
+    entry.cols = frame.cols;
+    entry.type = frame.type();
+    entry.step = row_bytes;
+    index_.push_back(entry);
+
+    offset_ = data_offset + header.data_size;
+    return true;
+}
+
+void camux::FrameArchiveWriter::close() {
+    if (!file_) return;
+
+    Trailer trailer;
+    trailer.index_offset = offset_;
+    trailer.count = index_.size();
+    std::memcpy(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC));
+
+    if (!index_.empty()) {
+        std::fwrite(index_.data(), sizeof(FrameIndexEntry), index_.size(), file_);
+    }
+    std::fwrite(&trailer, sizeof(trailer), 1, file_);
+    std::fclose(file_);
+
+    file_ = nullptr;
+    offset_ = 0;
+    index_.clear();
+}
+
+bool camux::FrameArchiveReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(FileHeader)) {
+        ::close(fd);
+        return false;
+    }
+
+    // Private and writable: callers may draw on the frames, which copies just the touched pages.
+    size_ = st.st_size;
+    void* map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+    data_ = static_cast<unsigned char*>(map);
+
+    const FileHeader* header = reinterpret_cast<const FileHeader*>(data_);
+    if (std::memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) != 0 ||
+        header->version != ARCHIVE_VERSION) {
+        close();
+        return false;
+    }
+
+    // Use the index if the writer got to write one, otherwise walk the frames.
+    Trailer trailer;
+    bool has_trailer = false;
+    if (size_ >= sizeof(FileHeader) + sizeof(Trailer)) {
+        std::memcpy(&trailer, data_ + size_ - sizeof(Trailer), sizeof(Trailer));
+        has_trailer = std::memcmp(trailer.magic, TRAILER_MAGIC, sizeof(TRAILER_MAGIC)) == 0 &&
+                      trailer.index_offset + trailer.count * sizeof(FrameIndexEntry) + sizeof(Trailer) == size_;
+    }
+
+    if (has_trailer) {
+        index_.resize(trailer.count);
+        if (trailer.count) {
+            std::memcpy(index_.data(), data_ + trailer.index_offset, trailer.count * sizeof(FrameIndexEntry));
+        }
+    } else {
+        _scanFrames();
+    }
+
+    madvise(data_, size_, MADV_SEQUENTIAL);
+    return true;
+}
+
+void camux::FrameArchiveReader::_scanFrames() {
+    uint64_t offset = sizeof(FileHeader);
+
+    while (true) {
+        uint64_t data_offset = align(offset + sizeof(FrameHeader));
+        uint64_t header_offset = data_offset - sizeof(FrameHeader);
+        if (data_offset > size_) break;
+
+        FrameHeader header;
+        std::memcpy(&header, data_ + header_offset, sizeof(header));
+        // A torn last frame (the recorder died mid-write) is dropped.
+        if (header.magic != FRAME_MAGIC || data_offset + header.data_size > size_) break;
+
+        FrameIndexEntry entry;
+        entry.offset = data_offset;
+        entry.timestamp_us = header.timestamp_us;
+        entry.rows = header.rows;
+        entry.cols = header.cols;
+        entry.type = header.type;
+        entry.step = header.step;
+        index_.push_back(entry);
+
+        offset = data_offset + header.data_size;
+    }
+}
+
+void camux::FrameArchiveReader::close() {
+    if (data_) munmap(data_, size_);
+
+    data_ = nullptr;
+    size_ = 0;
+    index_.clear();
+}
+
+cv::Mat camux::FrameArchiveReader::frame(size_t i) {
+    const FrameIndexEntry& entry = index_[i];
+    return cv::Mat(entry.rows, entry.cols, entry.type, data_ + entry.offset, entry.step);
+}
+
+void camux::FrameArchiveReader::prefetch(size_t first, size_t count) {
+    if (first >= index_.size()) return;
+    size_t last = std::min(first + count, index_.size()) - 1;
+
+    // madvise wants a page aligned start.
+    long page = sysconf(_SC_PAGESIZE);
+    uint64_t begin = index_[first].offset / page * page;
+    uint64_t end = index_[last].offset + (uint64_t) index_[last].step * index_[last].rows;
+    madvise(data_ + begin, end - begin, MADV_WILLNEED);
+}
@@ -0,0 +1,134 @@
+#pragma once
+
+#include <opencv2/core.hpp>
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief Where a frame lives in an archive and what it looks like.
+     */
+    struct FrameIndexEntry {
+        // Byte offset of the pixel data from the start of the file.
+        uint64_t offset;
+        int64_t timestamp_us;
+        int32_t rows;
+        int32_t cols;
+        // OpenCV type, e.g CV_8UC3.
+        int32_t type;
+        // Bytes per row.
+        uint32_t step;
+    };
+
+    /**
+     * @brief Records frames into an archive of raw (uncompressed) pixels, for replaying sessions
+     *  through the detectors without decoding video.
+     *
+     *  Layout: a file header, then for each frame a FrameHeader followed by the pixel rows
+     *  (aligned to 64 bytes so the reader's Mats are aligned), then an index of every frame and a
+     *  trailer pointing at it. The index is written by close(); if the recorder died before that,
+     *  the reader rebuilds it from the frame headers.
+     *
+     *  Raw frames are big (a 1080x720 BGR frame is ~2.3 MB, ~70 MB/s at 30 fps) but that's the
+     *  point: replay is a pointer into the file rather than a decode.
+     */
+    class FrameArchiveWriter {
+    public:
+        FrameArchiveWriter() {};
+        ~FrameArchiveWriter() { close(); }
+
+        FrameArchiveWriter(const FrameArchiveWriter&) = delete;
+        FrameArchiveWriter& operator=(const FrameArchiveWriter&) = delete;
+
+        /**
+         * @brief Create (or truncate) an archive.
+         *
+         * @param path The archive file.
+         * @return true If the file is ready to record to.
+         */
+        bool open(const std::string& path);
+
+        /**
+         * @brief Write the index and close the archive. Called by the destructor.
+         */
+        void close();
+
+        bool isOpen() { return file_ != nullptr; }
+
+        /**
+         * @brief Append a frame.
+         *
+         * @param frame The frame to record. Any type/size; frames don't have to match each other.
+         * @param timestamp_us When the frame was captured (steady clock, microseconds).
+         * @return true If the frame was written.
+         */
+        bool write(const cv::Mat& frame, int64_t timestamp_us);
+
+        size_t size() { return index_.size(); }
+
+    private:
+        FILE* file_ = nullptr;
+        uint64_t offset_ = 0;
+        std::vector<FrameIndexEntry> index_;
+    };
+
+    /**
+     * @brief Reads an archive written by FrameArchiveWriter. The whole file is memory-mapped and
+     *  frames are handed out as cv::Mat headers pointing straight into the mapping, so reading a
+     *  frame copies nothing.
+     *
+     *  The mapping is private copy-on-write: drawing on a returned frame is allowed and only copies
+     *  the pages that are drawn on - the archive on disk never changes.
+     */
+    class FrameArchiveReader {
+    public:
+        FrameArchiveReader() {};
+        ~FrameArchiveReader() { close(); }
+
+        FrameArchiveReader(const FrameArchiveReader&) = delete;
+        FrameArchiveReader& operator=(const FrameArchiveReader&) = delete;
+
+        /**
+         * @brief Map an archive and load (or rebuild) its index.
+         *
+         * @param path The archive file.
+         * @return true If the file is an archive we can read.
+         */
+        bool open(const std::string& path);
+        void close();
+
+        bool isOpen() { return data_ != nullptr; }
+
+        size_t size() { return index_.size(); }
+
+        /**
+         * @brief The ith frame. Valid until the reader is closed.
+         *
+         * @param i Frame index, 0 <= i < size().
+         * @return cv::Mat A header over the frame's pixels in the mapping (no copy).
+         */
+        cv::Mat frame(size_t i);
+
+        int64_t timestamp(size_t i) { return index_[i].timestamp_us; }
+
+        /**
+         * @brief Hint to the kernel that frames [first, first + count) are about to be read, so
+         *  it can start reading them in ahead of us.
+         */
+        void prefetch(size_t first, size_t count);
+
+    private:
+        /**
+         * @brief Walk the frame headers to rebuild the index of an archive with no trailer.
+         */
+        void _scanFrames();
+
+        unsigned char* data_ = nullptr;
+        size_t size_ = 0;
+        std::vector<FrameIndexEntry> index_;
+    };
+}
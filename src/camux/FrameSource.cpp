@@ -0,0 +1,34 @@
+#include "FrameSource.h"
+
+#include <chrono>
+
+int64_t camux::steadyMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool camux::CameraSource::read(camux::Frame& frame) {
+    if (!capture_.isOpened()) return false;
+
+    frame.index = index_++;
+    if (!capture_.grab()) {
+        frame.image.release();
+        return true;
+    }
+
+    frame.capture_us = frame.timestamp_us = steadyMicros();
+    if (!capture_.retrieve(frame.image)) frame.image.release();
+    return true;
+}
+
+bool camux::ArchiveSource::read(camux::Frame& frame) {
+    if (!archive_.isOpen() || next_ >= archive_.size()) return false;
+
+    // Replays aren't paced, so a frame is "captured" when it's read: latencies are then how long
+    // this process took with it. The recorded capture time stays in timestamp_us.
+    frame.index = next_;
+    frame.capture_us = steadyMicros();
+    frame.timestamp_us = archive_.timestamp(next_);
+    frame.image = archive_.frame(next_++);
+    return true;
+}
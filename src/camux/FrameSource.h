@@ -0,0 +1,89 @@
+#pragma once
+
+#include "FrameArchive.h"
+#include "geometry.hpp"
+
+#include <opencv2/videoio.hpp>
+
+#include <cstdint>
+#include <string>
+
+namespace camux {
+
+    /**
+     * @brief Steady clock time in microseconds. Every timestamp a Frame carries through the
+     *  pipeline is on this clock, so latencies are differences of these.
+     */
+    int64_t steadyMicros();
+
+    /**
+     * @brief A frame and when it was captured. The capture timestamp travels with the frame through
+     *  detection, pupil localization, mapping and cursor output, so each stage can tell how old the
+     *  frame it's working on is.
+     */
+    struct Frame {
+        cv::Mat image;
+        // Steady clock time the frame was captured (or entered this process, for recordings, which
+        // aren't replayed at their recorded pace).
+        int64_t capture_us = 0;
+        // The frame's own timestamp: the capture time for live sources, the time it was originally
+        // recorded for archives.
+        int64_t timestamp_us = 0;
+        uint64_t index = 0;
+    };
+
+    /**
+     * @brief Somewhere frames come from: a camera, a recording, or a generator.
+     */
+    class FrameSource {
+    public:
+        virtual ~FrameSource() {};
+
+        /**
+         * @brief Read the next frame.
+         *
+         * @param frame Set to the frame. Its image is empty if the source had nothing this time
+         *  (e.g a dropped camera frame) but may have more later.
+         * @return false If the source has run out of frames for good.
+         */
+        virtual bool read(Frame& frame) = 0;
+    };
+
+    /**
+     * @brief Frames from a camera (or anything else cv::VideoCapture opens). The capture timestamp
+     *  is taken as soon as the frame is grabbed, before it's decoded.
+     */
+    class CameraSource : public FrameSource {
+    public:
+        bool open(int camera) { return capture_.open(camera); }
+        bool open(const std::string& path) { return capture_.open(path); }
+        bool isOpen() { return capture_.isOpened(); }
+
+        bool read(Frame& frame) override;
+
+        cv::VideoCapture & getCapture() { return capture_; }
+
+    private:
+        cv::VideoCapture capture_;
+        uint64_t index_ = 0;
+    };
+
+    /**
+     * @brief Frames from a FrameArchive recording, as fast as they're read. Images are views into
+     *  the archive's mapping (no copies). The capture timestamp is when the frame was read, the
+     *  frame timestamp is when it was recorded.
+     */
+    class ArchiveSource : public FrameSource {
+    public:
+        bool open(const std::string& path) { next_ = 0; return archive_.open(path); }
+        bool isOpen() { return archive_.isOpen(); }
+
+        bool read(Frame& frame) override;
+
+        FrameArchiveReader & getArchive() { return archive_; }
+
+    private:
+        FrameArchiveReader archive_;
+        size_t next_ = 0;
+    };
+}
@@ -0,0 +1,266 @@
+#include "GazeMapper.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Default RLS forgetting factor. Samples lose half their weight after ~700 updates.
+const double DEFAULT_FORGETTING = .999;
+
+// Ridge term added to the normal equations when seeding the RLS covariance from a fit, so it's
+// invertible even if the calibration samples didn't excite every term.
+const double COVARIANCE_REGULARIZATION = 1e-3;
+
+// Upper bound on the covariance trace. With forgetting < 1 and samples that all look the same
+// (the user staring at one spot) the covariance grows without bound and a single noisy sample
+// would then swing the model; this caps it.
+const double MAX_COVARIANCE_TRACE = 1e4;
+
+// Smallest ratio of the normal equations' smallest to largest singular value we'll fit.
+const double MIN_CONDITION = 1e-9;
+
+// Smallest feature spread we normalize by, in frame pixels.
+const float MIN_FEATURE_SCALE = 1e-3f;
+
+// Features dropped after a calibration target moves, while the eyes catch up.
+const int SETTLE_FRAMES = 8;
+
+// Calibration targets are kept this fraction of the screen away from its edges.
+const double TARGET_MARGIN = .1;
+
+camux::GazeMapper::GazeMapper() : forgetting_(DEFAULT_FORGETTING) {
+    reset();
+}
+
+void camux::GazeMapper::reset() {
+    fitted_ = false;
+    mean_ = cv::Point2f(0, 0);
+    scale_ = cv::Point2f(1, 1);
+    std::fill(weights_x_, weights_x_ + GAZE_TERMS, 0.0);
+    std::fill(weights_y_, weights_y_ + GAZE_TERMS, 0.0);
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        std::fill(covariance_[i], covariance_[i] + GAZE_TERMS, 0.0);
+    }
+}
+
+void camux::GazeMapper::_features(const cv::Point2f& offset, double features[GAZE_TERMS]) const {
+    double x = (offset.x - mean_.x) / scale_.x;
+    double y = (offset.y - mean_.y) / scale_.y;
+
+    features[0] = 1;
+    features[1] = x;
+    features[2] = y;
+    features[3] = x * y;
+    features[4] = x * x;
+    features[5] = y * y;
+}
+
+bool camux::GazeMapper::fit(const std::vector<cv::Point2f>& offsets, const std::vector<cv::Point2f>& targets) {
+    int n = std::min(offsets.size(), targets.size());
+    if (n < GAZE_TERMS) return false;
+
+    // Normalize by the samples' mean and standard deviation.
+    cv::Point2f mean(0, 0), spread(0, 0);
+    for (int i = 0; i < n; ++i) mean += offsets[i];
+    mean *= 1.f / n;
+    for (int i = 0; i < n; ++i) {
+        cv::Point2f d = offsets[i] - mean;
+        spread += cv::Point2f(d.x * d.x, d.y * d.y);
+    }
+    cv::Point2f scale(std::max(std::sqrt(spread.x / n), MIN_FEATURE_SCALE),
+                      std::max(std::sqrt(spread.y / n), MIN_FEATURE_SCALE));
+
+    cv::Point2f old_mean = mean_, old_scale = scale_;
+    mean_ = mean;
+    scale_ = scale;
+
+    cv::Mat A(n, GAZE_TERMS, CV_64F), b(n, 2, CV_64F);
+    for (int i = 0; i < n; ++i) {
+        _features(offsets[i], A.ptr<double>(i));
+        b.at<double>(i, 0) = targets[i].x;
+        b.at<double>(i, 1) = targets[i].y;
+    }
+
+    // Samples that don't pin down every term (e.g all at one target) can't be fitted.
+    cv::Mat normal = A.t() * A;
+    cv::Mat singular_values;
+    cv::SVD::compute(normal, singular_values, cv::SVD::NO_UV);
+    double min_sv, max_sv;
+    cv::minMaxLoc(singular_values, &min_sv, &max_sv);
+
+    // Least squares for both coordinates at once.
+    cv::Mat w;
+    if (min_sv <= max_sv * MIN_CONDITION || !cv::solve(A, b, w, cv::DECOMP_SVD)) {
+        mean_ = old_mean;
+        scale_ = old_scale;
+        return false;
+    }
+
+    // The RLS covariance starts as the inverse of the (regularized) normal equations, which is
+    // exactly what it would be had these samples been fed in one at a time.
+    cv::Mat covariance;
+    cv::invert(normal + cv::Mat::eye(GAZE_TERMS, GAZE_TERMS, CV_64F) * COVARIANCE_REGULARIZATION, covariance);
+
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        weights_x_[i] = w.at<double>(i, 0);
+        weights_y_[i] = w.at<double>(i, 1);
+        for (int j = 0; j < GAZE_TERMS; ++j) covariance_[i][j] = covariance.at<double>(i, j);
+    }
+
+    fitted_ = true;
+    return true;
+}
+
+void camux::GazeMapper::update(const cv::Point2f& offset, const cv::Point2f& target) {
+    if (!fitted_) return;
+
+    double f[GAZE_TERMS], pf[GAZE_TERMS];
+    _features(offset, f);
+
+    // Gain k = P f / (lambda + f' P f)
+    double denominator = forgetting_;
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        pf[i] = 0;
+        for (int j = 0; j < GAZE_TERMS; ++j) pf[i] += covariance_[i][j] * f[j];
+        denominator += f[i] * pf[i];
+    }
+
+    double error_x = target.x, error_y = target.y;
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        error_x -= weights_x_[i] * f[i];
+        error_y -= weights_y_[i] * f[i];
+    }
+
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        double k = pf[i] / denominator;
+        weights_x_[i] += k * error_x;
+        weights_y_[i] += k * error_y;
+    }
+
+    // P = (P - k f' P) / lambda, kept symmetric against rounding.
+    double trace = 0;
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        for (int j = i; j < GAZE_TERMS; ++j) {
+            double p = (covariance_[i][j] - pf[i] * pf[j] / denominator) / forgetting_;
+            covariance_[i][j] = covariance_[j][i] = p;
+        }
+        trace += covariance_[i][i];
+    }
+
+    if (trace > MAX_COVARIANCE_TRACE) {
+        double shrink = MAX_COVARIANCE_TRACE / trace;
+        for (int i = 0; i < GAZE_TERMS; ++i) {
+            for (int j = 0; j < GAZE_TERMS; ++j) covariance_[i][j] *= shrink;
+        }
+    }
+}
+
+cv::Point2f camux::GazeMapper::map(const cv::Point2f& offset) const {
+    double f[GAZE_TERMS];
+    _features(offset, f);
+
+    double x = 0, y = 0;
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        x += weights_x_[i] * f[i];
+        y += weights_y_[i] * f[i];
+    }
+    return cv::Point2f(x, y);
+}
+
+void camux::GazeMapper::write(cv::FileStorage& fs) const {
+    cv::Mat weights(2, GAZE_TERMS, CV_64F), covariance(GAZE_TERMS, GAZE_TERMS, CV_64F);
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        weights.at<double>(0, i) = weights_x_[i];
+        weights.at<double>(1, i) = weights_y_[i];
+        for (int j = 0; j < GAZE_TERMS; ++j) covariance.at<double>(i, j) = covariance_[i][j];
+    }
+
+    fs << "{"
+       << "fitted" << (int) fitted_
+       << "mean" << mean_
+       << "scale" << scale_
+       << "weights" << weights
+       << "covariance" << covariance
+       << "}";
+}
+
+void camux::GazeMapper::read(const cv::FileNode& node) {
+    if (node.empty() || !(int) node["fitted"]) return;
+
+    cv::Mat weights, covariance;
+    cv::Point2f mean, scale;
+    node["weights"] >> weights;
+    node["covariance"] >> covariance;
+    node["mean"] >> mean;
+    node["scale"] >> scale;
+
+    if (weights.rows != 2 || weights.cols != GAZE_TERMS || weights.type() != CV_64F ||
+        covariance.rows != GAZE_TERMS || covariance.cols != GAZE_TERMS || covariance.type() != CV_64F ||
+        scale.x < MIN_FEATURE_SCALE || scale.y < MIN_FEATURE_SCALE) return;
+
+    mean_ = mean;
+    scale_ = scale;
+    for (int i = 0; i < GAZE_TERMS; ++i) {
+        weights_x_[i] = weights.at<double>(0, i);
+        weights_y_[i] = weights.at<double>(1, i);
+        for (int j = 0; j < GAZE_TERMS; ++j) covariance_[i][j] = covariance.at<double>(i, j);
+    }
+    fitted_ = true;
+}
+
+camux::GazeCalibration::GazeCalibration(cv::Size screen, int rows, int cols, int samples_per_target) :
+    samples_per_target_(std::max(samples_per_target, 1)) {
+    rows = std::max(rows, 1);
+    cols = std::max(cols, 1);
+
+    for (int r = 0; r < rows; ++r) {
+        for (int c = 0; c < cols; ++c) {
+            // Alternate direction each row.
+            int col = r % 2 ? cols - 1 - c : c;
+            double x = cols > 1 ? TARGET_MARGIN + (1 - 2 * TARGET_MARGIN) * col / (cols - 1) : .5;
+            double y = rows > 1 ? TARGET_MARGIN + (1 - 2 * TARGET_MARGIN) * r / (rows - 1) : .5;
+            targets_.push_back(cv::Point2f(x * screen.width, y * screen.height));
+        }
+    }
+}
+
+void camux::GazeCalibration::start() {
+    running_ = true;
+    target_ = 0;
+    frames_at_target_ = 0;
+    offsets_.clear();
+    sample_targets_.clear();
+}
+
+bool camux::GazeCalibration::addSample(const cv::Point2f& offset) {
+    if (!running_) return false;
+
+    if (frames_at_target_++ >= SETTLE_FRAMES) {
+        offsets_.push_back(offset);
+        sample_targets_.push_back(getTarget());
+    }
+
+    if (frames_at_target_ < SETTLE_FRAMES + samples_per_target_) return false;
+
+    frames_at_target_ = 0;
+    if (++target_ < (int) targets_.size()) return false;
+
+    target_ = targets_.size() - 1;
+    running_ = false;
+    return true;
+}
+
+bool camux::GazeCalibration::apply(camux::GazeMapper& mapper) {
+    if (!mapper.isFitted()) return mapper.fit(offsets_, sample_targets_);
+
+    for (size_t i = 0; i < offsets_.size(); ++i) mapper.update(offsets_[i], sample_targets_[i]);
+    return true;
+}
+
+void camux::write(cv::FileStorage& fs, const std::string&, const camux::GazeMapper& mapper) {
+    mapper.write(fs);
+}
+
+void camux::read(const cv::FileNode& node, camux::GazeMapper& mapper, const camux::GazeMapper& default_value) {
+    mapper = default_value;
+    mapper.read(node);
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <opencv2/core/persistence.hpp>
+
+#include <vector>
+
+namespace camux {
+
+    // Terms of the gaze polynomial: 1, x, y, xy, x^2, y^2.
+    const int GAZE_TERMS = 6;
+
+    /**
+     * @brief Maps a gaze feature - the pupil position relative to an anchor that moves with the
+     *  head (the forehead dot, or the eye corners) - to a point on the screen, with a second order
+     *  polynomial in each screen coordinate.
+     *
+     *  The polynomial is fitted by least squares on calibration samples (fit()), then refined by
+     *  recursive least squares as more samples with known screen positions come in (update()).
+     *  An RLS update is a fixed amount of work on 6x6 matrices, however many samples came before,
+     *  and older samples are slowly forgotten so the model follows drift in how the user sits.
+     *
+     *  Features are normalized by the mean and spread of the calibration samples, so the
+     *  polynomial is well conditioned whatever the scale of the anchor offsets.
+     */
+    class GazeMapper {
+    public:
+        GazeMapper();
+
+        /**
+         * @brief Fit the model from scratch.
+         *
+         * @param offsets Gaze features (pupil - anchor), in frame pixels.
+         * @param targets The screen point the user was looking at for each feature.
+         * @return true If there were enough samples (at least GAZE_TERMS, spread over the screen)
+         *  to fit. If not the model is left as it was.
+         */
+        bool fit(const std::vector<cv::Point2f>& offsets, const std::vector<cv::Point2f>& targets);
+
+        /**
+         * @brief Refine a fitted model with one sample whose screen position is known (e.g a
+         *  calibration target, or where the user clicked). Does nothing before fit().
+         *
+         * @param offset The gaze feature.
+         * @param target Where on the screen the user was looking.
+         */
+        void update(const cv::Point2f& offset, const cv::Point2f& target);
+
+        /**
+         * @brief Where on the screen a gaze feature is looking.
+         */
+        cv::Point2f map(const cv::Point2f& offset) const;
+
+        bool isFitted() const { return fitted_; }
+        void reset();
+
+        /**
+         * @brief How much each RLS update discounts the samples before it, in (0, 1]. 1 never
+         *  forgets; lower follows drift faster but is noisier.
+         */
+        void setForgetting(double forgetting) { forgetting_ = forgetting; }
+
+        void write(cv::FileStorage& fs) const;
+        void read(const cv::FileNode& node);
+
+    private:
+        void _features(const cv::Point2f& offset, double features[GAZE_TERMS]) const;
+
+        bool fitted_ = false;
+        double forgetting_;
+
+        // Feature normalization, from the calibration samples.
+        cv::Point2f mean_;
+        cv::Point2f scale_;
+
+        // Polynomial coefficients for screen x and y.
+        double weights_x_[GAZE_TERMS];
+        double weights_y_[GAZE_TERMS];
+        // RLS inverse correlation matrix of the features. Shared by x and y, since they're fitted
+        // on the same features.
+        double covariance_[GAZE_TERMS][GAZE_TERMS];
+    };
+
+    /**
+     * @brief A multi-point calibration: a grid of targets on the screen, visited one at a time.
+     *  The user looks at each target while gaze features are collected for it; the first few
+     *  features after the target moves are dropped, since the eyes are still getting there.
+     *
+     *  Targets are visited row by row in alternating direction, so the eyes never have to jump
+     *  across the whole screen.
+     */
+    class GazeCalibration {
+    public:
+        /**
+         * @param screen The screen size, in pixels.
+         * @param rows The number of rows of targets.
+         * @param cols The number of columns of targets.
+         * @param samples_per_target How many features to collect at each target.
+         */
+        GazeCalibration(cv::Size screen, int rows = 3, int cols = 3, int samples_per_target = 20);
+
+        void start();
+        void stop() { running_ = false; }
+        bool isRunning() { return running_; }
+
+        // The target the user should be looking at now, in screen pixels.
+        cv::Point2f getTarget() { return targets_[target_]; }
+        int getTargetIndex() { return target_; }
+        int getTargetCount() { return targets_.size(); }
+
+        /**
+         * @brief Add the gaze feature of a frame where the user was looking at the current target.
+         *
+         * @return true If that was the last sample of the last target; the calibration stops.
+         */
+        bool addSample(const cv::Point2f& offset);
+
+        /**
+         * @brief Give the collected samples to a mapper: refit it if it hasn't been fitted yet,
+         *  otherwise refine it with them.
+         *
+         * @return true If the mapper is fitted afterwards.
+         */
+        bool apply(GazeMapper& mapper);
+
+    private:
+        std::vector<cv::Point2f> targets_;
+        int samples_per_target_;
+
+        bool running_ = false;
+        int target_ = 0;
+        int frames_at_target_ = 0;
+
+        // Collected features and the target each was collected at.
+        std::vector<cv::Point2f> offsets_;
+        std::vector<cv::Point2f> sample_targets_;
+    };
+
+    // FileStorage hooks so a mapper can be written as fs << "name" << mapper.
+    void write(cv::FileStorage& fs, const std::string& name, const GazeMapper& mapper);
+    void read(const cv::FileNode& node, GazeMapper& mapper, const GazeMapper& default_value = GazeMapper());
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <cstdint>
+
+namespace camux {
+
+    /**
+     * @brief Everything the tracker worked out from one frame. Positions are in frame pixels
+     *  unless noted, timestamps on the steady clock (see steadyMicros()) and timings in
+     *  microseconds.
+     *
+     *  Plain data, so it can be published whole to other threads (see Latest).
+     */
+    struct GazeSample {
+        uint64_t frame = 0;
+        // When the frame was captured, its own timestamp (see Frame), and when processing it finished.
+        int64_t capture_us = 0;
+        int64_t timestamp_us = 0;
+        int64_t done_us = 0;
+
+        bool face_found = false;
+        // Whether the full detector ran, rather than optical flow tracking.
+        bool ran_detector = false;
+        // Whether the detector found a face but lost one of its eyes (HaarCascade only), which
+        // leaves face_found false.
+        bool eyes_missed = false;
+
+        cv::Rect face;
+        cv::Rect left_eye;
+        cv::Rect right_eye;
+        float face_confidence = 0;
+        float left_eye_confidence = 0;
+        float right_eye_confidence = 0;
+
+        cv::Point left_pupil;
+        cv::Point right_pupil;
+        bool left_closed = false;
+        bool right_closed = false;
+        bool left_blinked = false;
+        bool right_blinked = false;
+        // Blinks so far this session.
+        int left_blinks = 0;
+        int right_blinks = 0;
+
+        bool forehead_found = false;
+        cv::Rect forehead_dot;
+        cv::Point forehead;
+
+        // The gaze feature (mean pupil - forehead dot), if both eyes were open and the dot found.
+        bool has_offset = false;
+        cv::Point2f gaze_offset;
+        // Where on the screen (screen pixels) the user is looking, if the gaze mapper is fitted.
+        bool gaze_valid = false;
+        cv::Point2f gaze;
+
+        // Stage timings.
+        float detect_us = 0;
+        float forehead_us = 0;
+        float pupil_us = 0;
+        float map_us = 0;
+        // Within pupil_us, the pupil searches alone: how long the frame waited for both (see
+        // EyePair, the eyes run concurrently) and each eye's own search.
+        float pupils_us = 0;
+        float left_pupil_us = 0;
+        float right_pupil_us = 0;
+    };
+}
@@ -0,0 +1,115 @@
+#include "GazeTrack.h"
+
+#include <cstdio>
+#include <cstring>
+
+static const char GAZE_TRACK_MAGIC[8] = { 'E', 'Y', 'E', 'G', 'A', 'Z', 'E', 0 };
+
+// Columns start on a cache line (and any SIMD load) boundary.
+static const uint64_t COLUMN_ALIGNMENT = 64;
+
+// The columns, in the order set() fills them.
+static const char* INT32_COLUMNS[] = {
+    "face_x", "face_y", "face_w", "face_h",
+    "left_eye_x", "left_eye_y", "left_eye_w", "left_eye_h",
+    "right_eye_x", "right_eye_y", "right_eye_w", "right_eye_h",
+    "left_pupil_x", "left_pupil_y", "right_pupil_x", "right_pupil_y",
+    "forehead_x", "forehead_y",
+    "left_blinks", "right_blinks"
+};
+static const char* FLOAT32_COLUMNS[] = {
+    "face_confidence", "gaze_offset_x", "gaze_offset_y", "gaze_x", "gaze_y"
+};
+static const int NUM_INT32 = sizeof(INT32_COLUMNS) / sizeof(INT32_COLUMNS[0]);
+static const int NUM_FLOAT32 = sizeof(FLOAT32_COLUMNS) / sizeof(FLOAT32_COLUMNS[0]);
+
+camux::GazeTrack::GazeTrack() {
+    _add("timestamp_us", TrackInt64, sizeof(int64_t));
+    _add("flags", TrackUInt32, sizeof(uint32_t));
+    for (int i = 0; i < NUM_INT32; ++i) _add(INT32_COLUMNS[i], TrackInt32, sizeof(int32_t));
+    for (int i = 0; i < NUM_FLOAT32; ++i) _add(FLOAT32_COLUMNS[i], TrackFloat32, sizeof(float));
+}
+
+void camux::GazeTrack::_add(const char* name, GazeTrackType type, size_t element_size) {
+    Column column;
+    column.name = name;
+    column.type = type;
+    column.element_size = element_size;
+    columns_.push_back(column);
+}
+
+void camux::GazeTrack::resize(uint64_t frames) {
+    for (size_t c = 0; c < columns_.size(); ++c) {
+        columns_[c].data.resize(frames * columns_[c].element_size, 0);
+    }
+    frames_ = frames;
+}
+
+void camux::GazeTrack::set(uint64_t frame, const GazeSample& s) {
+    uint32_t flags = TrackProcessed;
+    flags |= s.face_found ? TrackFaceFound : 0;
+    flags |= s.ran_detector ? TrackRanDetector : 0;
+    flags |= s.left_closed ? TrackLeftClosed : 0;
+    flags |= s.right_closed ? TrackRightClosed : 0;
+    flags |= s.left_blinked ? TrackLeftBlinked : 0;
+    flags |= s.right_blinked ? TrackRightBlinked : 0;
+    flags |= s.forehead_found ? TrackForeheadFound : 0;
+    flags |= s.has_offset ? TrackHasOffset : 0;
+    flags |= s.gaze_valid ? TrackGazeValid : 0;
+
+    int32_t ints[NUM_INT32] = {
+        s.face.x, s.face.y, s.face.width, s.face.height,
+        s.left_eye.x, s.left_eye.y, s.left_eye.width, s.left_eye.height,
+        s.right_eye.x, s.right_eye.y, s.right_eye.width, s.right_eye.height,
+        s.left_pupil.x, s.left_pupil.y, s.right_pupil.x, s.right_pupil.y,
+        s.forehead.x, s.forehead.y,
+        s.left_blinks, s.right_blinks
+    };
+    float floats[NUM_FLOAT32] = {
+        s.face_confidence, s.gaze_offset.x, s.gaze_offset.y, s.gaze.x, s.gaze.y
+    };
+
+    std::memcpy(&columns_[0].data[frame * sizeof(int64_t)], &s.timestamp_us, sizeof(int64_t));
+    std::memcpy(&columns_[1].data[frame * sizeof(uint32_t)], &flags, sizeof(uint32_t));
+    for (int i = 0; i < NUM_INT32; ++i) {
+        std::memcpy(&columns_[2 + i].data[frame * sizeof(int32_t)], &ints[i], sizeof(int32_t));
+    }
+    for (int i = 0; i < NUM_FLOAT32; ++i) {
+        std::memcpy(&columns_[2 + NUM_INT32 + i].data[frame * sizeof(float)], &floats[i], sizeof(float));
+    }
+}
+
+bool camux::GazeTrack::save(const std::string& path) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) return false;
+
+    GazeTrackHeader header = {};
+    std::memcpy(header.magic, GAZE_TRACK_MAGIC, sizeof(GAZE_TRACK_MAGIC));
+    header.version = GAZE_TRACK_VERSION;
+    header.columns = columns_.size();
+    header.frames = frames_;
+
+    std::vector<GazeTrackColumn> table(columns_.size());
+    uint64_t offset = sizeof(header) + table.size() * sizeof(GazeTrackColumn);
+    for (size_t c = 0; c < columns_.size(); ++c) {
+        offset = (offset + COLUMN_ALIGNMENT - 1) / COLUMN_ALIGNMENT * COLUMN_ALIGNMENT;
+        std::strncpy(table[c].name, columns_[c].name.c_str(), sizeof(table[c].name) - 1);
+        table[c].type = columns_[c].type;
+        table[c].element_size = columns_[c].element_size;
+        table[c].offset = offset;
+        offset += columns_[c].data.size();
+    }
+
+    bool ok = std::fwrite(&header, sizeof(header), 1, file) == 1 &&
+              std::fwrite(table.data(), sizeof(GazeTrackColumn), table.size(), file) == table.size();
+
+    static const char zeros[COLUMN_ALIGNMENT] = {};
+    uint64_t written = sizeof(header) + table.size() * sizeof(GazeTrackColumn);
+    for (size_t c = 0; ok && c < columns_.size(); ++c) {
+        ok = std::fwrite(zeros, 1, table[c].offset - written, file) == table[c].offset - written &&
+             std::fwrite(columns_[c].data.data(), 1, columns_[c].data.size(), file) == columns_[c].data.size();
+        written = table[c].offset + columns_[c].data.size();
+    }
+
+    return std::fclose(file) == 0 && ok;
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "GazeSample.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace camux {
+
+    // Bits of the flags column.
+    enum GazeTrackFlags {
+        // The frame was read and processed; everything else is 0 if not.
+        TrackProcessed     = 1 << 0,
+        TrackFaceFound     = 1 << 1,
+        TrackRanDetector   = 1 << 2,
+        TrackLeftClosed    = 1 << 3,
+        TrackRightClosed   = 1 << 4,
+        TrackLeftBlinked   = 1 << 5,
+        TrackRightBlinked  = 1 << 6,
+        TrackForeheadFound = 1 << 7,
+        TrackHasOffset     = 1 << 8,
+        TrackGazeValid     = 1 << 9
+    };
+
+    // Element types of the columns.
+    enum GazeTrackType {
+        TrackInt32 = 0,
+        TrackUInt32 = 1,
+        TrackInt64 = 2,
+        TrackFloat32 = 3
+    };
+
+    const uint32_t GAZE_TRACK_VERSION = 1;
+
+    /**
+     * @brief Header at the start of a gaze track file. Followed by a GazeTrackColumn for each
+     *  column, then the columns' data.
+     */
+    struct GazeTrackHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t columns;
+        uint64_t frames;
+    };
+
+    /**
+     * @brief Where a column is in the file: frames elements of type, starting offset bytes from
+     *  the start of the file (always a multiple of 64), little endian.
+     */
+    struct GazeTrackColumn {
+        char name[24];
+        uint32_t type;
+        uint32_t element_size;
+        uint64_t offset;
+    };
+
+    /**
+     * @brief Per-frame gaze samples of a whole recording, stored by column: one array per field
+     *  (timestamps, flags, face x, ...) rather than one record per frame, so analysis code can
+     *  map the file and read, say, the gaze x of every frame as one contiguous array (e.g with
+     *  numpy.frombuffer) without touching the rest.
+     *
+     *  Rectangles are split into _x, _y, _w and _h columns and points into _x and _y, in frame
+     *  pixels; gaze is in screen pixels. Frames are the rows, in order; a frame that wasn't
+     *  processed has all columns 0.
+     *
+     *  set() on different frames may be called from different threads at once.
+     */
+    class GazeTrack {
+    public:
+        GazeTrack();
+
+        /**
+         * @brief Make room for frames rows (all 0), keeping any already set.
+         */
+        void resize(uint64_t frames);
+        uint64_t size() { return frames_; }
+
+        /**
+         * @brief Set a frame's row from its sample.
+         *
+         * @param frame The row, < size().
+         * @param sample What the pipeline found in it.
+         */
+        void set(uint64_t frame, const GazeSample& sample);
+
+        /**
+         * @brief Write the track to a file (replacing it).
+         *
+         * @return true If it was written.
+         */
+        bool save(const std::string& path);
+
+    private:
+        struct Column {
+            std::string name;
+            GazeTrackType type;
+            size_t element_size;
+            std::vector<uint8_t> data;
+        };
+
+        void _add(const char* name, GazeTrackType type, size_t element_size);
+
+        uint64_t frames_ = 0;
+        std::vector<Column> columns_;
+    };
+}
@@ -0,0 +1,156 @@
+#include "LandmarkTracker.h"
+
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Lucas-Kanade window and number of pyramid levels above the base image. Landmarks move a few
+// pixels between frames, the extra levels are there for fast head turns.
+const cv::Size LK_WINDOW(15, 15);
+const int LK_PYRAMID_LEVELS = 3;
+const cv::TermCriteria LK_CRITERIA(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.03);
+
+// A point is lost if it comes back further than this (pixels) from where it started after being
+// tracked forward then backward.
+const float MAX_POINT_FB_ERROR = 1.5;
+// Give up on tracking (so the caller re-runs the detector) if the median forward-backward error
+// or the fraction of lost points get above these.
+const float MAX_MEDIAN_FB_ERROR = 1.0;
+const float MAX_LOST_FRACTION = .3;
+// Every group needs at least this many good points to estimate its motion.
+const int MIN_GROUP_POINTS = 2;
+
+// Median of the first n values. Reorders them.
+static float median(std::vector<float>& values, size_t n) {
+    if (n == 0) return 0;
+    std::nth_element(values.begin(), values.begin() + n / 2, values.begin() + n);
+    return values[n / 2];
+}
+
+void camux::LandmarkTracker::seed(const cv::Mat& gray, const std::vector<cv::Point2f>& points,
+                                  const std::vector<int>& groups, int num_groups) {
+    points_ = points;
+    groups_ = groups;
+    shifts_.assign(num_groups, cv::Point2f(0, 0));
+    scales_.assign(num_groups, 1);
+
+    cv::buildOpticalFlowPyramid(gray, prev_pyramid_, LK_WINDOW, LK_PYRAMID_LEVELS);
+    tracking_ = !points_.empty();
+}
+
+bool camux::LandmarkTracker::track(const cv::Mat& gray) {
+    if (!tracking_) return false;
+
+    cv::buildOpticalFlowPyramid(gray, pyramid_, LK_WINDOW, LK_PYRAMID_LEVELS);
+
+    // Forward pass, then track the results back into the previous frame.
+    cv::calcOpticalFlowPyrLK(prev_pyramid_, pyramid_, points_, next_, status_, err_,
+                             LK_WINDOW, LK_PYRAMID_LEVELS, LK_CRITERIA);
+    cv::calcOpticalFlowPyrLK(pyramid_, prev_pyramid_, next_, back_, back_status_, err_,
+                             LK_WINDOW, LK_PYRAMID_LEVELS, LK_CRITERIA);
+
+    size_t n = points_.size();
+    good_.assign(n, false);
+    fb_errors_.resize(n);
+
+    size_t lost = 0, measured = 0;
+    for (size_t i = 0; i < n; ++i) {
+        if (!status_[i] || !back_status_[i]) {
+            ++lost;
+            continue;
+        }
+        float fb = (float) cv::norm(back_[i] - points_[i]);
+        fb_errors_[measured++] = fb;
+        if (fb > MAX_POINT_FB_ERROR) {
+            ++lost;
+        } else {
+            good_[i] = true;
+        }
+    }
+
+    fb_error_ = median(fb_errors_, measured);
+    lost_fraction_ = n ? (float) lost / n : 1;
+
+    // The current pyramid is the previous one for the next frame.
+    std::swap(prev_pyramid_, pyramid_);
+
+    if (fb_error_ > MAX_MEDIAN_FB_ERROR || lost_fraction_ > MAX_LOST_FRACTION) {
+        tracking_ = false;
+        return false;
+    }
+
+    _estimateGroupMotion();
+    return tracking_;
+}
+
+void camux::LandmarkTracker::_estimateGroupMotion() {
+    size_t n = points_.size();
+    scratch_.resize(n);
+
+    for (size_t g = 0; g < shifts_.size(); ++g) {
+        // Centroids of the good points before and after.
+        cv::Point2f before(0, 0), after(0, 0);
+        size_t count = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (groups_[i] != (int) g || !good_[i]) continue;
+            before += points_[i];
+            after += next_[i];
+            ++count;
+        }
+
+        if (count < MIN_GROUP_POINTS) {
+            tracking_ = false;
+            return;
+        }
+        before *= 1.0f / count;
+        after *= 1.0f / count;
+
+        // Median shift, x and y separately.
+        size_t k = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (groups_[i] == (int) g && good_[i]) scratch_[k++] = next_[i].x - points_[i].x;
+        }
+        float dx = median(scratch_, k);
+        k = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (groups_[i] == (int) g && good_[i]) scratch_[k++] = next_[i].y - points_[i].y;
+        }
+        float dy = median(scratch_, k);
+
+        // Median change in each point's distance from the centroid.
+        k = 0;
+        for (size_t i = 0; i < n; ++i) {
+            if (groups_[i] != (int) g || !good_[i]) continue;
+            float d0 = (float) cv::norm(points_[i] - before);
+            if (d0 < 1) continue;
+            scratch_[k++] = (float) cv::norm(next_[i] - after) / d0;
+        }
+        float scale = k ? median(scratch_, k) : 1;
+
+        shifts_[g] = cv::Point2f(dx, dy);
+        scales_[g] = scale;
+
+        // Lost points follow their group so the landmark indices stay meaningful.
+        for (size_t i = 0; i < n; ++i) {
+            if (groups_[i] != (int) g || good_[i]) continue;
+            next_[i] = after + (points_[i] - before) * scale;
+        }
+    }
+
+    std::swap(points_, next_);
+}
+
+cv::Rect camux::LandmarkTracker::transform(const cv::Rect& rect, int group) {
+    if (group < 0 || group >= (int) shifts_.size()) return rect;
+
+    float scale = scales_[group];
+    cv::Point2f center(rect.x + rect.width / 2.0f, rect.y + rect.height / 2.0f);
+    center += shifts_[group];
+
+    float width = rect.width * scale;
+    float height = rect.height * scale;
+
+    return cv::Rect(cvRound(center.x - width / 2), cvRound(center.y - height / 2),
+                    cvRound(width), cvRound(height));
+}
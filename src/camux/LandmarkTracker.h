@@ -0,0 +1,104 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief Propagates a set of facial points (dlib landmarks, or corners found inside the
+     *  face/eye boxes) from frame to frame with pyramidal Lucas-Kanade optical flow, so we only
+     *  have to run a full detector when tracking breaks down.
+     *
+     *  Each point belongs to a group (e.g face, left eye, right eye). After every track() call
+     *  each group has a shift and scale (median point motion and median change in spread around
+     *  the group centroid) that can be applied to that group's bounding box.
+     *
+     *  Tracking is considered lost when too many points fail the forward-backward check: a point
+     *  is tracked into the new frame and then back again, and if it doesn't come back close to
+     *  where it started it's unreliable.
+     *
+     *  The image pyramids are kept between frames and swapped rather than rebuilt, so after the
+     *  first frame track() doesn't allocate.
+     */
+    class LandmarkTracker {
+    public:
+        LandmarkTracker() {};
+
+        /**
+         * @brief Start tracking a new set of points.
+         *
+         * @param gray The grayscale frame the points were detected on.
+         * @param points The points to track, in frame coordinates.
+         * @param groups The group of each point (same length as points), in [0, num_groups).
+         * @param num_groups The number of groups.
+         */
+        void seed(const cv::Mat& gray, const std::vector<cv::Point2f>& points,
+                  const std::vector<int>& groups, int num_groups);
+
+        /**
+         * @brief Track the points into a new frame.
+         *
+         * @param gray The new grayscale frame. Must be the same size as the seeded one.
+         * @return true If tracking held up. false if the forward-backward error or the fraction
+         *  of lost points crossed their thresholds; the tracker stops tracking until re-seeded.
+         */
+        bool track(const cv::Mat& gray);
+
+        /**
+         * @brief Stop tracking, e.g because the face was lost.
+         */
+        void reset() { tracking_ = false; }
+
+        bool isTracking() { return tracking_; }
+
+        /**
+         * @brief The tracked points in the last frame. Points that were lost on the last frame
+         *  are moved with their group rather than dropped, so indices stay the same as seeded.
+         */
+        const std::vector<cv::Point2f>& getPoints() { return points_; }
+
+        /**
+         * @brief Move a rectangle belonging to a group by that group's last shift and scale
+         *  (scaling about the rectangle's center).
+         *
+         * @param rect The rectangle in the previous frame.
+         * @param group The group the rectangle belongs to.
+         * @return cv::Rect The rectangle in the current frame.
+         */
+        cv::Rect transform(const cv::Rect& rect, int group);
+
+        // Median forward-backward error (pixels) and fraction of points lost on the last frame.
+        float getForwardBackwardError() { return fb_error_; }
+        float getLostFraction() { return lost_fraction_; }
+
+    private:
+        /**
+         * @brief Work out each group's shift and scale from its good points, then carry the
+         *  lost points along with their group.
+         */
+        void _estimateGroupMotion();
+
+        bool tracking_ = false;
+
+        // Pyramids of the previous and current frame. Swapped after each frame.
+        std::vector<cv::Mat> prev_pyramid_, pyramid_;
+
+        std::vector<cv::Point2f> points_;
+        std::vector<int> groups_;
+
+        // Scratch buffers, kept so tracking doesn't allocate per frame.
+        std::vector<cv::Point2f> next_, back_;
+        std::vector<uchar> status_, back_status_;
+        std::vector<float> err_, fb_errors_, scratch_;
+        std::vector<bool> good_;
+
+        // Per-group motion estimated on the last frame.
+        std::vector<cv::Point2f> shifts_;
+        std::vector<float> scales_;
+
+        float fb_error_ = 0;
+        float lost_fraction_ = 0;
+    };
+}
@@ -0,0 +1,64 @@
+#include "LatencyHistogram.h"
+
+#include <algorithm>
+#include <cstdio>
+
+void camux::LatencyHistogram::reset() {
+    std::fill(buckets_, buckets_ + BUCKETS, 0);
+    count_ = 0;
+    sum_ = 0;
+    max_ = 0;
+}
+
+int camux::LatencyHistogram::_bucket(int64_t us) {
+    if (us < SUB_BUCKETS) return us < 0 ? 0 : us;
+
+    // The top bit picks the doubling, the next three bits the bucket within it.
+    int top = 63 - __builtin_clzll((uint64_t) us);
+    int sub = (us >> (top - 3)) & (SUB_BUCKETS - 1);
+    return std::min((top - 2) * SUB_BUCKETS + sub, BUCKETS - 1);
+}
+
+int64_t camux::LatencyHistogram::_bucketValue(int bucket) {
+    if (bucket < SUB_BUCKETS) return bucket;
+
+    // The middle of the bucket.
+    int top = bucket / SUB_BUCKETS + 2;
+    int sub = bucket % SUB_BUCKETS;
+    int64_t low = (int64_t) (SUB_BUCKETS + sub) << (top - 3);
+    return low + ((int64_t) 1 << (top - 3)) / 2;
+}
+
+void camux::LatencyHistogram::add(int64_t us) {
+    ++buckets_[_bucket(us)];
+    ++count_;
+    sum_ += us;
+    max_ = std::max(max_, us);
+}
+
+int64_t camux::LatencyHistogram::percentile(double fraction) const {
+    if (count_ == 0) return 0;
+
+    uint64_t rank = std::min((uint64_t) (fraction * count_), count_ - 1);
+    uint64_t seen = 0;
+    for (int i = 0; i < BUCKETS; ++i) {
+        seen += buckets_[i];
+        if (seen > rank) return std::min(_bucketValue(i), max_);
+    }
+    return max_;
+}
+
+std::string camux::LatencyHistogram::summary() const {
+    char line[160];
+    std::snprintf(line, sizeof(line), "n=%llu mean=%.1fms p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms",
+                  (unsigned long long) count_, mean() / 1000, percentile(.5) / 1000.0, percentile(.9) / 1000.0,
+                  percentile(.99) / 1000.0, max_ / 1000.0);
+    return line;
+}
+
+void camux::LatencyHistogram::merge(const camux::LatencyHistogram& other) {
+    for (int i = 0; i < BUCKETS; ++i) buckets_[i] += other.buckets_[i];
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+namespace camux {
+
+    /**
+     * @brief A fixed size histogram of latencies, for percentiles over millions of frames without
+     *  keeping the samples. Buckets are logarithmic (eight per doubling, so any percentile is
+     *  within ~9% of the true value) from 1 microsecond to over an hour; add() is a couple of
+     *  instructions and never allocates.
+     */
+    class LatencyHistogram {
+    public:
+        LatencyHistogram() { reset(); }
+
+        void add(int64_t us);
+        void reset();
+
+        uint64_t count() const { return count_; }
+        double mean() const { return count_ ? (double) sum_ / count_ : 0; }
+        int64_t max() const { return max_; }
+
+        /**
+         * @brief The latency below which a fraction of the samples fall (e.g .99 for p99), in
+         *  microseconds. 0 if there are no samples.
+         */
+        int64_t percentile(double fraction) const;
+
+        /**
+         * @brief One line summary, e.g "n=300 mean=31.2ms p50=30.1ms p90=33.0ms p99=41.5ms max=44.0ms".
+         */
+        std::string summary() const;
+
+        // Add another histogram's samples to this one.
+        void merge(const LatencyHistogram& other);
+
+    private:
+        static const int SUB_BUCKETS = 8;
+        static const int BUCKETS = 33 * SUB_BUCKETS;
+
+        static int _bucket(int64_t us);
+        static int64_t _bucketValue(int bucket);
+
+        uint64_t buckets_[BUCKETS];
+        uint64_t count_;
+        int64_t sum_;
+        int64_t max_;
+    };
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace camux {
+
+    /**
+     * @brief The latest value from one producer thread, for any number of reader threads: a
+     *  seqlock, like the stats segment's (see StatsSegment) but in process.
+     *
+     *  publish() never waits on readers: it's two atomic stores around a copy. read() always gets
+     *  a complete, consistent value - never half of one publication and half of the next. A read
+     *  that overlaps a publish just copies again, which for a few hundred bytes published once a
+     *  frame almost never happens.
+     *
+     *  T should be plain data (no pointers to things the producer goes on to change), since
+     *  readers may copy it while it's being overwritten and throw that copy away.
+     */
+    template <typename T>
+    class Latest {
+    public:
+        Latest() : sequence_(0) {}
+
+        Latest(const Latest&) = delete;
+        Latest& operator=(const Latest&) = delete;
+
+        /**
+         * @brief Replace the value. Only ever call from one thread at a time.
+         */
+        void publish(const T& value) {
+            // Odd while we copy, even once we're done.
+            uint64_t sequence = sequence_.load(std::memory_order_relaxed);
+            sequence_.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            value_ = value;
+
+            sequence_.store(sequence + 2, std::memory_order_release);
+        }
+
+        /**
+         * @brief Take a consistent copy of the latest value.
+         *
+         * @param value Set to the latest value, if anything's been published.
+         * @return uint64_t How many values have been published (0 if none yet, and value is
+         *  untouched). Compare against the last read's to tell whether this one is new.
+         */
+        uint64_t read(T& value) const {
+            for (;;) {
+                uint64_t before = sequence_.load(std::memory_order_acquire);
+                if (before == 0) return 0;
+                if (before & 1) continue;
+
+                value = value_;
+
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (sequence_.load(std::memory_order_relaxed) == before) return before / 2;
+            }
+        }
+
+        /**
+         * @brief How many values have been published.
+         */
+        uint64_t count() const { return sequence_.load(std::memory_order_acquire) / 2; }
+
+    private:
+        std::atomic<uint64_t> sequence_;
+        T value_;
+    };
+}
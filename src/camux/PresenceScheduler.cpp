@@ -0,0 +1,110 @@
+#include "PresenceScheduler.h"
+
+#include <algorithm>
+#include <ctime>
+
+// Frames tracked without a face before we decide nobody's there (a second at 30 fps). Long enough
+// that a blink, a turned head or a hand in front of the face doesn't drop us to scanning.
+const int ABSENT_AFTER_FRAMES = 30;
+
+// Time between scans when nobody's there, and how much the scanned frames are shrunk. 4 Hz is
+// quick enough that someone sitting down is being tracked before they've settled.
+const int64_t SCAN_INTERVAL_US = 250000;
+const double SCAN_SCALE = .5;
+
+// Even with the motion gate on, look for a face this often, in case someone sat down very still
+// (or the motion detector missed them).
+const int64_t MAX_GATED_INTERVAL_US = 5000000;
+
+// The motion detector compares tiny grayscale thumbnails of this width. A pixel counts as changed
+// if it moved by more than MOTION_PIXEL_THRESHOLD gray levels, and the frame as moved if more than
+// MOTION_FRACTION of its pixels did. Sensor noise on a thumbnail this small stays well under both.
+const int MOTION_WIDTH = 80;
+const double MOTION_PIXEL_THRESHOLD = 25;
+const double MOTION_FRACTION = .01;
+
+static int64_t cpu_micros() {
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+camux::PresenceScheduler::PresenceScheduler() {
+    last_wall_us_ = steadyMicros();
+    last_cpu_us_ = cpu_micros();
+}
+
+double camux::PresenceScheduler::getScanScale() {
+    return SCAN_SCALE;
+}
+
+camux::PresenceScheduler::Action camux::PresenceScheduler::next(const Frame& frame) {
+    _account();
+
+    if (state_ == Present) return Track;
+
+    if (frame.timestamp_us - last_scan_us_ < SCAN_INTERVAL_US) return Skip;
+    last_scan_us_ = frame.timestamp_us;
+
+    // The motion check is against the last scan's frame, not the last frame: slow movement adds
+    // up over a scan interval.
+    bool moved = _moved(frame.image);
+    if (motion_gate_ && !moved && frame.timestamp_us - last_detect_us_ < MAX_GATED_INTERVAL_US) {
+        ++gated_scans_;
+        return Skip;
+    }
+
+    last_detect_us_ = frame.timestamp_us;
+    ++scans_;
+    return Scan;
+}
+
+void camux::PresenceScheduler::update(bool face_found) {
+    if (face_found) {
+        frames_without_face_ = 0;
+        state_ = Present;
+        return;
+    }
+
+    // Scans don't count toward this; they only happen once we're already Absent.
+    if (state_ == Present && ++frames_without_face_ >= ABSENT_AFTER_FRAMES) {
+        state_ = Absent;
+        // Scan on the next frame, and start the motion detector afresh.
+        last_scan_us_ = last_detect_us_ = INT64_MIN / 2;
+        previous_motion_.release();
+    }
+}
+
+double camux::PresenceScheduler::getCpuSecondsPerHour(PresenceState state) {
+    if (!wall_us_[state]) return 0;
+    return 3600.0 * cpu_us_[state] / wall_us_[state];
+}
+
+bool camux::PresenceScheduler::_moved(const cv::Mat& image) {
+    if (image.empty()) return false;
+
+    int height = std::max(1, cvRound((double) image.rows * MOTION_WIDTH / image.cols));
+    cv::resize(image, motion_, cv::Size(MOTION_WIDTH, height), 0, 0, cv::INTER_AREA);
+    if (motion_.channels() == 3) cv::cvtColor(motion_, motion_, cv::COLOR_BGR2GRAY);
+
+    bool moved = true;
+    if (previous_motion_.size() == motion_.size()) {
+        cv::absdiff(motion_, previous_motion_, difference_);
+        cv::threshold(difference_, difference_, MOTION_PIXEL_THRESHOLD, 255, cv::THRESH_BINARY);
+        moved = cv::countNonZero(difference_) > MOTION_FRACTION * difference_.total();
+    }
+
+    cv::swap(motion_, previous_motion_);
+    return moved;
+}
+
+void camux::PresenceScheduler::_account() {
+    int64_t wall = steadyMicros();
+    int64_t cpu = cpu_micros();
+
+    wall_us_[state_] += wall - last_wall_us_;
+    cpu_us_[state_] += cpu - last_cpu_us_;
+
+    last_wall_us_ = wall;
+    last_cpu_us_ = cpu;
+}
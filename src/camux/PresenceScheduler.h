@@ -0,0 +1,98 @@
+#pragma once
+
+#include "FrameSource.h"
+#include "geometry.hpp"
+
+#include <cstdint>
+
+namespace camux {
+
+    enum PresenceState {
+        // Someone's in front of the camera (or was very recently): every frame is tracked.
+        Present = 0,
+        // Nobody is: a few frames a second are scanned for a face, at reduced resolution.
+        Absent = 1
+    };
+
+    /**
+     * @brief Decides how much work each frame gets, by whether there's anyone in front of the
+     *  camera. With a face present every frame is tracked at full resolution. Once it's been gone
+     *  for a second, the tracker drops to scanning a few frames a second at reduced resolution
+     *  for a face to come back, and only when the cheap motion detector sees something change
+     *  (if motion gating is on). The first scan that finds a face switches straight back, so the
+     *  next frame is tracked at full rate.
+     *
+     *  It also keeps account of the CPU time the process spends in each state.
+     *
+     *  Scan timing goes by the frames' own timestamps, so a replayed recording is scheduled as
+     *  it was when live.
+     */
+    class PresenceScheduler {
+    public:
+        enum Action {
+            // Run the full pipeline on the frame.
+            Track,
+            // Look for a face in a reduced resolution copy of the frame (see getScanScale()).
+            Scan,
+            // Do nothing with the frame.
+            Skip
+        };
+
+        PresenceScheduler();
+
+        /**
+         * @brief What to do with this frame. Follow up with update() for Track and Scan.
+         */
+        Action next(const Frame& frame);
+
+        /**
+         * @brief Whether the frame next() said to Track or Scan had a face in it.
+         */
+        void update(bool face_found);
+
+        /**
+         * @brief Only scan when the frame has changed since the last scan (or it's been a while
+         *  anyway). On by default.
+         */
+        void setMotionGate(bool gate) { motion_gate_ = gate; }
+
+        PresenceState getState() { return state_; }
+        // How much to shrink frames by for a Scan.
+        double getScanScale();
+
+        // Scans run and scans the motion gate skipped, since starting.
+        uint64_t getScans() { return scans_; }
+        uint64_t getGatedScans() { return gated_scans_; }
+
+        /**
+         * @brief Seconds of process CPU time per hour spent in a state, as of the last next()
+         *  call. 0 if it's never been in that state.
+         */
+        double getCpuSecondsPerHour(PresenceState state);
+
+        // Seconds of wall time spent in a state.
+        double getSeconds(PresenceState state) { return wall_us_[state] / 1e6; }
+
+    private:
+        // Whether the frame differs enough from the one at the last scan.
+        bool _moved(const cv::Mat& image);
+        // Charge the wall and CPU time since the last call to the current state.
+        void _account();
+
+        PresenceState state_ = Present;
+        int frames_without_face_ = 0;
+
+        bool motion_gate_ = true;
+        int64_t last_scan_us_ = 0;
+        int64_t last_detect_us_ = 0;
+        cv::Mat motion_, previous_motion_, difference_;
+
+        uint64_t scans_ = 0;
+        uint64_t gated_scans_ = 0;
+
+        int64_t last_wall_us_ = 0;
+        int64_t last_cpu_us_ = 0;
+        int64_t wall_us_[2] = {0, 0};
+        int64_t cpu_us_[2] = {0, 0};
+    };
+}
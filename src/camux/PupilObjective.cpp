@@ -0,0 +1,158 @@
+#include "PupilObjective.h"
+
+#include <opencv2/core/utility.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+// Candidates per tile of maximizePupilObjectiveParallel(), and gradients per block: each tile's
+// running sums (2 KB) and a block of gradients (16 KB) fit in L1 together.
+const int TILE_WIDTH = 32;
+const int TILE_HEIGHT = 8;
+const size_t GRADIENT_BLOCK = 1024;
+
+// Add the terms of gradients [begin, end) for candidate (cx, cy) to sum, one at a time and in order,
+// so however the list is split the sum comes out the same.
+static inline void accumulate(double& sum, const std::vector<camux::GradientSample>& gradients, size_t begin, size_t end,
+                              float cx, float cy) {
+    for (size_t i = begin; i < end; ++i) {
+        const camux::GradientSample& g = gradients[i];
+        float dx = g.x - cx;
+        float dy = g.y - cy;
+        float norm_sq = dx * dx + dy * dy;
+        if (norm_sq == 0) continue;
+
+        // Only gradients pointing away from the candidate count (dark center, bright surround).
+        float dot = dx * g.gx + dy * g.gy;
+        if (dot <= 0) continue;
+
+        sum += dot * dot / norm_sq;
+    }
+}
+
+double camux::pupilObjective(const std::vector<camux::GradientSample>& gradients, float cx, float cy) {
+    if (gradients.empty()) return 0;
+
+    double sum = 0;
+    accumulate(sum, gradients, 0, gradients.size(), cx, cy);
+    return sum / gradients.size();
+}
+
+cv::Point camux::maximizePupilObjective(const std::vector<camux::GradientSample>& gradients, const cv::Mat& weights,
+                                        const cv::Mat& candidates, const cv::Rect& window, double& best_score) {
+    cv::Rect area = window & cv::Rect(0, 0, candidates.cols, candidates.rows);
+    cv::Point best(-1, -1);
+    best_score = 0;
+
+    for (int y = area.y; y < area.y + area.height; ++y) {
+        const uchar* mask = candidates.ptr<uchar>(y);
+        const float* weight = weights.ptr<float>(y);
+
+        for (int x = area.x; x < area.x + area.width; ++x) {
+            if (!mask[x]) continue;
+
+            // Strictly greater, so ties go to the first candidate in row-major order.
+            double score = weight[x] * pupilObjective(gradients, x, y);
+            if (score > best_score || best.x < 0) {
+                best_score = score;
+                best = cv::Point(x, y);
+            }
+        }
+    }
+
+    return best;
+}
+
+namespace {
+
+    // The best candidate of one tile.
+    struct TileBest {
+        cv::Point point;
+        double score;
+    };
+
+    class ObjectiveTiles : public cv::ParallelLoopBody {
+    public:
+        ObjectiveTiles(const std::vector<camux::GradientSample>& gradients, const cv::Mat& weights, const cv::Mat& candidates,
+                       const cv::Rect& area, std::vector<TileBest>& tiles)
+            : gradients_(gradients), weights_(weights), candidates_(candidates), area_(area), tiles_(tiles),
+              columns_((area.width + TILE_WIDTH - 1) / TILE_WIDTH) {}
+
+        void operator()(const cv::Range& range) const override {
+            for (int t = range.start; t < range.end; ++t) _tile(t);
+        }
+
+    private:
+        void _tile(int t) const {
+            cv::Rect tile(area_.x + (t % columns_) * TILE_WIDTH, area_.y + (t / columns_) * TILE_HEIGHT, TILE_WIDTH, TILE_HEIGHT);
+            tile &= area_;
+
+            // The tile's candidates, in row-major order.
+            cv::Point points[TILE_WIDTH * TILE_HEIGHT];
+            double sums[TILE_WIDTH * TILE_HEIGHT];
+            int count = 0;
+            for (int y = tile.y; y < tile.br().y; ++y) {
+                const uchar* mask = candidates_.ptr<uchar>(y);
+                for (int x = tile.x; x < tile.br().x; ++x) {
+                    if (!mask[x]) continue;
+                    points[count] = cv::Point(x, y);
+                    sums[count++] = 0;
+                }
+            }
+
+            // A block of gradients at a time against every candidate, so the block stays in cache.
+            for (size_t begin = 0; begin < gradients_.size(); begin += GRADIENT_BLOCK) {
+                size_t end = std::min(begin + GRADIENT_BLOCK, gradients_.size());
+                for (int i = 0; i < count; ++i) accumulate(sums[i], gradients_, begin, end, points[i].x, points[i].y);
+            }
+
+            TileBest best = { cv::Point(-1, -1), 0 };
+            for (int i = 0; i < count; ++i) {
+                // As weight * pupilObjective() in maximizePupilObjective().
+                double objective = gradients_.empty() ? 0 : sums[i] / gradients_.size();
+                double score = weights_.ptr<float>(points[i].y)[points[i].x] * objective;
+                if (score > best.score || best.point.x < 0) {
+                    best.score = score;
+                    best.point = points[i];
+                }
+            }
+            tiles_[t] = best;
+        }
+
+        const std::vector<camux::GradientSample>& gradients_;
+        const cv::Mat& weights_;
+        const cv::Mat& candidates_;
+        cv::Rect area_;
+        std::vector<TileBest>& tiles_;
+        int columns_;
+    };
+}
+
+cv::Point camux::maximizePupilObjectiveParallel(const std::vector<camux::GradientSample>& gradients, const cv::Mat& weights,
+                                                const cv::Mat& candidates, const cv::Rect& window, double& best_score) {
+    cv::Rect area = window & cv::Rect(0, 0, candidates.cols, candidates.rows);
+    cv::Point best(-1, -1);
+    best_score = 0;
+    if (area.area() == 0) return best;
+
+    int columns = (area.width + TILE_WIDTH - 1) / TILE_WIDTH;
+    int rows = (area.height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+    std::vector<TileBest> tiles(columns * rows);
+    cv::parallel_for_(cv::Range(0, columns * rows), ObjectiveTiles(gradients, weights, candidates, area, tiles));
+
+    // Tiles in row-major order of their candidates would interleave rows, so ties are broken on the
+    // point rather than the tile order: the highest score, and of those the first in row-major
+    // order, as the serial search picks.
+    for (size_t t = 0; t < tiles.size(); ++t) {
+        const TileBest& tile = tiles[t];
+        if (tile.point.x < 0) continue;
+
+        bool earlier = tile.point.y < best.y || (tile.point.y == best.y && tile.point.x < best.x);
+        if (best.x < 0 || tile.score > best_score || (tile.score == best_score && earlier)) {
+            best_score = tile.score;
+            best = tile.point;
+        }
+    }
+
+    return best;
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief A strong image gradient fed to the pupil objective: its position in the eye crop and
+     *  its direction as a unit vector.
+     */
+    struct GradientSample {
+        float x, y;
+        float gx, gy;
+    };
+
+    /**
+     * @brief The Timm & Barth objective for one candidate center c: the mean over all gradients i of
+     *  max(0, d_i . g_i)^2, where d_i is the unit vector from c to gradient i and g_i its unit
+     *  gradient. Gradients on the edge of a dark ellipse all point away from its center, so the
+     *  center maximizes this. O(len(gradients)).
+     *
+     * @param gradients The strong gradients of the eye crop.
+     * @param cx The x coordinate of the candidate center.
+     * @param cy The y coordinate of the candidate center.
+     * @return double The objective, in [0, 1].
+     */
+    double pupilObjective(const std::vector<GradientSample>& gradients, float cx, float cy);
+
+    /**
+     * @brief Evaluate the objective at every candidate center inside a window and return the best.
+     *  O(candidates * gradients).
+     *
+     * @param gradients The strong gradients of the eye crop.
+     * @param weights Per-pixel prior (CV_32F, crop sized) multiplied into the objective. Timm & Barth
+     *  use the inverted intensity, since the pupil is dark.
+     * @param candidates Mask (CV_8U, crop sized) of pixels that may be the center. Zero is skipped.
+     * @param window The part of the crop to search.
+     * @param best_score Set to the weighted objective of the returned center (0 if none).
+     * @return cv::Point The best center in crop coordinates, or (-1, -1) if no candidate was in the
+     *  window.
+     */
+    cv::Point maximizePupilObjective(const std::vector<GradientSample>& gradients, const cv::Mat& weights,
+                                     const cv::Mat& candidates, const cv::Rect& window, double& best_score);
+
+    /**
+     * @brief maximizePupilObjective() for large crops, e.g from a near-eye camera, where the search
+     *  is hundreds of thousands of candidates against thousands of gradients. The window is split
+     *  into small tiles of candidates spread over OpenCV's threads (cv::parallel_for_), and each
+     *  tile runs through the gradients a cache-sized block at a time.
+     *
+     *  Returns exactly what maximizePupilObjective() does: every candidate's sum is taken in the
+     *  same order, and the tiles' bests are reduced to the highest score, the first in row-major
+     *  order on a tie, whatever order the tiles finished in.
+     */
+    cv::Point maximizePupilObjectiveParallel(const std::vector<GradientSample>& gradients, const cv::Mat& weights,
+                                             const cv::Mat& candidates, const cv::Rect& window, double& best_score);
+}
@@ -0,0 +1,49 @@
+#include "ResolutionController.h"
+
+#include <algorithm>
+#include <cmath>
+
+// How wide (pixels) the face should be in the processed frame. Comfortably over the Haar
+// cascade's minimum face (see HaarBackend) at the same scale, so the face is still found if
+// the user leans back a little before the scale catches up.
+const double TARGET_FACE_WIDTH = 320;
+
+// The scale moves in steps of this, between these bounds.
+const double SCALE_STEP = .125;
+const double MIN_SCALE = .25;
+const double MAX_SCALE = 1;
+
+// How far the face may drift from the target size (as a fraction of it) before the scale changes.
+const double SCALE_HYSTERESIS = .25;
+
+// How wide (pixels) eye crops are resized to for the pupil localizer, and the most they're
+// shrunk or enlarged by.
+const double EYE_CROP_WIDTH = 64;
+const double MIN_EYE_SCALE = .25;
+const double MAX_EYE_SCALE = 3;
+
+void camux::ResolutionController::update(bool face_found, const cv::Rect& face) {
+    if (!face_found || face.width <= 0) {
+        scale_ = MAX_SCALE;
+        return;
+    }
+
+    double width = face.width * scale_;
+    if (std::abs(width - TARGET_FACE_WIDTH) <= SCALE_HYSTERESIS * TARGET_FACE_WIDTH) return;
+
+    double scale = std::round(TARGET_FACE_WIDTH / face.width / SCALE_STEP) * SCALE_STEP;
+    scale_ = std::min(MAX_SCALE, std::max(MIN_SCALE, scale));
+}
+
+double camux::ResolutionController::eyeScale(const cv::Rect& eye) {
+    if (eye.width <= 0) return 1;
+    return std::min(MAX_EYE_SCALE, std::max(MIN_EYE_SCALE, EYE_CROP_WIDTH / eye.width));
+}
+
+cv::Rect camux::ResolutionController::toFrame(const cv::Rect& r, double scale) {
+    return cv::Rect(cvRound(r.x / scale), cvRound(r.y / scale), cvRound(r.width / scale), cvRound(r.height / scale));
+}
+
+cv::Rect camux::ResolutionController::fromFrame(const cv::Rect& r, double scale) {
+    return cv::Rect(cvRound(r.x * scale), cvRound(r.y * scale), cvRound(r.width * scale), cvRound(r.height * scale));
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include "geometry.hpp"
+
+namespace camux {
+
+    /**
+     * @brief Picks the resolution frames are processed at, per frame, from the size of the face
+     *  being tracked: the frame is shrunk so the face comes out about the same size whether the
+     *  user sits close or far, and each eye crop is resized to the same width for the pupil
+     *  localizer.
+     *
+     *  A face covering half the frame is mostly wasted pixels for the detectors, and their costs
+     *  (and the optical flow window, the Haar minimum size, the forehead dot kernel) are all tuned
+     *  for a face of roughly one size. The pupil localizer's thresholds adapt per eye, but its
+     *  center is only as fine as the crop's pixels, and tiny crops from a far away user are too
+     *  coarse.
+     *
+     *  The scale only moves in steps, and only when the face has changed size by a good margin,
+     *  so it isn't changing every frame (each change restarts optical flow tracking). With no face
+     *  it goes back to full resolution, so a small face can still be found.
+     */
+    class ResolutionController {
+    public:
+        /**
+         * @brief Work out the scale for the next frame.
+         *
+         * @param face_found Whether this frame had a face.
+         * @param face The face, in full frame pixels.
+         */
+        void update(bool face_found, const cv::Rect& face);
+
+        /**
+         * @brief The scale to shrink the next frame by: 1 for full resolution, never more.
+         */
+        double getScale() { return scale_; }
+
+        /**
+         * @brief How much to resize an eye crop (full frame pixels) by for the pupil localizer.
+         *  May be more than 1, for a far away user.
+         */
+        static double eyeScale(const cv::Rect& eye);
+
+        // Map between full frame pixels and pixels of a frame shrunk by scale.
+        static cv::Rect toFrame(const cv::Rect& r, double scale);
+        static cv::Rect fromFrame(const cv::Rect& r, double scale);
+
+    private:
+        double scale_ = 1;
+    };
+}
@@ -0,0 +1,113 @@
+#include "Stats.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char STATS_MAGIC[8] = { 'E', 'Y', 'E', 'S', 'T', 'A', 'T', 0 };
+
+// How many torn copies a reader tolerates before giving up on this read.
+static const int MAX_READ_ATTEMPTS = 100;
+
+bool camux::StatsPublisher::open(const std::string& name) {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) return false;
+
+    if (ftruncate(fd, sizeof(StatsSegment)) != 0) {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    void* map = mmap(nullptr, sizeof(StatsSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        return false;
+    }
+
+    segment_ = static_cast<StatsSegment*>(map);
+    name_ = name;
+
+    // Readers check the magic and version before anything else, so write those last.
+    std::memset(&segment_->stats, 0, sizeof(Stats));
+    segment_->sequence.store(0, std::memory_order_relaxed);
+    segment_->size = sizeof(StatsSegment);
+    segment_->version = STATS_VERSION;
+    std::atomic_thread_fence(std::memory_order_release);
+    std::memcpy(segment_->magic, STATS_MAGIC, sizeof(STATS_MAGIC));
+
+    return true;
+}
+
+void camux::StatsPublisher::close() {
+    if (!segment_) return;
+
+    munmap(segment_, sizeof(StatsSegment));
+    shm_unlink(name_.c_str());
+    segment_ = nullptr;
+}
+
+void camux::StatsPublisher::publish(const Stats& stats) {
+    if (!segment_) return;
+
+    // Seqlock write: odd while we copy, even once we're done.
+    uint64_t sequence = segment_->sequence.load(std::memory_order_relaxed);
+    segment_->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memcpy(&segment_->stats, &stats, sizeof(Stats));
+
+    segment_->sequence.store(sequence + 2, std::memory_order_release);
+}
+
+bool camux::StatsReader::open(const std::string& name) {
+    close();
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < sizeof(StatsSegment)) {
+        ::close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, sizeof(StatsSegment), PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (map == MAP_FAILED) return false;
+
+    segment_ = static_cast<const StatsSegment*>(map);
+
+    if (std::memcmp(segment_->magic, STATS_MAGIC, sizeof(STATS_MAGIC)) != 0 ||
+        segment_->version != STATS_VERSION || segment_->size != sizeof(StatsSegment)) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void camux::StatsReader::close() {
+    if (segment_) munmap(const_cast<StatsSegment*>(segment_), sizeof(StatsSegment));
+    segment_ = nullptr;
+}
+
+bool camux::StatsReader::read(Stats& stats) {
+    if (!segment_) return false;
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        uint64_t before = segment_->sequence.load(std::memory_order_acquire);
+        if (before & 1) continue;
+
+        std::memcpy(&stats, &segment_->stats, sizeof(Stats));
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (segment_->sequence.load(std::memory_order_relaxed) == before) return true;
+    }
+    return false;
+}
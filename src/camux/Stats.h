@@ -0,0 +1,153 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace camux {
+
+    // Name of the shared memory segment eye_mouse publishes its stats to (see eye_mouse_stat).
+    const char* const STATS_SEGMENT = "/eye_mouse_stats";
+
+    enum TrackingState {
+        NoFace = 0,
+        // The full detector ran this frame.
+        Detecting = 1,
+        // Optical flow carried the last detection forward this frame.
+        Tracking = 2,
+        // Nobody's been there for a while; only scanning for a face (see PresenceScheduler).
+        Idle = 3
+    };
+
+    /**
+     * @brief The live counters and gauges of a running tracker. Plain old data, copied whole into
+     *  the shared memory segment. Latencies are exponential moving averages in microseconds.
+     *
+     *  If you change this, bump STATS_VERSION.
+     */
+    struct Stats {
+        int32_t pid;
+        int32_t tracking_state;
+        // Steady clock time (microseconds) the tracker started and the stats were last updated.
+        int64_t start_us;
+        int64_t update_us;
+
+        // Counters
+        uint64_t frames;
+        // Frames the camera gave us nothing for.
+        uint64_t dropped_frames;
+        // Frames that took longer than the camera's frame interval to process.
+        uint64_t late_frames;
+        uint64_t detector_runs;
+        uint64_t faces_lost;
+        uint64_t blinks;
+
+        // Gauges
+        double fps;
+        double detect_us;
+        double forehead_us;
+        double pupil_us;
+        double frame_us;
+        double max_frame_us;
+        double model_load_ms;
+        int32_t calibrated;
+        int32_t padding;
+        // Process CPU seconds per hour with someone in front of the camera, and with nobody.
+        double present_cpu_s_per_h;
+        double absent_cpu_s_per_h;
+        // Of both eyes' pupil searches: how often the window around the last center was enough, and
+        // how much faster searching is for it (see Eye::setWarmStart()).
+        double pupil_warm_hit_rate;
+        double pupil_search_speedup;
+        // The pupil searches of the pupil stage: both eyes (what the frame waited) and each eye.
+        double pupils_us;
+        double left_pupil_us;
+        double right_pupil_us;
+    };
+
+    const uint32_t STATS_VERSION = 4;
+
+    /**
+     * @brief Layout of the shared memory segment. The sequence number is a seqlock: it's odd while
+     *  the publisher is writing stats, and readers retry if it was odd or changed while they
+     *  copied.
+     */
+    struct StatsSegment {
+        char magic[8];
+        uint32_t version;
+        uint32_t size;
+        std::atomic<uint64_t> sequence;
+        Stats stats;
+    };
+
+    /**
+     * @brief Publishes Stats into a shared memory segment. publish() never waits on readers -
+     *  it's two atomic stores and a copy.
+     *
+     */
+    class StatsPublisher {
+    public:
+        StatsPublisher() {};
+        ~StatsPublisher() { close(); }
+
+        StatsPublisher(const StatsPublisher&) = delete;
+        StatsPublisher& operator=(const StatsPublisher&) = delete;
+
+        /**
+         * @brief Create (or take over) the segment.
+         *
+         * @param name The POSIX shared memory name, starting with '/'.
+         * @return true If the segment is ready to publish to.
+         */
+        bool open(const std::string& name = STATS_SEGMENT);
+
+        /**
+         * @brief Unmap and remove the segment. Called by the destructor.
+         */
+        void close();
+
+        bool isOpen() { return segment_ != nullptr; }
+
+        /**
+         * @brief Copy a new set of stats into the segment. Does nothing if it isn't open.
+         */
+        void publish(const Stats& stats);
+
+    private:
+        StatsSegment* segment_ = nullptr;
+        std::string name_;
+    };
+
+    /**
+     * @brief Reads the stats a StatsPublisher (in another process) is publishing.
+     *
+     */
+    class StatsReader {
+    public:
+        StatsReader() {};
+        ~StatsReader() { close(); }
+
+        StatsReader(const StatsReader&) = delete;
+        StatsReader& operator=(const StatsReader&) = delete;
+
+        /**
+         * @brief Map an existing segment.
+         *
+         * @param name The POSIX shared memory name, starting with '/'.
+         * @return true If there's a segment of the version we understand.
+         */
+        bool open(const std::string& name = STATS_SEGMENT);
+        void close();
+
+        /**
+         * @brief Take a consistent copy of the current stats.
+         *
+         * @param stats The stats to write to.
+         * @return true If we got a consistent copy (we give up after a few torn ones).
+         */
+        bool read(Stats& stats);
+
+    private:
+        const StatsSegment* segment_ = nullptr;
+    };
+}
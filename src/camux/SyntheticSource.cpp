@@ -0,0 +1,92 @@
+#include "SyntheticSource.h"
+
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+// Colours, BGR. The forehead dot is inside main.cpp's default HSV range for it.
+const cv::Scalar BACKGROUND(70, 70, 70);
+const cv::Scalar SKIN(150, 180, 215);
+const cv::Scalar SHADOW(80, 95, 120);
+const cv::Scalar SCLERA(235, 235, 235);
+const cv::Scalar IRIS(60, 80, 110);
+const cv::Scalar PUPIL(15, 15, 15);
+const cv::Scalar FOREHEAD_DOT(140, 74, 30);
+
+// The face's size as a fraction of the frame height. The Haar face search only looks for faces
+// of 250 pixels and up.
+const double FACE_HEIGHT = .8;
+
+// How far the pupil travels from the middle of the eye at gaze +-1, as a fraction of the eye size.
+const double PUPIL_TRAVEL_X = .25;
+const double PUPIL_TRAVEL_Y = .15;
+
+camux::SyntheticSource::SyntheticSource(cv::Size size, double fps) :
+    size_(size), interval_us_(fps > 0 ? (int64_t) (1e6 / fps) : 0) {
+    int height = cvRound(size.height * FACE_HEIGHT);
+    int width = height * 3 / 4;
+    face_ = cv::Rect((size.width - width) / 2, (size.height - height) / 2, width, height);
+
+    // Eyes a quarter of the face wide, at 40% of the face height. The right eye is on the left of
+    // the image, as it is in a webcam's (mirrored) view.
+    int eye = width / 4;
+    int eye_y = face_.y + height * 2 / 5 - eye / 2;
+    right_eye_ = cv::Rect(face_.x + width * 3 / 10 - eye / 2, eye_y, eye, eye);
+    left_eye_ = cv::Rect(face_.x + width * 7 / 10 - eye / 2, eye_y, eye, eye);
+
+    background_ = cv::Mat(size, CV_8UC3, BACKGROUND);
+    cv::Point center(face_.x + width / 2, face_.y + height / 2);
+    cv::ellipse(background_, center, cv::Size(width / 2, height / 2), 0, 0, 360, SKIN, -1, cv::LINE_AA);
+
+    // Brows, nose shadow, mouth.
+    for (const cv::Rect& r : { right_eye_, left_eye_ }) {
+        cv::rectangle(background_, cv::Rect(r.x, r.y - eye / 3, r.width, eye / 8), SHADOW, -1);
+    }
+    cv::ellipse(background_, cv::Point(center.x, face_.y + height * 3 / 5), cv::Size(width / 12, height / 14),
+                0, 0, 360, SHADOW, -1, cv::LINE_AA);
+    cv::ellipse(background_, cv::Point(center.x, face_.y + height * 4 / 5), cv::Size(width / 6, height / 24),
+                0, 0, 360, SHADOW, -1, cv::LINE_AA);
+    cv::circle(background_, cv::Point(center.x, face_.y + height / 6), std::max(width / 30, 3), FOREHEAD_DOT, -1);
+}
+
+void camux::SyntheticSource::_drawEye(cv::Mat& image, const cv::Rect& eye, cv::Point2f& pupil) {
+    cv::Point center(eye.x + eye.width / 2, eye.y + eye.height / 2);
+    float gx = std::min(std::max(gaze_.x, -1.f), 1.f);
+    float gy = std::min(std::max(gaze_.y, -1.f), 1.f);
+    pupil = cv::Point2f(center.x + gx * eye.width * PUPIL_TRAVEL_X, center.y + gy * eye.height * PUPIL_TRAVEL_Y);
+
+    // A closed eye is skin with a lash line along the bottom of the lid, curving down a little.
+    if (eyes_closed_) {
+        cv::ellipse(image, center, cv::Size(eye.width / 2, eye.height / 8), 0, 0, 180, SHADOW,
+                    std::max(eye.height / 24, 1), cv::LINE_AA);
+        return;
+    }
+
+    cv::ellipse(image, center, cv::Size(eye.width / 2, eye.height / 4), 0, 0, 360, SCLERA, -1, cv::LINE_AA);
+
+    // Draw with sub-pixel precision so small gaze changes still move the pupil.
+    const int SHIFT = 4;
+    cv::Point p(cvRound(pupil.x * (1 << SHIFT)), cvRound(pupil.y * (1 << SHIFT)));
+    cv::circle(image, p, (eye.height / 6) << SHIFT, IRIS, -1, cv::LINE_AA, SHIFT);
+    cv::circle(image, p, (eye.height / 12) << SHIFT, PUPIL, -1, cv::LINE_AA, SHIFT);
+}
+
+bool camux::SyntheticSource::read(camux::Frame& frame) {
+    // Pace like a camera: a frame every interval, whether or not the reader kept up.
+    if (interval_us_ > 0) {
+        int64_t now = steadyMicros();
+        if (next_us_ == 0 || next_us_ < now - interval_us_) next_us_ = now;
+        if (next_us_ > now) std::this_thread::sleep_for(std::chrono::microseconds(next_us_ - now));
+        next_us_ += interval_us_;
+    }
+
+    background_.copyTo(frame.image);
+    _drawEye(frame.image, right_eye_, right_pupil_);
+    _drawEye(frame.image, left_eye_, left_pupil_);
+
+    frame.index = index_++;
+    frame.capture_us = frame.timestamp_us = steadyMicros();
+    return true;
+}
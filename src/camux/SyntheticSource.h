@@ -0,0 +1,71 @@
+#pragma once
+
+#include "FrameSource.h"
+
+namespace camux {
+
+    /**
+     * @brief Generates frames of a drawn face whose pupils look where you tell them to, for
+     *  measuring the pipeline on machines with no camera (and no person).
+     *
+     *  The face is drawn to be found by the detectors: a light face on a darker background with
+     *  dark brows, eye sockets, nose and mouth shadows, and the blue forehead dot main.cpp looks
+     *  for. Each eye is a white sclera with an iris and a pupil that move together with the gaze.
+     *
+     *  Frames can be paced at a frame rate like a camera, or produced as fast as they're read.
+     *  The capture timestamp is taken when a frame is finished drawing - the synthetic equivalent
+     *  of the end of exposure.
+     */
+    class SyntheticSource : public FrameSource {
+    public:
+        /**
+         * @param size The frame size.
+         * @param fps The frame rate to pace frames at, or 0 to produce them as fast as they're read.
+         */
+        SyntheticSource(cv::Size size = cv::Size(640, 480), double fps = 30);
+
+        bool read(Frame& frame) override;
+
+        /**
+         * @brief Where the eyes look in the following frames.
+         *
+         * @param gaze The pupils' displacement from the middle of the eye, each coordinate in
+         *  [-1, 1] of how far the pupil can travel.
+         */
+        void setGaze(const cv::Point2f& gaze) { gaze_ = gaze; }
+        cv::Point2f getGaze() { return gaze_; }
+
+        /**
+         * @brief Whether the eyes are shut in the following frames: drawn as lids with a lash line
+         *  instead of the sclera, iris and pupil. Open them again after a few frames for a blink.
+         */
+        void setEyesClosed(bool closed) { eyes_closed_ = closed; }
+        bool getEyesClosed() { return eyes_closed_; }
+
+        // Where the pupils were drawn in the last frame, in frame pixels (behind the lids, when the
+        // eyes are closed).
+        cv::Point2f getLeftPupil() { return left_pupil_; }
+        cv::Point2f getRightPupil() { return right_pupil_; }
+
+        // The face and eye rectangles of the drawn face.
+        cv::Rect getFace() { return face_; }
+        cv::Rect getLeftEye() { return left_eye_; }
+        cv::Rect getRightEye() { return right_eye_; }
+
+    private:
+        void _drawEye(cv::Mat& image, const cv::Rect& eye, cv::Point2f& pupil);
+
+        cv::Size size_;
+        int64_t interval_us_;
+        int64_t next_us_ = 0;
+        uint64_t index_ = 0;
+
+        cv::Point2f gaze_;
+        bool eyes_closed_ = false;
+        cv::Rect face_, left_eye_, right_eye_;
+        cv::Point2f left_pupil_, right_pupil_;
+
+        // The face without the eyes, drawn once.
+        cv::Mat background_;
+    };
+}
@@ -0,0 +1,138 @@
+#include "Telemetry.h"
+
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char TELEMETRY_MAGIC[8] = { 'E', 'Y', 'E', 'T', 'L', 'M', 'T', 0 };
+
+// Records start on their own cache line after the header.
+static const size_t RECORDS_OFFSET = 64;
+static_assert(sizeof(camux::TelemetryHeader) <= RECORDS_OFFSET, "Telemetry header too large");
+
+#ifndef MAP_POPULATE
+#define MAP_POPULATE 0
+#endif
+
+bool camux::TelemetryWriter::open(const std::string& path, uint64_t capacity) {
+    close();
+    if (capacity == 0) return false;
+
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd_ < 0) return false;
+
+    size_ = RECORDS_OFFSET + capacity * sizeof(TelemetryRecord);
+    if (ftruncate(fd_, size_) != 0) {
+        close();
+        return false;
+    }
+
+    // Fault every page in now rather than on the first write to it.
+    void* map = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd_, 0);
+    if (map == MAP_FAILED) {
+        close();
+        return false;
+    }
+
+    header_ = static_cast<TelemetryHeader*>(map);
+    records_ = reinterpret_cast<TelemetryRecord*>(static_cast<char*>(map) + RECORDS_OFFSET);
+
+    std::memcpy(header_->magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC));
+    header_->version = TELEMETRY_VERSION;
+    header_->record_size = sizeof(TelemetryRecord);
+    header_->capacity = capacity;
+    header_->written.store(0, std::memory_order_release);
+
+    return true;
+}
+
+void camux::TelemetryWriter::close() {
+    if (header_) munmap(header_, size_);
+    if (fd_ >= 0) ::close(fd_);
+
+    header_ = nullptr;
+    records_ = nullptr;
+    size_ = 0;
+    fd_ = -1;
+}
+
+void camux::TelemetryWriter::write(const TelemetryRecord& record) {
+    if (!header_) return;
+
+    // Only this thread writes, so a relaxed load of our own counter is enough. The release store
+    // makes the record visible to readers before the count that covers it.
+    uint64_t written = header_->written.load(std::memory_order_relaxed);
+    std::memcpy(&records_[written % header_->capacity], &record, sizeof(record));
+    header_->written.store(written + 1, std::memory_order_release);
+}
+
+bool camux::TelemetryReader::open(const std::string& path) {
+    close();
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t) st.st_size < RECORDS_OFFSET) {
+        ::close(fd);
+        return false;
+    }
+
+    size_ = st.st_size;
+    void* map = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the file is closed.
+    ::close(fd);
+    if (map == MAP_FAILED) {
+        size_ = 0;
+        return false;
+    }
+
+    header_ = static_cast<const TelemetryHeader*>(map);
+    records_ = reinterpret_cast<const TelemetryRecord*>(static_cast<const char*>(map) + RECORDS_OFFSET);
+
+    if (std::memcmp(header_->magic, TELEMETRY_MAGIC, sizeof(TELEMETRY_MAGIC)) != 0 ||
+        header_->version != TELEMETRY_VERSION || header_->record_size != sizeof(TelemetryRecord) ||
+        header_->capacity == 0 || RECORDS_OFFSET + header_->capacity * sizeof(TelemetryRecord) > size_) {
+        close();
+        return false;
+    }
+
+    snapshot();
+    return true;
+}
+
+void camux::TelemetryReader::close() {
+    if (header_) munmap(const_cast<TelemetryHeader*>(header_), size_);
+
+    header_ = nullptr;
+    records_ = nullptr;
+    size_ = 0;
+    first_ = end_ = 0;
+}
+
+uint64_t camux::TelemetryReader::snapshot() {
+    if (!header_) return 0;
+
+    // The oldest slot is the next one the writer overwrites, so it may be mid-copy at any moment.
+    uint64_t capacity = header_->capacity;
+    end_ = header_->written.load(std::memory_order_acquire);
+    first_ = end_ >= capacity ? end_ - capacity + 1 : 0;
+    return size();
+}
+
+bool camux::TelemetryReader::read(uint64_t i, TelemetryRecord& record) {
+    if (!header_ || i >= size()) return false;
+
+    uint64_t capacity = header_->capacity;
+    uint64_t seq = first_ + i;
+
+    std::memcpy(&record, &records_[seq % capacity], sizeof(record));
+
+    // The writer overwrites this slot while writing record seq + capacity, i.e once the count
+    // reaches seq + capacity. If it hasn't got there, our copy is intact.
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return header_->written.load(std::memory_order_relaxed) < seq + capacity;
+}
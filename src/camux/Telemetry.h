@@ -0,0 +1,178 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+namespace camux {
+
+    // Bits of TelemetryRecord::flags
+    enum TelemetryFlags {
+        FaceFound        = 1 << 0,
+        RanDetector      = 1 << 1,
+        LeftEyeClosed    = 1 << 2,
+        RightEyeClosed   = 1 << 3,
+        Calibrating      = 1 << 4,
+        Calibrated       = 1 << 5,
+        GazeMapped       = 1 << 6
+    };
+
+    /**
+     * @brief Everything we know about one processed frame. Fixed size and plain old data so it can be
+     *  copied straight into the log. Rectangles are (x, y, width, height) and points (x, y), all in
+     *  frame pixels. Timings are in microseconds.
+     *
+     *  If you change this, bump TELEMETRY_VERSION.
+     */
+    struct TelemetryRecord {
+        uint64_t frame;
+        // Steady clock time the frame was read, microseconds.
+        int64_t timestamp_us;
+
+        int32_t face[4];
+        int32_t left_eye[4];
+        int32_t right_eye[4];
+        float face_confidence;
+        float left_eye_confidence;
+        float right_eye_confidence;
+
+        int32_t left_pupil[2];
+        int32_t right_pupil[2];
+        int32_t forehead[2];
+
+        // Calibration frame index, -1 when not calibrating.
+        int32_t calibration_frame;
+        uint32_t flags;
+
+        // Per-stage timings.
+        float detect_us;
+        float forehead_us;
+        float pupil_us;
+        float frame_us;
+
+        // End to end: from the frame's capture to the pipeline finishing with it, and to the
+        // cursor being moved (0 if it wasn't).
+        float latency_us;
+        float cursor_us;
+
+        // Where on the screen the user was looking (screen pixels), if GazeMapped.
+        int32_t gaze[2];
+    };
+
+    const uint32_t TELEMETRY_VERSION = 2;
+
+    /**
+     * @brief Header at the start of a telemetry file. Followed by capacity records.
+     */
+    struct TelemetryHeader {
+        char magic[8];
+        uint32_t version;
+        uint32_t record_size;
+        uint64_t capacity;
+        // Total number of records ever written. The newest record is at (written - 1) % capacity.
+        std::atomic<uint64_t> written;
+    };
+
+    /**
+     * @brief Writes TelemetryRecords into a memory-mapped ring file. The file is created and mapped
+     *  (and its pages faulted in) up front, so write() is just a copy into the mapping - no system
+     *  calls or allocation per frame. The kernel flushes the pages to disk in the background, and
+     *  they survive the process crashing. Once the ring is full the oldest records are overwritten.
+     *
+     */
+    class TelemetryWriter {
+    public:
+        TelemetryWriter() {};
+        ~TelemetryWriter() { close(); }
+
+        TelemetryWriter(const TelemetryWriter&) = delete;
+        TelemetryWriter& operator=(const TelemetryWriter&) = delete;
+
+        /**
+         * @brief Create (or truncate) the log file and map it.
+         *
+         * @param path Where to write the log.
+         * @param capacity How many records the ring holds.
+         * @return true If the file is ready to write to.
+         */
+        bool open(const std::string& path, uint64_t capacity);
+
+        /**
+         * @brief Unmap and close the log. Called by the destructor.
+         */
+        void close();
+
+        bool isOpen() { return header_ != nullptr; }
+
+        /**
+         * @brief Append a record, overwriting the oldest one if the ring is full. Does nothing if
+         *  the log isn't open.
+         *
+         * @param record The record to copy into the log.
+         */
+        void write(const TelemetryRecord& record);
+
+    private:
+        TelemetryHeader* header_ = nullptr;
+        TelemetryRecord* records_ = nullptr;
+        size_t size_ = 0;
+        int fd_ = -1;
+    };
+
+    /**
+     * @brief Reads a telemetry log written by TelemetryWriter (possibly while it's still being
+     *  written). Reads are indexed from a snapshot of the ring, so a writer that keeps going
+     *  doesn't shift records under a loop over them; it can only overwrite them, which read()
+     *  reports.
+     *
+     */
+    class TelemetryReader {
+    public:
+        TelemetryReader() {};
+        ~TelemetryReader() { close(); }
+
+        TelemetryReader(const TelemetryReader&) = delete;
+        TelemetryReader& operator=(const TelemetryReader&) = delete;
+
+        /**
+         * @brief Map a log for reading.
+         *
+         * @param path The log file.
+         * @return true If the file is a telemetry log of the version we understand.
+         */
+        bool open(const std::string& path);
+        void close();
+
+        /**
+         * @brief Take a new snapshot: the records in the ring now become the ones size() counts
+         *  and read() indexes. open() takes the first one.
+         *
+         * @return The new size().
+         */
+        uint64_t snapshot();
+
+        /**
+         * @brief The number of records in the ring at the last snapshot(). At most capacity - 1:
+         *  the oldest slot is the next one to be overwritten, so we don't count it.
+         */
+        uint64_t size() { return end_ - first_; }
+
+        /**
+         * @brief Copy out the ith oldest record of the last snapshot(), 0 <= i < size().
+         *
+         * @param i The index, oldest first.
+         * @param record The record to write to.
+         * @return true If the record wasn't overwritten by the writer, since the snapshot or while
+         *  we copied it.
+         */
+        bool read(uint64_t i, TelemetryRecord& record);
+
+    private:
+        const TelemetryHeader* header_ = nullptr;
+        const TelemetryRecord* records_ = nullptr;
+        size_t size_ = 0;
+        // The sequence numbers of the snapshot's records, [first_, end_).
+        uint64_t first_ = 0;
+        uint64_t end_ = 0;
+    };
+}
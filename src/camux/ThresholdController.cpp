@@ -0,0 +1,99 @@
+#include "ThresholdController.h"
+
+#include <algorithm>
+#include <cmath>
+
+// Starting thresholds, the values the localizer used before they were adapted. The gradient
+// threshold is a multiple of the mean gradient magnitude, the dark one a multiple of the mean
+// intensity.
+const double DEFAULT_GRADIENT_THRESHOLD = 2.5;
+const double DEFAULT_DARK_THRESHOLD = .8;
+
+// Bounds on the thresholds, so a weird frame (e.g a blink the blink detector missed) can't push
+// them somewhere they'll never recover from.
+const double MIN_GRADIENT_THRESHOLD = 1.0;
+const double MAX_GRADIENT_THRESHOLD = 6.0;
+const double MIN_DARK_THRESHOLD = .3;
+const double MAX_DARK_THRESHOLD = 1.0;
+
+// Target number of strong gradients. Below the minimum the objective gets noisy, above the
+// maximum we're paying for evidence we don't need.
+const int MIN_STRONG_GRADIENTS = 40;
+const int MAX_STRONG_GRADIENTS = 160;
+
+// Target fraction of the crop that are candidate centers.
+const double MIN_CANDIDATE_FRACTION = .05;
+const double MAX_CANDIDATE_FRACTION = .25;
+
+// Relative step per frame when a count is out of range. Small, so the controller settles rather
+// than oscillating frame to frame.
+const double THRESHOLD_STEP = .03;
+
+// Center jitter (pixels, smoothed) above which we want more gradients, and below which we're
+// happy to trade some away for speed.
+const double UNSTABLE_JITTER = 2.0;
+const double STABLE_JITTER = .5;
+const double JITTER_RATE = .1;
+
+camux::ThresholdController::ThresholdController() :
+    gradient_threshold_(DEFAULT_GRADIENT_THRESHOLD), dark_threshold_(DEFAULT_DARK_THRESHOLD) {};
+
+void camux::ThresholdController::update(int strong_gradients, int candidates, int pixels, const cv::Point& center) {
+    if (pixels <= 0) return;
+
+    if (has_center_) {
+        double moved = cv::norm(center - last_center_);
+        jitter_ += (moved - jitter_) * JITTER_RATE;
+    }
+    last_center_ = center;
+    has_center_ = true;
+
+    // Raising the gradient threshold passes fewer gradients. The budget always wins over
+    // stability: an unstable center only lowers the threshold while we're under the maximum.
+    if (strong_gradients > MAX_STRONG_GRADIENTS) {
+        gradient_threshold_ *= 1 + THRESHOLD_STEP;
+    } else if (strong_gradients < MIN_STRONG_GRADIENTS || jitter_ > UNSTABLE_JITTER) {
+        gradient_threshold_ *= 1 - THRESHOLD_STEP;
+    } else if (jitter_ < STABLE_JITTER) {
+        gradient_threshold_ *= 1 + THRESHOLD_STEP / 4;
+    }
+
+    // Raising the dark threshold passes more (brighter) pixels as candidates.
+    double fraction = (double) candidates / pixels;
+    if (fraction > MAX_CANDIDATE_FRACTION) {
+        dark_threshold_ *= 1 - THRESHOLD_STEP;
+    } else if (fraction < MIN_CANDIDATE_FRACTION) {
+        dark_threshold_ *= 1 + THRESHOLD_STEP;
+    }
+
+    gradient_threshold_ = std::min(std::max(gradient_threshold_, MIN_GRADIENT_THRESHOLD), MAX_GRADIENT_THRESHOLD);
+    dark_threshold_ = std::min(std::max(dark_threshold_, MIN_DARK_THRESHOLD), MAX_DARK_THRESHOLD);
+}
+
+void camux::ThresholdController::write(cv::FileStorage& fs) const {
+    fs << "{"
+       << "gradient_threshold" << gradient_threshold_
+       << "dark_threshold" << dark_threshold_
+       << "}";
+}
+
+void camux::ThresholdController::read(const cv::FileNode& node) {
+    if (node.empty()) return;
+
+    double gradient = node["gradient_threshold"].empty() ? DEFAULT_GRADIENT_THRESHOLD : (double) node["gradient_threshold"];
+    double dark = node["dark_threshold"].empty() ? DEFAULT_DARK_THRESHOLD : (double) node["dark_threshold"];
+
+    gradient_threshold_ = std::min(std::max(gradient, MIN_GRADIENT_THRESHOLD), MAX_GRADIENT_THRESHOLD);
+    dark_threshold_ = std::min(std::max(dark, MIN_DARK_THRESHOLD), MAX_DARK_THRESHOLD);
+    resetStability();
+}
+
+void camux::write(cv::FileStorage& fs, const std::string&, const camux::ThresholdController& controller) {
+    controller.write(fs);
+}
+
+void camux::read(const cv::FileNode& node, camux::ThresholdController& controller,
+                 const camux::ThresholdController& default_value) {
+    controller = default_value;
+    controller.read(node);
+}
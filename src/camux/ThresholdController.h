@@ -0,0 +1,66 @@
+#pragma once
+
+#include "geometry.hpp"
+
+#include <opencv2/core/persistence.hpp>
+
+namespace camux {
+
+    /**
+     * @brief Adapts the two thresholds of the gradient pupil localizer for one eye, online.
+     *
+     *  The localizer's cost is (number of strong gradients) x (number of dark candidate pixels).
+     *  The strong gradient threshold (a multiple of the mean gradient magnitude) is nudged up
+     *  when too many gradients pass it and down when too few do, to keep the gradient count in
+     *  a target range. The dark pixel threshold (a multiple of the mean intensity) is controlled
+     *  the same way on the fraction of the crop that are candidate centers.
+     *
+     *  It also watches how stable the localized center is. If the center jitters while we still
+     *  have gradient budget to spare, the gradient threshold is lowered to feed the objective more
+     *  evidence; if it's rock steady the threshold is allowed to creep up to save time.
+     *
+     *  State is saved with the calibration profile (write()/read()) so a new session starts from
+     *  the thresholds the last one settled on.
+     */
+    class ThresholdController {
+    public:
+        ThresholdController();
+
+        double getGradientThreshold() { return gradient_threshold_; }
+        double getDarkThreshold() { return dark_threshold_; }
+
+        /**
+         * @brief Feed back what the localizer saw on a frame.
+         *
+         * @param strong_gradients The number of gradients that passed the gradient threshold.
+         * @param candidates The number of candidate center pixels.
+         * @param pixels The number of pixels in the eye crop.
+         * @param center The center the localizer found, in crop coordinates.
+         */
+        void update(int strong_gradients, int candidates, int pixels, const cv::Point& center);
+
+        /**
+         * @brief Forget the stability history (e.g the eye box jumped), keeping the thresholds.
+         */
+        void resetStability() { has_center_ = false; jitter_ = 0; }
+
+        double getJitter() { return jitter_; }
+
+        void write(cv::FileStorage& fs) const;
+        void read(const cv::FileNode& node);
+
+    private:
+        double gradient_threshold_;
+        double dark_threshold_;
+
+        // Exponential moving average of how far (pixels) the center moves between frames.
+        double jitter_ = 0;
+        cv::Point last_center_;
+        bool has_center_ = false;
+    };
+
+    // FileStorage hooks so a controller can be written as fs << "name" << controller.
+    void write(cv::FileStorage& fs, const std::string& name, const ThresholdController& controller);
+    void read(const cv::FileNode& node, ThresholdController& controller,
+              const ThresholdController& default_value = ThresholdController());
+}
@@ -0,0 +1,66 @@
+#include "WorkStealingPool.h"
+
+#include <algorithm>
+#include <exception>
+#include <thread>
+
+camux::WorkStealingPool::WorkStealingPool(int threads) : steals_(0) {
+    if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    threads_ = threads;
+
+    for (int i = 0; i < threads_; ++i) queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+}
+
+void camux::WorkStealingPool::run(size_t count, const std::function<void(size_t, int)>& task) {
+    // Deal the tasks out in contiguous runs, as even as they'll go.
+    for (int i = 0; i < threads_; ++i) {
+        size_t first = count * i / threads_;
+        size_t last = count * (i + 1) / threads_;
+        for (size_t t = first; t < last; ++t) queues_[i]->tasks.push_back(t);
+    }
+    error_ = nullptr;
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < threads_; ++i) threads.push_back(std::thread(&WorkStealingPool::_work, this, i, std::cref(task)));
+    _work(0, task);
+    for (size_t i = 0; i < threads.size(); ++i) threads[i].join();
+
+    if (error_) std::rethrow_exception(error_);
+}
+
+void camux::WorkStealingPool::_work(int thread, const std::function<void(size_t, int)>& task) {
+    size_t next;
+    while (_next(thread, next)) {
+        try {
+            task(next, thread);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex_);
+            if (!error_) error_ = std::current_exception();
+        }
+    }
+}
+
+bool camux::WorkStealingPool::_next(int thread, size_t& task) {
+    {
+        Queue& own = *queues_[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+
+    // No tasks are added once a run has started, so once every queue is empty we're done.
+    for (int i = 1; i < threads_; ++i) {
+        Queue& victim = *queues_[(thread + i) % threads_];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            steals_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
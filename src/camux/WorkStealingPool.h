@@ -0,0 +1,60 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace camux {
+
+    /**
+     * @brief Runs a batch of independent tasks of uneven length on a fixed number of threads,
+     *  keeping them all busy until the batch is done.
+     *
+     *  Each thread starts with its own contiguous run of the tasks, which it works through from the
+     *  front (so neighbouring tasks, e.g chunks of the same file, run one after another on the same
+     *  thread). A thread that runs out steals from the back of another's run, the work furthest
+     *  from what that thread is on. Tasks are coarse (seconds each), so the queues are just
+     *  mutex-guarded deques.
+     */
+    class WorkStealingPool {
+    public:
+        /**
+         * @param threads How many threads to run tasks on, 0 for one per core.
+         */
+        explicit WorkStealingPool(int threads = 0);
+
+        /**
+         * @brief Run task(i, thread) for every i in [0, count), and return once they've all
+         *  finished. thread is the index (0 <= thread < getThreads()) of the thread running it, for
+         *  per-thread state. If tasks throw, the rest still run and the first exception is
+         *  rethrown here.
+         */
+        void run(size_t count, const std::function<void(size_t task, int thread)>& task);
+
+        int getThreads() { return threads_; }
+
+        // Tasks stolen from another thread's run, over all run() calls.
+        uint64_t getSteals() { return steals_; }
+
+    private:
+        struct Queue {
+            std::mutex mutex;
+            std::deque<size_t> tasks;
+        };
+
+        void _work(int thread, const std::function<void(size_t, int)>& task);
+        bool _next(int thread, size_t& task);
+
+        int threads_;
+        std::vector<std::unique_ptr<Queue>> queues_;
+        std::atomic<uint64_t> steals_;
+
+        std::mutex error_mutex_;
+        std::exception_ptr error_;
+    };
+}
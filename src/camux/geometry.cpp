@@ -41,14 +41,15 @@ cv::Rect camux::boundingRectMargin(const camux::Points& points, const float p_er
     cv::Rect r = camux::boundingRect(points);
 
     // Increase the width and height of the bounding box by p_err percent.
-    unsigned width = r.width * (1+p_err_width);
-    unsigned height = r.height * (1+p_err_height);
+    int width = r.width * (1+p_err_width);
+    int height = r.height * (1+p_err_height);
     
     // Adjust the x and y coordinates so the center of the bounding box stays in the same place.
     // E.g 100x100 px adjusted by 10% gives 110x110. So we decrease the starting x & y by 5.
-    // Can't have negative coordinates, so max with 0.
-    unsigned x = std::max(r.x - (width - r.width) / 2, (unsigned) 0);
-    unsigned y = std::max(r.y - (height - r.height) / 2, (unsigned) 0); 
+    // Can't have negative coordinates, so max with 0. Signed: in unsigned arithmetic a box near
+    // the edge wraps around to a huge x/y instead of clamping.
+    int x = std::max(r.x - (width - r.width) / 2, 0);
+    int y = std::max(r.y - (height - r.height) / 2, 0);
 
     return cv::Rect(x, y, width, height);
 }
@@ -0,0 +1,147 @@
+#include "camux_c.h"
+
+#include "Tracker.h"
+
+#include <exception>
+#include <string>
+
+// A tracker and the sources it can be started on, which have to outlive the tracking.
+struct camux_tracker {
+    explicit camux_tracker(Detector method) : tracker(method) {}
+
+    // Declared before the tracker, so it's stopped before they're destroyed.
+    camux::CameraSource camera;
+    camux::ArchiveSource archive;
+    Tracker tracker;
+
+    // The last camux_tracker_last_error() result, which the returned pointer points into.
+    std::string error;
+};
+
+static void to_c(const camux::GazeSample &in, camux_gaze_sample *out) {
+    out->frame = in.frame;
+    out->capture_us = in.capture_us;
+    out->done_us = in.done_us;
+
+    out->face_found = in.face_found;
+    out->face[0] = in.face.x;
+    out->face[1] = in.face.y;
+    out->face[2] = in.face.width;
+    out->face[3] = in.face.height;
+
+    out->left_pupil[0] = in.left_pupil.x;
+    out->left_pupil[1] = in.left_pupil.y;
+    out->right_pupil[0] = in.right_pupil.x;
+    out->right_pupil[1] = in.right_pupil.y;
+    out->left_closed = in.left_closed;
+    out->right_closed = in.right_closed;
+    out->left_blinked = in.left_blinked;
+    out->right_blinked = in.right_blinked;
+
+    out->has_offset = in.has_offset;
+    out->offset[0] = in.gaze_offset.x;
+    out->offset[1] = in.gaze_offset.y;
+
+    out->gaze_valid = in.gaze_valid;
+    out->gaze[0] = in.gaze.x;
+    out->gaze[1] = in.gaze.y;
+}
+
+camux_tracker *camux_tracker_create(enum camux_detector detector) {
+    Detector method;
+    switch (detector) {
+    case CAMUX_DETECTOR_DNN: method = OpenCV_DNN; break;
+    case CAMUX_DETECTOR_DLIB_68: method = Dlib_68; break;
+    case CAMUX_DETECTOR_HAAR: method = HaarCascade; break;
+    default: return nullptr;
+    }
+
+    // Nothing may be thrown across the C boundary; model files that won't load throw.
+    try {
+        return new camux_tracker(method);
+    } catch (...) {
+        return nullptr;
+    }
+}
+
+void camux_tracker_destroy(camux_tracker *tracker) {
+    try {
+        delete tracker;
+    } catch (...) {
+    }
+}
+
+int camux_tracker_load_profile(camux_tracker *tracker, const char *path) {
+    try {
+        return tracker->tracker.loadProfile(path);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void camux_tracker_set_callback(camux_tracker *tracker, camux_gaze_callback callback, void *user) {
+    try {
+        if (!callback) {
+            tracker->tracker.setCallback(Tracker::Callback());
+            return;
+        }
+
+        tracker->tracker.setCallback([callback, user](const camux::GazeSample &sample) {
+            camux_gaze_sample out;
+            to_c(sample, &out);
+            callback(&out, user);
+        });
+    } catch (...) {
+    }
+}
+
+int camux_tracker_start_camera(camux_tracker *tracker, int camera) {
+    // VideoCapture may throw opening the camera, and starting the thread may throw too.
+    try {
+        if (tracker->tracker.isRunning() || !tracker->camera.open(camera)) return 0;
+        return tracker->tracker.start(tracker->camera);
+    } catch (...) {
+        return 0;
+    }
+}
+
+int camux_tracker_start_archive(camux_tracker *tracker, const char *path) {
+    try {
+        if (tracker->tracker.isRunning() || !tracker->archive.open(path)) return 0;
+        return tracker->tracker.start(tracker->archive);
+    } catch (...) {
+        return 0;
+    }
+}
+
+void camux_tracker_stop(camux_tracker *tracker) {
+    try {
+        tracker->tracker.stop();
+    } catch (...) {
+    }
+}
+
+int camux_tracker_is_running(camux_tracker *tracker) {
+    return tracker->tracker.isRunning();
+}
+
+const char *camux_tracker_last_error(camux_tracker *tracker) {
+    try {
+        tracker->error = tracker->tracker.lastError();
+    } catch (...) {
+        return "";
+    }
+    return tracker->error.c_str();
+}
+
+int camux_tracker_poll(camux_tracker *tracker, camux_gaze_sample *sample, uint64_t *seen) {
+    try {
+        camux::GazeSample latest;
+        if (!tracker->tracker.poll(latest, *seen)) return 0;
+
+        to_c(latest, sample);
+        return 1;
+    } catch (...) {
+        return 0;
+    }
+}
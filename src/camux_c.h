@@ -0,0 +1,91 @@
+/*
+ * C interface to the eye tracker (see Tracker.h), for embedding it in programs that aren't C++.
+ *
+ * Every function is safe to call with a tracker created by camux_tracker_create(). Functions that
+ * return int return nonzero for success/true, and 0 if anything failed: no C++ exception ever
+ * crosses into the caller.
+ */
+
+#ifndef CAMUX_C_H
+#define CAMUX_C_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Face detection methods, as the Detector enum. */
+enum camux_detector {
+    CAMUX_DETECTOR_DNN = 0,
+    CAMUX_DETECTOR_DLIB_68 = 1,
+    CAMUX_DETECTOR_HAAR = 2
+};
+
+/*
+ * What the tracker found in one frame (a subset of camux::GazeSample). Positions are in frame
+ * pixels, except gaze which is in screen pixels. Timestamps are steady clock microseconds.
+ */
+typedef struct camux_gaze_sample {
+    uint64_t frame;
+    int64_t capture_us;
+    int64_t done_us;
+
+    int face_found;
+    int32_t face[4]; /* x, y, width, height */
+
+    int32_t left_pupil[2];
+    int32_t right_pupil[2];
+    int left_closed;
+    int right_closed;
+    int left_blinked;
+    int right_blinked;
+
+    /* Mean pupil relative to the forehead dot, if both eyes were open and the dot was found. */
+    int has_offset;
+    float offset[2];
+
+    /* Where on the screen the user is looking, if the tracker is calibrated. */
+    int gaze_valid;
+    float gaze[2];
+} camux_gaze_sample;
+
+typedef struct camux_tracker camux_tracker;
+
+/* Called on the tracking thread with every sample. Must not call camux_tracker_stop() or
+ * camux_tracker_set_callback(). */
+typedef void (*camux_gaze_callback)(const camux_gaze_sample *sample, void *user);
+
+/* Create a tracker, loading the detector's model files from the working directory. NULL if they
+ * couldn't be loaded. */
+camux_tracker *camux_tracker_create(enum camux_detector detector);
+/* Stop and free a tracker. */
+void camux_tracker_destroy(camux_tracker *tracker);
+
+/* Restore a calibration profile saved by eye_mouse. Only while stopped. */
+int camux_tracker_load_profile(camux_tracker *tracker, const char *path);
+
+/* Set the callback (NULL to clear it). user is passed through to it. */
+void camux_tracker_set_callback(camux_tracker *tracker, camux_gaze_callback callback, void *user);
+
+/* Start tracking a camera, or a frame archive recorded with eye_mouse --record. */
+int camux_tracker_start_camera(camux_tracker *tracker, int camera);
+int camux_tracker_start_archive(camux_tracker *tracker, const char *path);
+void camux_tracker_stop(camux_tracker *tracker);
+/* Whether it's tracking; becomes 0 by itself when an archive runs out, or on an error. */
+int camux_tracker_is_running(camux_tracker *tracker);
+/* Why tracking stopped by itself (e.g an OpenCV error, or the camera delivering nothing), or ""
+ * if it didn't. Valid until the next call for this tracker. */
+const char *camux_tracker_last_error(camux_tracker *tracker);
+
+/*
+ * Copy the latest sample into sample, if it's newer than *seen (start it at 0), and update *seen.
+ * Safe to call from any number of threads, each with its own seen count; never holds up tracking.
+ */
+int camux_tracker_poll(camux_tracker *tracker, camux_gaze_sample *sample, uint64_t *seen);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -18,17 +18,30 @@
 // Copyright(c) Ryan Prendergast 2020. All Rights Reserved.
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#include "FaceEyeDetector.h"
-#include "camux/Face.h"
+#include "Pipeline.h"
+#include "camux/CalibrationProfile.h"
+#include "camux/Cursor.h"
+#include "camux/FlightRecorder.h"
+#include "camux/FrameArchive.h"
+#include "camux/FrameSource.h"
+#include "camux/GazeMapper.h"
+#include "camux/LatencyHistogram.h"
+#include "camux/PresenceScheduler.h"
+#include "camux/Stats.h"
+#include "camux/Telemetry.h"
 
 #include <iostream>
 #include <chrono>
+#include <cstdio>
 
 #include <queue>
+#include <string>
 
 #include <opencv2/highgui.hpp>
 #include <opencv2/imgproc.hpp>
 
+#include <unistd.h>
+
 
 // Confidence threshold (>0, <1.0) for deciding if a feature is a face
 const int MICROSECONDS_PER_SECOND = 1000000;
@@ -40,10 +53,16 @@ const int FPS = 30;
 // of outliers)
 const static int CALIBRATION_LENGTH = 75;
 
+// How many frames of telemetry to keep in the ring file (an hour at 30 fps, ~14 MB).
+const static uint64_t TELEMETRY_CAPACITY = FPS * 60 * 60;
+
+// How many frames the flight recorder keeps (three seconds at 30 fps), and how much of a frame
+// each of its slots holds when it only keeps the face and eyes. Bigger faces are subsampled.
+const static int FLIGHT_SLOTS = FPS * 3;
+const static int FLIGHT_ROI_FRACTION = 4;
+
 // Frame Index - Iterates each frame from 0 to $FPS-1. For timing granularity.
 int f_idx = 0;
-int img_height = 720;
-int img_width = 1080;
 double total_latency = 0;
 
 // These are the tunable parameters for the blue dot localization. HIGHLY DEPENDENT ON
@@ -58,6 +77,31 @@ static cv::Point right_eye_calibration[CALIBRATION_LENGTH], left_eye_calibration
 static cv::Point calibrated_forehead, calibrated_right_eye, calibrated_left_eye;
 
 std::string webcam_window = "Webcam Display";
+// Where to write the per-frame telemetry log. Set with --telemetry <file>, or "" to disable.
+std::string telemetry_file = "eye_mouse.telemetry";
+// Raw frame archives to record the webcam into (--record <file>) or to read frames from instead of
+// the webcam (--replay <file>).
+std::string record_file;
+std::string replay_file;
+// The calibration profile to load at startup and save after calibrating (--profile <file>).
+std::string profile_file = "eye_mouse_calibration.yml";
+// The screen gaze is mapped onto (--screen <width>x<height>), and the window that shows the
+// calibration targets on it.
+cv::Size screen_size(1920, 1080);
+std::string gaze_window = "Gaze Calibration";
+// Whether to move the cursor to where the user is looking (--cursor).
+bool move_cursor = false;
+// Whether, with nobody in front of the camera, to only scan for a face when something moves
+// (turned off with --no-motion-gate).
+bool motion_gate = true;
+// A near-eye camera instead of a webcam on the face (--near-eye single|stereo): one eye filling
+// the frame, or two side by side. Skips the face detection and forehead dot entirely.
+InputMode input_mode = FaceInput;
+// Where the flight recorder dumps the last few seconds when tracking fails (--flight-recorder
+// <dir>), or "" to not keep them, and whether it keeps whole frames (--flight-frames) rather than
+// just the face and eyes.
+std::string flight_dir;
+bool flight_frames = false;
 
 static void on_low_H_thresh_trackbar(int, void *) {
     low_H = std::min(high_H-1, low_H);
@@ -94,10 +138,28 @@ static void on_callibrate_gaze_button(int state, void *) {
 	calibration_frame = 0;
 }
 
+static void on_calibrate_screen_button(int state, void *calibration) {
+	std::cout << "Look at each dot until it moves" << std::endl;
+	static_cast<camux::GazeCalibration *>(calibration)->start();
+	cv::namedWindow(gaze_window, cv::WINDOW_NORMAL);
+	cv::setWindowProperty(gaze_window, cv::WND_PROP_FULLSCREEN, cv::WINDOW_FULLSCREEN);
+}
+
+/**
+ * Show the current calibration target, full screen.
+ */
+static void show_gaze_target(camux::GazeCalibration &calibration) {
+	cv::Mat canvas = cv::Mat::zeros(screen_size, CV_8UC3);
+	cv::circle(canvas, calibration.getTarget(), 15, cv::Scalar(0, 0, 255), -1);
+	cv::putText(canvas, std::to_string(calibration.getTargetIndex() + 1) + "/" + std::to_string(calibration.getTargetCount()),
+				cv::Point(20, 40), cv::FONT_HERSHEY_SIMPLEX, 1, cv::Scalar(255, 255, 255));
+	cv::imshow(gaze_window, canvas);
+}
+
 static void parse_calibration_data() {
-	int forehead_x_total, forehead_y_total;
-	int righteye_x_total, righteye_y_total;
-	int lefteye_x_total, lefteye_y_total;
+	int forehead_x_total = 0, forehead_y_total = 0;
+	int righteye_x_total = 0, righteye_y_total = 0;
+	int lefteye_x_total = 0, lefteye_y_total = 0;
 
 	for (int i = 0; i < CALIBRATION_LENGTH; ++i) {
 		// Forehead data
@@ -121,37 +183,223 @@ static void parse_calibration_data() {
 	calibrated_left_eye.y = lefteye_y_total / CALIBRATION_LENGTH;
 }
 
+// Same clock as the frames' capture timestamps.
+static int64_t now_us() {
+	return camux::steadyMicros();
+}
+
+// Exponential moving average for the latency gauges in the published stats.
+static double ema(double average, double sample) {
+	return average ? average + (sample - average) * 0.1 : sample;
+}
+
+static void update_presence_stats(camux::Stats &stats, camux::PresenceScheduler &presence) {
+	stats.present_cpu_s_per_h = presence.getCpuSecondsPerHour(camux::Present);
+	stats.absent_cpu_s_per_h = presence.getCpuSecondsPerHour(camux::Absent);
+}
+
+static void update_pupil_search_stats(camux::Stats &stats, camux::Eye &left_eye, camux::Eye &right_eye) {
+	const camux::PupilSearchStats &left = left_eye.getSearchStats(), &right = right_eye.getSearchStats();
+	camux::PupilSearchStats both;
+	both.searches = left.searches + right.searches;
+	both.attempts = left.attempts + right.attempts;
+	both.hits = left.hits + right.hits;
+	both.full_searches = left.full_searches + right.full_searches;
+	both.full_us = left.full_us + right.full_us;
+	both.total_us = left.total_us + right.total_us;
+	stats.pupil_warm_hit_rate = both.hitRate();
+	stats.pupil_search_speedup = both.speedup();
+}
+
+static void copy_rect(const cv::Rect &r, int32_t out[4]) {
+	out[0] = r.x;
+	out[1] = r.y;
+	out[2] = r.width;
+	out[3] = r.height;
+}
+
+static void copy_point(const cv::Point &p, int32_t out[2]) {
+	out[0] = p.x;
+	out[1] = p.y;
+}
+
+/**
+ * Whether there's a calibration to save: the screen calibration's gaze fit, or the reference
+ * points. Near-eye mode has no forehead dot, so the fit is all it ever gets.
+ */
+static bool is_calibrated(camux::GazeMapper &gaze_mapper) {
+	return gaze_mapper.isFitted() || calibrated_forehead != cv::Point();
+}
+
+/**
+ * Save the calibrated reference points, both eyes' adapted pupil thresholds and the gaze mapping.
+ */
+static void save_profile(camux::Eye &left_eye, camux::Eye &right_eye, camux::GazeMapper &gaze_mapper) {
+	camux::CalibrationProfile profile;
+	profile.forehead = calibrated_forehead;
+	profile.left_eye = calibrated_left_eye;
+	profile.right_eye = calibrated_right_eye;
+	profile.left_thresholds = left_eye.getThresholdController();
+	profile.right_thresholds = right_eye.getThresholdController();
+	profile.gaze = gaze_mapper;
+
+	if (!profile.save(profile_file)) {
+		std::cerr << "Could not save calibration profile " << profile_file << std::endl;
+	}
+}
+
+/**
+ * Parse the command line. Returns false (after printing usage) on anything we don't understand.
+ */
+static bool parse_args(int argc, char **argv) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--telemetry" && i + 1 < argc) {
+			telemetry_file = argv[++i];
+		} else if (arg == "--record" && i + 1 < argc) {
+			record_file = argv[++i];
+		} else if (arg == "--replay" && i + 1 < argc) {
+			replay_file = argv[++i];
+		} else if (arg == "--profile" && i + 1 < argc) {
+			profile_file = argv[++i];
+		} else if (arg == "--flight-recorder" && i + 1 < argc) {
+			flight_dir = argv[++i];
+		} else if (arg == "--flight-frames") {
+			flight_frames = true;
+		} else if (arg == "--cursor") {
+			move_cursor = true;
+		} else if (arg == "--no-motion-gate") {
+			motion_gate = false;
+		} else if (arg == "--near-eye" && i + 1 < argc && (std::string(argv[i + 1]) == "single" ||
+															 std::string(argv[i + 1]) == "stereo")) {
+			input_mode = std::string(argv[++i]) == "single" ? SingleEyeInput : StereoEyeInput;
+		} else if (arg == "--screen" && i + 1 < argc &&
+				   std::sscanf(argv[++i], "%dx%d", &screen_size.width, &screen_size.height) == 2 &&
+				   screen_size.area() > 0) {
+			continue;
+		} else {
+			std::cerr << "Usage: eye_mouse [--telemetry <FILE>] [--record <ARCHIVE> | --replay <ARCHIVE>] "
+					  << "[--profile <FILE>] [--screen <WIDTH>x<HEIGHT>] [--cursor] [--no-motion-gate] "
+					  << "[--near-eye single|stereo] [--flight-recorder <DIR> [--flight-frames]]" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
 /**
  * Run the GazeMouse software. Opens up a webcam, iterates through each frame, and runs
  * 	the implemented tracking softwares (face detector -> eye detector -> pupil detector ->
  * 	gaze detector). Times the above detectors to track latencies.
  *
  */
-int main() {
-		cv::VideoCapture cap(0);
-		if (!cap.isOpened()) {
-			std::cerr << "No webcam detected" << std::endl;
+int main(int argc, char **argv) {
+		if (!parse_args(argc, argv)) return -1;
+
+		// Frames come from the webcam, or from a recorded archive when replaying.
+		camux::CameraSource camera;
+		camux::ArchiveSource replay;
+		camux::FrameSource *source;
+
+		if (!replay_file.empty()) {
+			if (!replay.open(replay_file)) {
+				std::cerr << "Could not open frame archive " << replay_file << std::endl;
+				return -1;
+			}
+			source = &replay;
+		} else {
+			camera.open(0);
+			if (!camera.isOpen()) {
+				std::cerr << "No webcam detected" << std::endl;
+				return -1;
+			}
+			source = &camera;
+		}
+
+		camux::FrameArchiveWriter recorder;
+		if (!record_file.empty() && !recorder.open(record_file)) {
+			std::cerr << "Could not open frame archive " << record_file << std::endl;
 			return -1;
 		}
 
-		// Initialize the variables to pass to the face detector. Frame holds the image
-		// data. Face is written by the face detector to hold the coordinates of the face,
-		// among other properties e.g confidence.
-		cv::Mat frame, leye_frame, reye_frame, hsv, hsv_out, face_frame;
-		camux::Face face;
-		camux::Eye left_eye, right_eye;
+		camux::XdotoolCursor cursor;
+		if (move_cursor && !cursor.open()) {
+			std::cerr << "Could not start xdotool to move the cursor" << std::endl;
+			return -1;
+		}
 
-		// Initialize the face/eye detector itself using any of the implemented methods.
-		FaceEyeDetector face_eye_detector(HaarCascade, face, left_eye, right_eye);
+		// Frame holds the image data of the frame being processed, sample everything the pipeline
+		// found in it.
+		cv::Mat frame, face_frame;
+		camux::Frame input;
+		camux::GazeSample sample;
 
-		// Initialize the varibales to pass to the eye detector.
+		// Live stats for eye_mouse_stat. Publishing never blocks on whoever is reading them.
+		camux::StatsPublisher stats_publisher;
+		if (!stats_publisher.open()) {
+			std::cerr << "Could not publish stats to " << camux::STATS_SEGMENT << std::endl;
+		}
+		camux::Stats stats = {};
+		stats.pid = getpid();
+		stats.start_us = now_us();
+		int64_t fps_start_us = stats.start_us;
+
+		// Initialize the tracking pipeline (and the face/eye detector) using any of the implemented methods.
+		Pipeline pipeline(HaarCascade);
+		stats.model_load_ms = (now_us() - stats.start_us) / 1000.0;
+		pipeline.setInputMode(input_mode);
+
+		camux::Eye &left_eye = pipeline.getLeftEye();
+		camux::Eye &right_eye = pipeline.getRightEye();
+		FaceEyeDetector &face_eye_detector = pipeline.getDetector();
+		// Show the pupil localizer's intermediate images (only for the eye on this thread).
+		camux::DebugView show = [](const std::string &name, const cv::Mat &image) { cv::imshow(name, image); };
+		if (!pipeline.getEyePair().isConcurrent()) right_eye.setDebugView(show);
+		left_eye.setDebugView(show);
+
+		// Maps where the pupils are relative to the forehead dot to where on the screen they're
+		// looking. Fitted by the multi-point screen calibration, then refined by every later one.
+		camux::GazeMapper &gaze_mapper = pipeline.getGazeMapper();
+		camux::GazeCalibration gaze_calibration(screen_size);
+
+		// Pick up where the last session's calibration left off.
+		camux::CalibrationProfile profile;
+		if (profile.load(profile_file)) {
+			calibrated_forehead = profile.forehead;
+			calibrated_left_eye = profile.left_eye;
+			calibrated_right_eye = profile.right_eye;
+			left_eye.getThresholdController() = profile.left_thresholds;
+			right_eye.getThresholdController() = profile.right_thresholds;
+			gaze_mapper = profile.gaze;
+		}
 
 		// Timing latency variables
 		std::chrono::steady_clock::time_point begin;
 		std::chrono::steady_clock::time_point end;
 
+		// Camera to cursor latency, over the last second and the whole session.
+		camux::LatencyHistogram e2e_second, e2e_session;
+
+		// Per-frame telemetry, for working out what happened after the fact (see eye_mouse_telemetry).
+		camux::TelemetryWriter telemetry;
+		if (!telemetry_file.empty() && !telemetry.open(telemetry_file, TELEMETRY_CAPACITY)) {
+			std::cerr << "Could not open telemetry log " << telemetry_file << std::endl;
+		}
+		uint64_t frame_count = 0;
+
+		// The last few seconds of frames, dumped to flight_dir when tracking fails (or on 'f').
+		// Opened on the first frame, once its size is known.
+		camux::FlightRecorder flight;
+		bool flight_failed = false;
+
+		// Tracks every frame while someone's there; otherwise only scans for a face a few times a
+		// second, in a smaller frame, so an empty kiosk doesn't burn a core.
+		camux::PresenceScheduler presence;
+		presence.setMotionGate(motion_gate);
+
 		cv::namedWindow(webcam_window);
 		cv::createButton("Calibrate Gaze", on_callibrate_gaze_button);  
+		cv::createButton("Calibrate Screen", on_calibrate_screen_button, &gaze_calibration);
 
 		cv::createTrackbar("Low H", webcam_window, &low_H, max_H, on_low_H_thresh_trackbar);
 		cv::createTrackbar("High H", webcam_window, &high_H, max_H, on_high_H_thresh_trackbar);
@@ -162,79 +410,154 @@ int main() {
 
 		// Iterate through webcam frames until we receive escape
 		while(1) {
-			cap >> frame;
-			
-			// cv::cvtColor(frame, frame, cv::COLOR_BGR2GRAY);
+			// Replays run as fast as we can process; their frames are views straight into the archive.
+			if (!source->read(input)) break;
+			frame = input.image;
+
+			if (frame.empty()) {
+				++stats.dropped_frames;
+				stats.update_us = now_us();
+				stats_publisher.publish(stats);
+				// A camera that stops delivering returns empty frames at once: wait a little, and
+				// still let Esc quit.
+				if (cv::waitKey(1) == 27) break;
+				continue;
+			}
 
-			// Timing latencies for debug
-			std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+			// Record before anything is drawn on the frame.
+			if (recorder.isOpen()) recorder.write(frame, input.timestamp_us);
 
-			face_eye_detector.detectFace(frame);
+			if (!flight_dir.empty() && !flight.isOpen() && !flight_failed) {
+				size_t frame_bytes = frame.total() * frame.elemSize();
+				if (!flight.open(flight_dir, FLIGHT_SLOTS, flight_frames ? frame_bytes : frame_bytes / FLIGHT_ROI_FRACTION,
+								 flight_frames ? camux::FlightFrames : camux::FlightRois)) {
+					std::cerr << "Could not start the flight recorder in " << flight_dir << std::endl;
+					flight_failed = true;
+				}
+			}
 
-			cv::Rect le = left_eye.getCoords();
-			cv::Rect re = right_eye.getCoords();
+			camux::PresenceScheduler::Action action = presence.next(input);
+			if (action != camux::PresenceScheduler::Track) {
+				stats.tracking_state = camux::Idle;
+				if (action == camux::PresenceScheduler::Scan) {
+					pipeline.scan(input, presence.getScanScale(), sample);
+					presence.update(sample.face_found);
+
+					++stats.detector_runs;
+					if (sample.face_found) {
+						stats.tracking_state = camux::Detecting;
+						camux::drawRectangle(frame, sample.face);
+					}
+					cv::putText(frame, "Idle", cv::Point(0, 20), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(255, 0, 0));
+					cv::imshow(webcam_window, frame);
+				}
 
+				update_presence_stats(stats, presence);
+				stats.update_us = now_us();
+				stats_publisher.publish(stats);
 
-			leye_frame = frame(le);
-			reye_frame = frame(re);
+				// Still pump HighGUI's events, for the buttons, escape and 'f' (the flight recorder
+				// only records tracked frames, so it dumps on the next one).
+				int key = cv::waitKey(1);
+				if (key == 27) break;
+				if (key == 'f') flight.trigger();
+				continue;
+			}
 
-			cv::Rect face_rect = face_eye_detector.getFace().getCoords();
+			// Timing latencies for debug
+			begin = std::chrono::steady_clock::now();
+
+			camux::TelemetryRecord record = {};
+			record.frame = frame_count++;
+			record.timestamp_us = input.timestamp_us;
+			record.calibration_frame = calibration_frame;
+
+			ForeheadDotRange &range = pipeline.getForeheadRange();
+			range.low_h = low_H;
+			range.low_s = low_S;
+			range.low_v = low_V;
+			range.high_h = high_H;
+			range.high_s = high_S;
+			range.high_v = high_V;
+
+			// Detection (or tracking), the forehead dot, both pupils and the gaze mapping.
+			pipeline.process(input, sample);
+			presence.update(sample.face_found);
+			flight.record(frame, sample);
+
+			record.detect_us = sample.detect_us;
+			record.forehead_us = sample.forehead_us;
+			record.pupil_us = sample.pupil_us;
+			record.flags |= sample.face_found ? camux::FaceFound : 0;
+			record.flags |= sample.ran_detector ? camux::RanDetector : 0;
+
+			cv::Rect face_rect = sample.face & cv::Rect(0, 0, frame.cols, frame.rows);
 			face_frame = frame(face_rect);
 
 			if (!face_frame.empty()) {
-				// Identify the blue on the image (for forehead dot feature)
-				cv::cvtColor(face_frame, hsv, cv::COLOR_BGR2HSV);
-				// cv::InputArray lower_pink = []; 
-				
-				// cv::GaussianBlur(hsv, hsv, cv::Size(3, 3), 0);
-				cv::inRange(hsv, cv::Scalar(low_H, low_S, low_V), cv::Scalar(high_H, high_S, high_V), hsv_out);
-				// cv::GaussianBlur(hsv_out, hsv_out, cv::Size(3, 3), 0);
-			
-				cv::Mat kernel = cv::getStructuringElement(cv::MORPH_RECT, cv::Size(5, 5));
-				cv::morphologyEx(hsv_out, hsv_out, cv::MORPH_OPEN, kernel);
-				
-				std::vector<std::vector<cv::Point>> contours;
-				cv::findContours(hsv_out, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_SIMPLE);
-
-				cv::drawContours(face_frame, contours, -1, cv::Scalar(225,0,0), 1);
-
-				cv::Rect forehead_dot_rect;
-				if (contours.size() > 0) {
-					forehead_dot_rect = cv::boundingRect(contours[0]);
-					camux::drawRectangle(face_frame, forehead_dot_rect);
-				}
+				if (sample.forehead_found) camux::drawRectangle(frame, sample.forehead_dot);
 
-				cv::imshow("Selected parts of the image", hsv_out);
+				// No forehead dot is looked for with a near-eye camera.
+				if (!pipeline.getForeheadMask().empty()) cv::imshow("Selected parts of the image", pipeline.getForeheadMask());
 				cv::imshow("Blue circle", face_frame);
 
-				// cv::cvtColor(leye_frame, leye_frame, cv::COLOR_BGR2GRAY);
-				// cv::cvtColor(reye_frame, reye_frame, cv::COLOR_BGR2GRAY);
-
-				// cv::equalizeHist(leye_frame, leye_frame);
-				// cv::equalizeHist(reye_frame, reye_frame);
-
-				cv::Point left_eye_center = left_eye.findPupilCenter(leye_frame);
-				cv::Point right_eye_center = right_eye.findPupilCenter(reye_frame);
-
-				cv::Point forehead_dot_center;
-				forehead_dot_center.x = face.getCoords().x + forehead_dot_rect.x + (forehead_dot_rect.width / 2);
-				forehead_dot_center.y = face.getCoords().y + forehead_dot_rect.y + (forehead_dot_rect.height / 2);
-
-				left_eye_center.x += left_eye.getCoords().x;
-				left_eye_center.y += left_eye.getCoords().y;
+				cv::Point forehead_dot_center = sample.forehead;
+				cv::Point left_eye_center = sample.left_pupil;
+				cv::Point right_eye_center = sample.right_pupil;
 
 				cv::circle(frame, left_eye_center, 3, cv::Scalar(0,255,0), -1);
 				// cv::circle(frame, left_eye_center, left_eye.getPupilRadius(), cv::Scalar(0,0,255));
 
-				right_eye_center.x += right_eye.getCoords().x;
-				right_eye_center.y += right_eye.getCoords().y;
+				// A closed eye has no pupil to calibrate on, so only sample frames with both eyes open.
+				bool eyes_open = !sample.left_closed && !sample.right_closed;
 
-				if (calibration_frame >= 0) {
+				if (calibration_frame >= 0 && eyes_open) {
 					forehead_calibration[calibration_frame] = forehead_dot_center;
 					left_eye_calibration[calibration_frame] = left_eye_center;
 					right_eye_calibration[calibration_frame] = right_eye_center;
 				}
 
+				if (sample.has_offset && gaze_calibration.isRunning() && gaze_calibration.addSample(sample.gaze_offset)) {
+					cv::destroyWindow(gaze_window);
+					if (gaze_calibration.apply(gaze_mapper)) {
+						std::cout << "Screen calibration finished..." << std::endl;
+						save_profile(left_eye, right_eye, gaze_mapper);
+					} else {
+						std::cout << "Screen calibration failed, the pupils barely moved between targets" << std::endl;
+					}
+				}
+
+				if (sample.gaze_valid) {
+					cv::Point gaze(cvRound(sample.gaze.x), cvRound(sample.gaze.y));
+					cv::putText(frame, "Gaze: " + std::to_string(gaze.x) + ", " + std::to_string(gaze.y),
+								cv::Point(0, 60), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(255, 0, 0));
+					copy_point(gaze, record.gaze);
+
+					// The end of the line: from the camera capturing the frame to the cursor moving.
+					gaze.x = std::min(std::max(gaze.x, 0), screen_size.width - 1);
+					gaze.y = std::min(std::max(gaze.y, 0), screen_size.height - 1);
+					if (cursor.isOpen() && cursor.move(gaze)) {
+						record.cursor_us = now_us() - input.capture_us;
+						e2e_second.add(record.cursor_us);
+						e2e_session.add(record.cursor_us);
+					}
+				}
+
+				if (sample.left_blinked || sample.right_blinked) {
+					std::cout << "Blink (left: " << sample.left_blinks << ", right: "
+							  << sample.right_blinks << ")" << std::endl;
+				}
+				if (!eyes_open) {
+					cv::putText(frame, sample.left_closed && sample.right_closed ? "Eyes closed" : "Eye closed",
+								cv::Point(0, 40), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(0, 0, 255));
+				}
+
+				copy_point(left_eye_center, record.left_pupil);
+				copy_point(right_eye_center, record.right_pupil);
+				copy_point(forehead_dot_center, record.forehead);
+				record.flags |= sample.left_closed ? camux::LeftEyeClosed : 0;
+				record.flags |= sample.right_closed ? camux::RightEyeClosed : 0;
+
 				cv::circle(frame, right_eye_center, 3, cv::Scalar(0,255,0), -1);
 				// cv::circle(frame, right_eye_center, right_eye.getPupilRadius(), cv::Scalar(0,0,255));
 
@@ -248,21 +571,19 @@ int main() {
 				cv::line(frame, right_eye_center, forehead_dot_center, cv::Scalar(0, 255, 255), 2);
 				cv::line(frame, left_eye_center, right_eye_center, cv::Scalar(0, 255, 255), 2);
 
-				cv::resize(leye_frame, leye_frame, cv::Size(), 2, 2, cv::INTER_CUBIC);
-				cv::resize(reye_frame, reye_frame, cv::Size(), 2, 2, cv::INTER_CUBIC);
+				// The boxes come from the sample; the landmarks (Dlib_68 only) still come from the
+				// detector, which is fine on the thread that runs it.
+				camux::drawRectangle(frame, sample.face);
+				camux::drawRectangle(frame, sample.left_eye);
+				camux::drawRectangle(frame, sample.right_eye);
+				face_eye_detector.drawLandmarks(frame, pipeline.getScale());
 
-				// cv::imshow("Left eye", leye_frame);
-				// cv::imshow("Right eye", reye_frame);
-				
-				face_eye_detector.drawFace(frame);
-				face_eye_detector.drawEyes(frame);
-				face_eye_detector.drawLandmarks(frame);
-
-				if (calibration_frame >= 0 && calibration_frame++ >= CALIBRATION_LENGTH) {
+				if (calibration_frame >= 0 && eyes_open && ++calibration_frame >= CALIBRATION_LENGTH) {
 					calibration_frame = -1;
 					std::cout << "Calibration finished..." << std::endl;
 					// Call calibration function
 					parse_calibration_data();
+					save_profile(left_eye, right_eye, gaze_mapper);
 				}
 			}
 
@@ -271,6 +592,45 @@ int main() {
 			end = std::chrono::steady_clock::now();
 			double frame_latency = std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count();
 
+			copy_rect(sample.face, record.face);
+			copy_rect(sample.left_eye, record.left_eye);
+			copy_rect(sample.right_eye, record.right_eye);
+			record.face_confidence = sample.face_confidence;
+			record.left_eye_confidence = sample.left_eye_confidence;
+			record.right_eye_confidence = sample.right_eye_confidence;
+			record.flags |= record.calibration_frame >= 0 ? camux::Calibrating : 0;
+			record.flags |= is_calibrated(gaze_mapper) ? camux::Calibrated : 0;
+			record.flags |= sample.gaze_valid ? camux::GazeMapped : 0;
+			record.frame_us = frame_latency;
+			record.latency_us = sample.done_us - input.capture_us;
+			telemetry.write(record);
+
+			// Publish the live stats.
+			if (stats.tracking_state != camux::NoFace && !sample.face_found) ++stats.faces_lost;
+			stats.tracking_state = !sample.face_found ? camux::NoFace :
+								   sample.ran_detector ? camux::Detecting : camux::Tracking;
+			++stats.frames;
+			stats.late_frames += frame_latency > MICROSECONDS_PER_SECOND / FPS;
+			stats.detector_runs += sample.ran_detector;
+			stats.blinks += sample.left_blinked || sample.right_blinked;
+			stats.detect_us = ema(stats.detect_us, record.detect_us);
+			stats.forehead_us = ema(stats.forehead_us, record.forehead_us);
+			stats.pupil_us = ema(stats.pupil_us, record.pupil_us);
+			stats.pupils_us = ema(stats.pupils_us, sample.pupils_us);
+			stats.left_pupil_us = ema(stats.left_pupil_us, sample.left_pupil_us);
+			stats.right_pupil_us = ema(stats.right_pupil_us, sample.right_pupil_us);
+			stats.frame_us = ema(stats.frame_us, frame_latency);
+			stats.max_frame_us = std::max(stats.max_frame_us, frame_latency);
+			stats.calibrated = (record.flags & camux::Calibrated) != 0;
+			update_presence_stats(stats, presence);
+			update_pupil_search_stats(stats, left_eye, right_eye);
+			stats.update_us = now_us();
+			if (stats.frames % FPS == 0) {
+				stats.fps = FPS * (double) MICROSECONDS_PER_SECOND / (stats.update_us - fps_start_us);
+				fps_start_us = stats.update_us;
+			}
+			stats_publisher.publish(stats);
+
 			// Display the processing time for this frame
 			cv::putText(frame, "Frame Latency: " + std::to_string((frame_latency) / MICROSECONDS_PER_SECOND),
 										cv::Point(0, 20), cv::FONT_HERSHEY_SIMPLEX, 0.45, cv::Scalar(255, 0, 0));
@@ -278,16 +638,40 @@ int main() {
 			// Print average latency once per second, skipping the first second
 			if (!f_idx && total_latency) {
 				std::cout << "\033[1;31mAvg Frame Latency:\033[0m " << total_latency / MICROSECONDS_PER_SECOND / FPS << std::endl;
+				if (e2e_second.count()) std::cout << "Camera to cursor: " << e2e_second.summary() << std::endl;
 				total_latency = 0;
+				e2e_second.reset();
 			}
 			total_latency += frame_latency;
 
 			f_idx = (f_idx + 1) % FPS;
 
 			cv::imshow(webcam_window, frame);
+			if (gaze_calibration.isRunning()) show_gaze_target(gaze_calibration);
+
+			// Wait 30 ms between frames, and break if escape key is pressed. 'f' dumps the flight
+			// recorder.
+			int key = cv::waitKey(1);
+			if (key == 27) break;
+			if (key == 'f') flight.trigger();
+		}
 
-			// Wait 30 ms between frames, and break if escape key is pressed
-			if (cv::waitKey(1) == 27) break;
+		if (e2e_session.count()) std::cout << "Camera to cursor, whole session: " << e2e_session.summary() << std::endl;
+		std::printf("Present %.0f s at %.0f CPU s/h, absent %.0f s at %.0f CPU s/h (%llu scans, %llu skipped for no motion)\n",
+					presence.getSeconds(camux::Present), presence.getCpuSecondsPerHour(camux::Present),
+					presence.getSeconds(camux::Absent), presence.getCpuSecondsPerHour(camux::Absent),
+					(unsigned long long) presence.getScans(), (unsigned long long) presence.getGatedScans());
+		std::printf("Pupil search: %.0f%% warm start hits, %.2fx faster than full searches\n", stats.pupil_warm_hit_rate * 100,
+					stats.pupil_search_speedup);
+		if (flight.isOpen()) {
+			// Writes out a dump still waiting for its frames after the trigger.
+			flight.close();
+			std::printf("Flight recorder: %llu dumps in %s (%llu triggers dropped, %llu frames overwritten mid-dump)\n",
+						(unsigned long long) flight.getDumps(), flight_dir.c_str(), (unsigned long long) flight.getDroppedTriggers(),
+						(unsigned long long) flight.getTornFrames());
 		}
+
+		// The thresholds keep adapting after calibration, so save where they ended up.
+		if (is_calibrated(gaze_mapper)) save_profile(left_eye, right_eye, gaze_mapper);
 		return 0;
 }
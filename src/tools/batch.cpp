@@ -0,0 +1,354 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_batch: Turn recorded sessions into per-frame gaze tracks offline, as fast as the machine
+// allows, instead of playing each one through eye_mouse in real time.
+//
+// Usage: eye_mouse_batch [OPTIONS] INPUT...
+//   INPUT               Frame archives recorded with eye_mouse --record, or any video OpenCV can read
+//   --out DIR           Where to write the tracks, one INPUT_NAME.gaze per input (default: next to
+//                       each input)
+//   --threads N         Threads to run on (default one per core)
+//   --chunk N           Frames per chunk (default 900, 30 seconds at 30 fps)
+//   --overlap N         Frames run before each chunk to rebuild tracking state (default 30)
+//   --profile FILE      Calibration profile to load, so gaze is mapped to the screen
+//   --near-eye MODE     Inputs are from a near-eye camera: "single" (one eye per frame) or "stereo"
+//                       (both side by side), see Pipeline::setInputMode()
+//
+// Every input is split into chunks, and the chunks of all the inputs are run across the threads
+// with a work-stealing scheduler (see camux::WorkStealingPool), so a few long recordings keep every
+// core as busy as many short ones. Each thread keeps one Pipeline (loading the cascades once) and
+// resets it a little before each chunk's first frame: face and eye tracking, the pupil thresholds
+// and the processing scale all settle over the overlap frames, which are run but not written. A
+// chunk's results don't depend on what ran before it on the same thread, so the tracks come out the
+// same whatever the thread count.
+//
+// A video's frame count is only the container's estimate, so the last chunk of a video reads on to
+// its real end and the track is cut or extended to match. Seeks can land early (on a keyframe) or
+// anywhere the container guesses, so each chunk checks where it landed and decodes forward to its
+// first frame. Videos whose frame count OpenCV can't tell are run as a single chunk. The tracks are
+// columnar (see camux::GazeTrack). An input whose chunk fails is reported and skipped; exits 1 if
+// any input couldn't be read or its track written.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../Pipeline.h"
+#include "../camux/CalibrationProfile.h"
+#include "../camux/FrameArchive.h"
+#include "../camux/GazeTrack.h"
+#include "../camux/WorkStealingPool.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <opencv2/videoio.hpp>
+
+struct Input {
+	std::string path;
+	std::string out;
+	bool archive = false;
+	// Frames, or 0 if unknown (a video that can't tell). Only an estimate for videos.
+	uint64_t frames = 0;
+
+	camux::GazeTrack track;
+	// Samples past the end of track, from the last chunk, which reads on to the input's real end.
+	std::vector<camux::GazeSample> tail;
+	// Where the input turned out to end, if a chunk ran out of frames before its own end.
+	std::atomic<uint64_t> end;
+	// Chunks still to finish; the one that finishes last writes the track.
+	std::atomic<int> remaining;
+	std::atomic<bool> failed;
+
+	Input() : end(UINT64_MAX), remaining(0), failed(false) {}
+};
+
+struct Chunk {
+	Input *input;
+	uint64_t first;
+	// Frames in the chunk, or 0 for all the rest of the input.
+	uint64_t count;
+};
+
+// Command line settings.
+std::string out_dir, profile_file;
+int threads = 0;
+uint64_t chunk_frames = 900;
+uint64_t overlap_frames = 30;
+InputMode input_mode = FaceInput;
+
+camux::CalibrationProfile profile;
+bool have_profile = false;
+
+static std::string track_path(const std::string &path) {
+	size_t slash = path.rfind('/');
+	std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+	size_t dot = name.rfind('.');
+	if (dot != std::string::npos && dot > 0) name = name.substr(0, dot);
+
+	if (out_dir.empty()) return (slash == std::string::npos ? "" : path.substr(0, slash + 1)) + name + ".gaze";
+	return out_dir + "/" + name + ".gaze";
+}
+
+// Find out whether the input is an archive and how many frames it has.
+static bool probe(Input &input) {
+	camux::FrameArchiveReader archive;
+	if (archive.open(input.path)) {
+		input.archive = true;
+		input.frames = archive.size();
+		return true;
+	}
+
+	cv::VideoCapture video(input.path);
+	if (!video.isOpened()) return false;
+	double frames = video.get(cv::CAP_PROP_FRAME_COUNT);
+	input.frames = frames > 0 ? (uint64_t) frames : 0;
+	return true;
+}
+
+/**
+ * Reads a range of frames of an input, from an archive or by seeking a video.
+ */
+class ChunkReader {
+public:
+	bool open(const Input &input, uint64_t first, uint64_t count) {
+		next_ = first;
+		end_ = count ? first + count : UINT64_MAX;
+
+		if (input.archive) {
+			if (!archive_.open(input.path)) return false;
+			end_ = std::min<uint64_t>(end_, archive_.size());
+			archive_.prefetch(first, end_ - first);
+			archive_open_ = true;
+			return true;
+		}
+
+		if (!video_.open(input.path)) return false;
+		if (first == 0) return true;
+
+		// Check where the seek landed and decode forward from there. If it went past the frame, or
+		// can't tell, decode forward from the start instead.
+		uint64_t at = 0;
+		double landed = video_.set(cv::CAP_PROP_POS_FRAMES, (double) first) ? video_.get(cv::CAP_PROP_POS_FRAMES) : -1;
+		if (landed >= 0 && landed <= first && landed == std::floor(landed)) {
+			at = (uint64_t) landed;
+		} else if (!video_.open(input.path)) {
+			return false;
+		}
+		while (at < first && video_.grab()) ++at;
+
+		// The video ends before the chunk starts.
+		if (at < first) next_ = end_ = at;
+		return true;
+	}
+
+	bool read(camux::Frame &frame) {
+		if (next_ >= end_) return false;
+
+		if (archive_open_) {
+			frame.image = archive_.frame(next_);
+			frame.timestamp_us = archive_.timestamp(next_);
+		} else {
+			if (!video_.read(image_)) return false;
+			frame.image = image_;
+			frame.timestamp_us = (int64_t) (video_.get(cv::CAP_PROP_POS_MSEC) * 1000);
+		}
+		frame.capture_us = camux::steadyMicros();
+		frame.index = next_++;
+		return true;
+	}
+
+	uint64_t position() { return next_; }
+
+private:
+	camux::FrameArchiveReader archive_;
+	bool archive_open_ = false;
+	cv::VideoCapture video_;
+	cv::Mat image_;
+	uint64_t next_ = 0;
+	uint64_t end_ = 0;
+};
+
+static void run_chunk(Chunk &chunk, Pipeline &pipeline) {
+	Input &input = *chunk.input;
+
+	// Start a little early, so tracking has settled by the chunk's first frame.
+	uint64_t warm_start = chunk.first > overlap_frames ? chunk.first - overlap_frames : 0;
+	uint64_t count = chunk.count ? chunk.first + chunk.count - warm_start : 0;
+
+	ChunkReader reader;
+	if (!reader.open(input, warm_start, count)) throw std::runtime_error("could not open it");
+
+	// Nothing the thread's last chunk left behind carries over.
+	pipeline.reset();
+	if (have_profile) {
+		pipeline.getLeftEye().getThresholdController() = profile.left_thresholds;
+		pipeline.getRightEye().getThresholdController() = profile.right_thresholds;
+		pipeline.getGazeMapper() = profile.gaze;
+	}
+
+	camux::Frame frame;
+	camux::GazeSample sample;
+	while (reader.read(frame)) {
+		pipeline.process(frame, sample);
+		if (frame.index < chunk.first) continue;
+
+		// Only the last chunk reads past the frame count, and the other chunks may still be writing
+		// the track, so it keeps those frames aside.
+		if (frame.index < input.track.size()) input.track.set(frame.index, sample);
+		else input.tail.push_back(sample);
+	}
+
+	// Ran out before the chunk's end: the input is shorter than its frame count said.
+	uint64_t end = chunk.count ? chunk.first + chunk.count : UINT64_MAX;
+	uint64_t shortest = input.end;
+	while (reader.position() < end && reader.position() < shortest &&
+		   !input.end.compare_exchange_weak(shortest, reader.position())) {}
+}
+
+// Fit the track to the frames that were actually there, once every chunk has finished.
+static void finish_track(Input &input) {
+	if (input.end < input.track.size()) {
+		input.track.resize(input.end);
+	} else if (!input.tail.empty()) {
+		uint64_t first = input.track.size();
+		input.track.resize(first + input.tail.size());
+		for (size_t i = 0; i < input.tail.size(); ++i) input.track.set(first + i, input.tail[i]);
+	}
+}
+
+static bool parse_args(int argc, char **argv, std::vector<std::string> &paths) {
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--out" && has_value) {
+			out_dir = argv[++i];
+		} else if (arg == "--threads" && has_value) {
+			threads = std::atoi(argv[++i]);
+		} else if (arg == "--chunk" && has_value) {
+			chunk_frames = std::strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--overlap" && has_value) {
+			overlap_frames = std::strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--profile" && has_value) {
+			profile_file = argv[++i];
+		} else if (arg == "--near-eye" && has_value && (std::string(argv[i + 1]) == "single" || std::string(argv[i + 1]) == "stereo")) {
+			input_mode = std::string(argv[++i]) == "single" ? SingleEyeInput : StereoEyeInput;
+		} else if (arg[0] != '-') {
+			paths.push_back(arg);
+		} else {
+			return false;
+		}
+	}
+	return !paths.empty() && chunk_frames > 0;
+}
+
+int main(int argc, char **argv) {
+	std::vector<std::string> paths;
+	if (!parse_args(argc, argv, paths)) {
+		std::fprintf(stderr, "Usage: %s [--out DIR] [--threads N] [--chunk N] [--overlap N] [--profile FILE] [--near-eye single|stereo] INPUT...\n",
+					 argv[0]);
+		return -1;
+	}
+
+	if (!profile_file.empty()) {
+		if (!profile.load(profile_file)) {
+			std::fprintf(stderr, "Could not load calibration profile %s\n", profile_file.c_str());
+			return -1;
+		}
+		have_profile = true;
+	}
+
+	// Split every input into chunks.
+	std::vector<std::unique_ptr<Input>> inputs;
+	std::vector<Chunk> chunks;
+	bool failed = false;
+
+	for (size_t i = 0; i < paths.size(); ++i) {
+		std::unique_ptr<Input> input(new Input());
+		input->path = paths[i];
+		input->out = track_path(paths[i]);
+		if (!probe(*input)) {
+			std::fprintf(stderr, "Could not open %s\n", paths[i].c_str());
+			failed = true;
+			continue;
+		}
+
+		input->track.resize(input->frames);
+
+		if (input->frames == 0) {
+			Chunk chunk = { input.get(), 0, 0 };
+			chunks.push_back(chunk);
+			input->remaining = 1;
+		} else {
+			for (uint64_t first = 0; first < input->frames; first += chunk_frames) {
+				// A video's last chunk reads to wherever the video really ends.
+				uint64_t count = std::min(chunk_frames, input->frames - first);
+				if (!input->archive && first + count == input->frames) count = 0;
+				Chunk chunk = { input.get(), first, count };
+				chunks.push_back(chunk);
+				++input->remaining;
+			}
+		}
+		inputs.push_back(std::move(input));
+	}
+
+	camux::WorkStealingPool pool(threads);
+	// Each chunk runs on one core; OpenCV's own threads would only fight the pool's.
+	if (pool.getThreads() > 1) cv::setNumThreads(1);
+	std::printf("%zu inputs, %zu chunks, %d threads\n", inputs.size(), chunks.size(), pool.getThreads());
+
+	// One pipeline per thread, made by its first chunk.
+	std::vector<std::unique_ptr<Pipeline>> pipelines(pool.getThreads());
+
+	int64_t start_us = camux::steadyMicros();
+	pool.run(chunks.size(), [&](size_t i, int thread) {
+		Chunk &chunk = chunks[i];
+		Input &input = *chunk.input;
+		// A bad chunk fails its input, not the batch. The input's other chunks still count down, so
+		// the last of them reports it.
+		try {
+			if (!input.failed) {
+				std::unique_ptr<Pipeline> &pipeline = pipelines[thread];
+				if (!pipeline) {
+					pipeline.reset(new Pipeline(HaarCascade));
+					pipeline->setInputMode(input_mode);
+					// The pool already has every core busy.
+					pipeline->getEyePair().setConcurrent(false);
+				}
+				run_chunk(chunk, *pipeline);
+			}
+		} catch (const std::exception &e) {
+			std::fprintf(stderr, "%s, chunk at frame %llu: %s\n", input.path.c_str(), (unsigned long long) chunk.first, e.what());
+			input.failed = true;
+		}
+
+		if (--input.remaining > 0) return;
+		if (input.failed) {
+			std::fprintf(stderr, "Could not read %s\n", input.path.c_str());
+			return;
+		}
+		finish_track(input);
+		if (!input.track.save(input.out)) {
+			std::fprintf(stderr, "Could not write %s\n", input.out.c_str());
+			input.failed = true;
+			return;
+		}
+		std::printf("%s -> %s (%llu frames)\n", input.path.c_str(), input.out.c_str(), (unsigned long long) input.track.size());
+	});
+	double seconds = (camux::steadyMicros() - start_us) / 1e6;
+
+	uint64_t total_frames = 0;
+	for (size_t i = 0; i < inputs.size(); ++i) {
+		if (inputs[i]->failed) failed = true;
+		else total_frames += inputs[i]->track.size();
+	}
+	std::printf("%llu frames in %.1f s (%.0f fps), %llu chunks stolen\n", (unsigned long long) total_frames, seconds,
+				seconds > 0 ? total_frames / seconds : 0.0, (unsigned long long) pool.getSteals());
+	return failed ? 1 : 0;
+}
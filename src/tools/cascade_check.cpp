@@ -0,0 +1,165 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_cascade_check: Check that a compiled binary cascade (camux::BinaryCascade) finds what
+// cv::CascadeClassifier finds with the XML it was compiled from, frame for frame.
+//
+// Usage: eye_mouse_cascade_check <CASCADE.xml> <CASCADE.bin> [INPUT...]
+//   CASCADE.xml  An OpenCV Haar cascade, e.g data/haarcascades/haarcascade_eye.xml
+//   CASCADE.bin  The same cascade compiled with eye_mouse_cascade_compile
+//   INPUT        Frame archives recorded with eye_mouse --record, or any video OpenCV can read, to
+//                check on (at most 300 frames of each). Always checked on synthetic faces (see
+//                camux::SyntheticSource) and noise too.
+//
+// Every frame is searched with about the parameters HaarBackend uses for faces and for eyes, and
+// with no grouping (min_neighbors 0), which compares every window that passed the cascade. The
+// detections must be the same rectangles in the same order (HaarBackend takes the first face), with
+// the same reject levels, and weights within a float rounding. Exits 1 on any mismatch.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/Cascade.h"
+#include "../camux/FrameArchive.h"
+#include "../camux/SyntheticSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+#include <opencv2/videoio.hpp>
+
+// Frames checked per input, so a long recording doesn't take all day.
+const int MAX_INPUT_FRAMES = 300;
+// Synthetic frames (the gaze swept across the eye) and noise frames.
+const int SYNTHETIC_FRAMES = 20;
+const int NOISE_FRAMES = 5;
+// How far (relatively) a detection's weight may be from OpenCV's: both sum floats, maybe in a
+// different order.
+const double WEIGHT_TOLERANCE = 1e-4;
+
+// A detectMultiScale call to compare.
+struct Search {
+	const char *name;
+	double scale_factor;
+	int min_neighbors;
+	cv::Size min_size, max_size;
+};
+
+// Raw windows, then roughly HaarBackend's face search and eye search (at 640x480).
+const Search SEARCHES[] = {
+	{ "raw", 1.1, 0, cv::Size(), cv::Size() },
+	{ "face", 1.1, 2, cv::Size(120, 120), cv::Size() },
+	{ "eye", 1.1, 3, cv::Size(20, 20), cv::Size(80, 80) },
+};
+
+static bool same_weight(double a, double b) {
+	return std::fabs(a - b) <= WEIGHT_TOLERANCE * std::max(1.0, std::max(std::fabs(a), std::fabs(b)));
+}
+
+// Check one frame with every search. Returns whether they all matched.
+static bool check(const std::string &name, const cv::Mat &frame, camux::Cascade &xml, camux::Cascade &binary, int &detections) {
+	cv::Mat gray;
+	if (frame.channels() == 1) gray = frame;
+	else cv::cvtColor(frame, gray, cv::COLOR_BGR2GRAY);
+
+	bool matched = true;
+	for (size_t s = 0; s < sizeof(SEARCHES) / sizeof(SEARCHES[0]); ++s) {
+		const Search &search = SEARCHES[s];
+		std::vector<cv::Rect> xml_objects, binary_objects, xml_plain, binary_plain;
+		std::vector<int> xml_levels, binary_levels;
+		std::vector<double> xml_weights, binary_weights;
+
+		xml.detectMultiScale(gray, xml_objects, xml_levels, xml_weights, search.scale_factor, search.min_neighbors,
+							 search.min_size, search.max_size);
+		binary.detectMultiScale(gray, binary_objects, binary_levels, binary_weights, search.scale_factor,
+								search.min_neighbors, search.min_size, search.max_size);
+		xml.detectMultiScale(gray, xml_plain, search.scale_factor, search.min_neighbors, search.min_size, search.max_size);
+		binary.detectMultiScale(gray, binary_plain, search.scale_factor, search.min_neighbors, search.min_size, search.max_size);
+		detections += (int) xml_objects.size() + (int) xml_plain.size();
+
+		std::string bad;
+		if (xml_objects != binary_objects) bad += " rects";
+		if (xml_plain != binary_plain) bad += " rects(no levels)";
+		if (xml_levels != binary_levels) bad += " levels";
+		bool weights_match = xml_weights.size() == binary_weights.size();
+		for (size_t i = 0; weights_match && i < xml_weights.size(); ++i) {
+			weights_match = same_weight(xml_weights[i], binary_weights[i]);
+		}
+		if (!weights_match) bad += " weights";
+
+		if (!bad.empty()) {
+			std::printf("MISMATCH %s %s:%s (xml %zu, binary %zu detections)\n", name.c_str(), search.name, bad.c_str(),
+						xml_objects.size(), binary_objects.size());
+			matched = false;
+		}
+	}
+	return matched;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 3) {
+		std::fprintf(stderr, "Usage: %s <CASCADE.xml> <CASCADE.bin> [INPUT...]\n", argv[0]);
+		return -1;
+	}
+
+	camux::Cascade xml, binary;
+	if (!xml.load(argv[1]) || xml.empty() || xml.isBinary()) {
+		std::fprintf(stderr, "Could not load %s as an OpenCV cascade\n", argv[1]);
+		return -1;
+	}
+	if (!binary.load(argv[2]) || binary.empty() || !binary.isBinary()) {
+		std::fprintf(stderr, "Could not load %s as a binary cascade (it must end in .bin)\n", argv[2]);
+		return -1;
+	}
+
+	int checks = 0, failures = 0, detections = 0;
+	bool unreadable = false;
+	camux::Frame frame;
+
+	camux::SyntheticSource synthetic(cv::Size(640, 480), 0);
+	for (int i = 0; i < SYNTHETIC_FRAMES; ++i) {
+		double t = (double) i / (SYNTHETIC_FRAMES - 1);
+		synthetic.setGaze(cv::Point2f((float) (2 * t - 1), (float) std::sin(6.28 * t) / 2));
+		if (!synthetic.read(frame)) break;
+		failures += !check("synthetic " + std::to_string(i), frame.image, xml, binary, detections);
+		++checks;
+	}
+
+	cv::RNG rng(1);
+	for (int i = 0; i < NOISE_FRAMES; ++i) {
+		cv::Mat noise(480, 640, CV_8UC1);
+		rng.fill(noise, cv::RNG::UNIFORM, 0, 256);
+		// Blurred to varying degrees, so some windows pass the first stages.
+		if (i > 0) cv::GaussianBlur(noise, noise, cv::Size(), 2.0 * i);
+		failures += !check("noise " + std::to_string(i), noise, xml, binary, detections);
+		++checks;
+	}
+
+	for (int a = 3; a < argc; ++a) {
+		std::string path = argv[a];
+		camux::FrameArchiveReader archive;
+		cv::VideoCapture video;
+		size_t frames = MAX_INPUT_FRAMES;
+		if (archive.open(path)) {
+			frames = std::min(frames, archive.size());
+		} else if (!video.open(path)) {
+			std::fprintf(stderr, "Could not open %s\n", path.c_str());
+			unreadable = true;
+			continue;
+		}
+
+		cv::Mat image;
+		for (size_t i = 0; i < frames; ++i) {
+			if (archive.size()) image = archive.frame(i);
+			else if (!video.read(image)) break;
+			failures += !check(path + " frame " + std::to_string(i), image, xml, binary, detections);
+			++checks;
+		}
+	}
+
+	std::printf("%d of %d frames matched (%d detections compared)\n", checks - failures, checks, detections);
+	if (detections == 0) std::printf("Nothing was detected; pass recordings of faces to check on\n");
+	return failures || unreadable ? 1 : 0;
+}
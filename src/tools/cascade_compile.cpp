@@ -0,0 +1,101 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_cascade_compile: Compile an OpenCV Haar cascade (XML) to the binary cascade format
+// eye_mouse memory-maps at startup, then time loading both and running a first detection with each.
+//
+// Usage: eye_mouse_cascade_compile <IN.xml> <OUT.bin> [RUNS]
+//   IN.xml   An OpenCV Haar cascade, e.g data/haarcascades/haarcascade_frontalface_alt.xml
+//   OUT.bin  Where to write the compiled cascade. eye_mouse looks for it next to the XML, with
+//            the same name and a .bin extension.
+//   RUNS     How many times to load each format for the timing (default 10)
+//
+// Load times are the mean over RUNS loads, so the second and later runs come from the page cache;
+// the first line shows the cold(ish) first load of each. Mapping the binary cascade reads none of
+// it: its pages fault in on the first detection instead, so each load is timed both on its own and
+// with a first detectMultiScale on a fixed 640x480 frame, which is what startup really pays.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/Cascade.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <opencv2/imgproc.hpp>
+
+struct LoadTime {
+	// Milliseconds to load, and to load and run the first detection; load_ms is -1 if it didn't load.
+	double load_ms;
+	double first_detect_ms;
+};
+
+// Load a cascade and run it once on frame.
+static LoadTime time_load(const std::string& path, const cv::Mat& frame) {
+	auto start = std::chrono::steady_clock::now();
+	camux::Cascade cascade;
+	bool loaded = cascade.load(path);
+	auto end_load = std::chrono::steady_clock::now();
+
+	std::vector<cv::Rect> objects;
+	if (loaded && !cascade.empty()) cascade.detectMultiScale(frame, objects, 1.1, 3, cv::Size());
+	auto end_detect = std::chrono::steady_clock::now();
+
+	LoadTime time;
+	time.load_ms = !loaded || cascade.empty() ? -1 : std::chrono::duration<double, std::milli>(end_load - start).count();
+	time.first_detect_ms = std::chrono::duration<double, std::milli>(end_detect - start).count();
+	return time;
+}
+
+int main(int argc, char** argv) {
+	if (argc < 3) {
+		std::fprintf(stderr, "Usage: %s <IN.xml> <OUT.bin> [RUNS]\n", argv[0]);
+		return 1;
+	}
+
+	std::string xml = argv[1];
+	std::string binary = argv[2];
+	int runs = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+
+	if (!camux::BinaryCascade::compile(xml, binary)) {
+		std::fprintf(stderr, "Could not compile %s (is it an OpenCV Haar cascade?)\n", xml.c_str());
+		return 1;
+	}
+
+	// Blurred noise, the same every run, so the first detection walks a good part of the cascade.
+	cv::Mat frame(480, 640, CV_8UC1);
+	cv::RNG rng(1);
+	rng.fill(frame, cv::RNG::UNIFORM, 0, 256);
+	cv::GaussianBlur(frame, frame, cv::Size(), 2);
+
+	LoadTime first_xml = time_load(xml, frame);
+	LoadTime first_binary = time_load(binary, frame);
+	if (first_xml.load_ms < 0 || first_binary.load_ms < 0) {
+		std::fprintf(stderr, "Could not load %s back\n", first_xml.load_ms < 0 ? xml.c_str() : binary.c_str());
+		return 1;
+	}
+
+	LoadTime xml_mean = { 0, 0 }, binary_mean = { 0, 0 };
+	for (int i = 0; i < runs; ++i) {
+		LoadTime x = time_load(xml, frame), b = time_load(binary, frame);
+		xml_mean.load_ms += x.load_ms / runs;
+		xml_mean.first_detect_ms += x.first_detect_ms / runs;
+		binary_mean.load_ms += b.load_ms / runs;
+		binary_mean.first_detect_ms += b.first_detect_ms / runs;
+	}
+
+	std::printf("%s -> %s\n", xml.c_str(), binary.c_str());
+	std::printf("first load: xml %.3f ms, binary %.3f ms\n", first_xml.load_ms, first_binary.load_ms);
+	std::printf("first load + detect: xml %.3f ms, binary %.3f ms\n", first_xml.first_detect_ms,
+	            first_binary.first_detect_ms);
+	std::printf("mean of %d load: xml %.3f ms, binary %.3f ms (%.0fx)\n", runs, xml_mean.load_ms, binary_mean.load_ms,
+	            binary_mean.load_ms > 0 ? xml_mean.load_ms / binary_mean.load_ms : 0.0);
+	std::printf("mean of %d load + detect: xml %.3f ms, binary %.3f ms (%.1fx)\n", runs, xml_mean.first_detect_ms,
+	            binary_mean.first_detect_ms,
+	            binary_mean.first_detect_ms > 0 ? xml_mean.first_detect_ms / binary_mean.first_detect_ms : 0.0);
+
+	return 0;
+}
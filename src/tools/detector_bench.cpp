@@ -0,0 +1,189 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_detector_bench_<backend>: What a build with only one face detection backend costs: binary
+// size, the memory the detector takes, and per-frame latency of the compile-time specialized
+// FaceEyeDetectorT<Backend> next to the runtime FaceEyeDetector running the same method.
+//
+// Usage: eye_mouse_detector_bench_<backend> [ARCHIVE_OR_VIDEO] [MAX_FRAMES]
+//   ARCHIVE_OR_VIDEO  A frame archive recorded with eye_mouse --record, or any video OpenCV can read.
+//                     Without one, frames of a synthetic face are used.
+//   MAX_FRAMES        How many frames to run each detector on (default 300)
+//
+// Each variant (haar, dnn, dlib) is built from the same source with only its backend compiled in
+// (see BENCH_BACKEND and the EYEMOUSE_WITH_* definitions in CMakeLists.txt); eye_mouse_detector_bench
+// is the Haar backend in a build with all of them, for comparison. Binary size is the executable's
+// own, then with the shared libraries it has mapped. RSS is how much the resident set grew
+// constructing the detector (loading its models). Latencies are reported for both trackFace() (optical
+// flow between detections, what eye_mouse runs) and detectFace() (the detector on every frame).
+// Run from the directory with the model files, like eye_mouse.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../FaceEyeDetector.h"
+#include "../camux/FrameArchive.h"
+#include "../camux/LatencyHistogram.h"
+#include "../camux/SyntheticSource.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <opencv2/videoio.hpp>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifndef BENCH_BACKEND
+#define BENCH_BACKEND HaarBackend
+#endif
+
+#define BENCH_STRING(x) #x
+#define BENCH_NAME(x) BENCH_STRING(x)
+
+// Frames run before timing each detector, so one-off allocations don't count.
+const int WARMUP_FRAMES = 5;
+
+static std::vector<cv::Mat> load_frames(const std::string &path, size_t max_frames) {
+	std::vector<cv::Mat> frames;
+
+	camux::FrameArchiveReader archive;
+	if (archive.open(path)) {
+		for (size_t i = 0; i < archive.size() && frames.size() < max_frames; ++i) {
+			frames.push_back(archive.frame(i).clone());
+		}
+		return frames;
+	}
+
+	cv::VideoCapture video(path);
+	cv::Mat frame;
+	while (frames.size() < max_frames && video.read(frame)) {
+		frames.push_back(frame.clone());
+	}
+	return frames;
+}
+
+static std::vector<cv::Mat> synthetic_frames(size_t count) {
+	std::vector<cv::Mat> frames;
+	camux::SyntheticSource source(cv::Size(640, 480), 0);
+	camux::Frame frame;
+
+	// Look around a little, so optical flow has something to follow.
+	for (size_t i = 0; i < count && source.read(frame); ++i) {
+		source.setGaze(cv::Point2f(std::sin(i * .1f) * .6f, std::cos(i * .07f) * .4f));
+		frames.push_back(frame.image.clone());
+	}
+	return frames;
+}
+
+static off_t file_size(const std::string &path) {
+	struct stat st;
+	return stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+}
+
+// The shared libraries this process has mapped.
+static std::set<std::string> mapped_libraries() {
+	std::set<std::string> libraries;
+	std::ifstream maps("/proc/self/maps");
+	std::string line;
+	while (std::getline(maps, line)) {
+		size_t slash = line.find('/');
+		if (slash == std::string::npos) continue;
+		std::string path = line.substr(slash);
+		if (path.find(".so") != std::string::npos) libraries.insert(path);
+	}
+	return libraries;
+}
+
+static double rss_mb() {
+	long pages = 0, resident = 0;
+	std::ifstream statm("/proc/self/statm");
+	statm >> pages >> resident;
+	return resident * (double) sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+/**
+ * Run a detector's trackFace() or detectFace() over every frame, returning the latencies.
+ */
+template <class FaceDetector>
+static camux::LatencyHistogram run(FaceDetector &detector, std::vector<cv::Mat> &frames, bool track, size_t &found) {
+	camux::LatencyHistogram histogram;
+	found = 0;
+
+	for (int i = 0; i < WARMUP_FRAMES && i < (int) frames.size(); ++i) {
+		track ? detector.trackFace(frames[i]) : detector.detectFace(frames[i]);
+	}
+	detector.reset();
+
+	for (size_t i = 0; i < frames.size(); ++i) {
+		int64_t begin = camux::steadyMicros();
+		if (track) {
+			detector.trackFace(frames[i]);
+		} else {
+			detector.detectFace(frames[i]);
+		}
+		histogram.add(camux::steadyMicros() - begin);
+		found += detector.foundFace();
+	}
+	return histogram;
+}
+
+template <class FaceDetector>
+static void report(const char *name, FaceDetector &detector, std::vector<cv::Mat> &frames) {
+	const char *modes[] = { "trackFace", "detectFace" };
+	for (int m = 0; m < 2; ++m) {
+		size_t found;
+		camux::LatencyHistogram histogram = run(detector, frames, m == 0, found);
+		std::printf("%-18s %-11s %10.3f %10.3f %10.3f %7zu/%zu\n", name, modes[m], histogram.mean() / 1000,
+					histogram.percentile(.5) / 1000.0, histogram.percentile(.99) / 1000.0, found, frames.size());
+	}
+}
+
+int main(int argc, char **argv) {
+	if (argc > 3) {
+		std::cerr << "Usage: " << argv[0] << " [ARCHIVE_OR_VIDEO] [MAX_FRAMES]" << std::endl;
+		return -1;
+	}
+	size_t max_frames = argc == 3 ? std::atoi(argv[2]) : 300;
+
+	std::vector<cv::Mat> frames = argc > 1 ? load_frames(argv[1], max_frames) : synthetic_frames(max_frames);
+	if (frames.empty()) {
+		std::cerr << "No frames in " << argv[1] << std::endl;
+		return -1;
+	}
+
+	std::printf("backend %s (built with dnn %d, dlib %d), %zu frames\n\n", BENCH_NAME(BENCH_BACKEND),
+				EYEMOUSE_WITH_DNN, EYEMOUSE_WITH_DLIB, frames.size());
+
+	camux::Face face;
+	camux::Eye left_eye, right_eye;
+
+	double rss_before = rss_mb();
+	FaceEyeDetectorT<BENCH_BACKEND> specialized(face, left_eye, right_eye);
+	double rss_specialized = rss_mb();
+	FaceEyeDetector runtime(BENCH_BACKEND::method, face, left_eye, right_eye);
+	double rss_runtime = rss_mb();
+
+	// Only now are the libraries the backends load lazily (if any) mapped.
+	std::set<std::string> libraries = mapped_libraries();
+	off_t library_bytes = 0;
+	for (std::set<std::string>::const_iterator it = libraries.begin(); it != libraries.end(); ++it) {
+		library_bytes += file_size(*it);
+	}
+	off_t exe_bytes = file_size("/proc/self/exe");
+
+	std::printf("binary            %10.2f MB\n", exe_bytes / 1048576.0);
+	std::printf("  + %3zu libraries %10.2f MB\n", libraries.size(), (exe_bytes + library_bytes) / 1048576.0);
+	std::printf("rss at start      %10.2f MB\n", rss_before);
+	std::printf("  specialized     %+10.2f MB\n", rss_specialized - rss_before);
+	std::printf("  runtime         %+10.2f MB\n\n", rss_runtime - rss_specialized);
+
+	std::printf("%-18s %-11s %10s %10s %10s %9s\n", "detector", "call", "mean ms", "p50 ms", "p99 ms", "found");
+	report("specialized", specialized, frames);
+	report("runtime", runtime, frames);
+	return 0;
+}
@@ -0,0 +1,159 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_dnn_bench: Compare latency and recall of the OpenCV_DNN face detector across inference
+// settings (input size, weight precision, thread count) on this machine's CPU.
+//
+// Usage: eye_mouse_dnn_bench <ARCHIVE_OR_VIDEO> [MAX_FRAMES]
+//   ARCHIVE_OR_VIDEO  A frame archive recorded with eye_mouse --record, or any video OpenCV can read
+//   MAX_FRAMES        How many frames to run each setting on (default 300)
+//
+// Recall is measured against the reference setting (300x300, FP32 weights, default threads): the
+// fraction of frames where the reference found a face that the setting also found, with an
+// intersection over union of at least 0.5. Settings whose model files are missing are skipped.
+// Run from the directory with the model files, like eye_mouse.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../FaceEyeDetector.h"
+#include "../camux/FrameArchive.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <opencv2/videoio.hpp>
+
+// Frames run before timing each setting, so one-off allocations don't count.
+const int WARMUP_FRAMES = 5;
+const double MIN_IOU = 0.5;
+
+struct Result {
+	bool found;
+	cv::Rect face;
+};
+
+static std::vector<cv::Mat> load_frames(const std::string &path, size_t max_frames) {
+	std::vector<cv::Mat> frames;
+
+	camux::FrameArchiveReader archive;
+	if (archive.open(path)) {
+		for (size_t i = 0; i < archive.size() && frames.size() < max_frames; ++i) {
+			frames.push_back(archive.frame(i).clone());
+		}
+		return frames;
+	}
+
+	cv::VideoCapture video(path);
+	cv::Mat frame;
+	while (frames.size() < max_frames && video.read(frame)) {
+		frames.push_back(frame.clone());
+	}
+	return frames;
+}
+
+static double iou(const cv::Rect &a, const cv::Rect &b) {
+	double overlap = (a & b).area();
+	double total = a.area() + b.area() - overlap;
+	return total > 0 ? overlap / total : 0;
+}
+
+/**
+ * Run the detector over every frame, returning each frame's detection and filling in the per-frame
+ * latencies (microseconds).
+ */
+static std::vector<Result> run(FaceEyeDetector &detector, camux::Face &face, std::vector<cv::Mat> &frames,
+							   std::vector<double> &latencies) {
+	std::vector<Result> results;
+	latencies.clear();
+
+	for (int i = 0; i < WARMUP_FRAMES && i < (int) frames.size(); ++i) {
+		detector.detectFace(frames[i]);
+	}
+
+	for (size_t i = 0; i < frames.size(); ++i) {
+		std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+		detector.detectFace(frames[i]);
+		std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
+
+		latencies.push_back(std::chrono::duration_cast<std::chrono::microseconds>(end - begin).count());
+		Result result = { detector.foundFace(), face.getCoords() };
+		results.push_back(result);
+	}
+	return results;
+}
+
+static double percentile(std::vector<double> values, double p) {
+	if (values.empty()) return 0;
+	size_t k = std::min(values.size() - 1, (size_t) (p * values.size()));
+	std::nth_element(values.begin(), values.begin() + k, values.end());
+	return values[k];
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 3) {
+		std::cerr << "Usage: eye_mouse_dnn_bench <ARCHIVE_OR_VIDEO> [MAX_FRAMES]" << std::endl;
+		return -1;
+	}
+	size_t max_frames = argc == 3 ? std::atoi(argv[2]) : 300;
+
+	std::vector<cv::Mat> frames = load_frames(argv[1], max_frames);
+	if (frames.empty()) {
+		std::cerr << "No frames in " << argv[1] << std::endl;
+		return -1;
+	}
+
+	camux::Face face;
+	camux::Eye left_eye, right_eye;
+	FaceEyeDetector detector(OpenCV_DNN, face, left_eye, right_eye);
+
+	std::vector<double> latencies;
+	std::vector<Result> reference = run(detector, face, frames, latencies);
+	size_t reference_found = 0;
+	for (size_t i = 0; i < reference.size(); ++i) reference_found += reference[i].found;
+
+	std::printf("%zu frames, reference found a face in %zu\n\n", frames.size(), reference_found);
+	std::printf("%-6s %-5s %-8s %10s %10s %10s %8s\n", "input", "prec", "threads", "mean ms", "p50 ms", "p95 ms", "recall");
+
+	const int sizes[] = { 150, 200, 300 };
+	const DnnPrecision precisions[] = { DnnFP32, DnnFP16, DnnINT8 };
+	const char *precision_names[] = { "fp32", "fp16", "int8" };
+	const int threads[] = { 1, cv::getNumThreads() };
+
+	for (int p = 0; p < 3; ++p) {
+		for (int s = 0; s < 3; ++s) {
+			for (int t = 0; t < 2; ++t) {
+				DnnConfig config;
+				config.input_size = sizes[s];
+				config.precision = precisions[p];
+				config.threads = threads[t];
+
+				try {
+					detector.setDnnConfig(config);
+				} catch (const cv::Exception &) {
+					std::printf("%-6d %-5s %-8d %s\n", sizes[s], precision_names[p], threads[t], "model missing, skipped");
+					continue;
+				}
+
+				std::vector<Result> results = run(detector, face, frames, latencies);
+
+				size_t hits = 0;
+				for (size_t i = 0; i < results.size(); ++i) {
+					if (reference[i].found && results[i].found && iou(reference[i].face, results[i].face) >= MIN_IOU) ++hits;
+				}
+
+				double mean = 0;
+				for (size_t i = 0; i < latencies.size(); ++i) mean += latencies[i];
+				mean /= latencies.size();
+
+				std::printf("%-6d %-5s %-8d %10.2f %10.2f %10.2f %8.3f\n", sizes[s], precision_names[p], threads[t],
+							mean / 1000, percentile(latencies, .5) / 1000, percentile(latencies, .95) / 1000,
+							reference_found ? (double) hits / reference_found : 0.0);
+			}
+		}
+	}
+	return 0;
+}
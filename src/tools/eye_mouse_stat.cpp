@@ -0,0 +1,109 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_stat: Show the live stats of a running eye_mouse, refreshed like top.
+//
+// Usage: eye_mouse_stat [-n <SECONDS>] [-1]
+//   -n  Refresh interval (default 1 second)
+//   -1  Print the stats once and exit
+//
+// Reads the shared memory segment eye_mouse publishes to (see camux/Stats.h). Never blocks the
+// tracker: if we catch it mid-update we just read again.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/Stats.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#include <signal.h>
+
+static const char *tracking_state_name(int32_t state) {
+	switch (state) {
+		case camux::NoFace:
+			return "no face";
+		case camux::Detecting:
+			return "detecting";
+		case camux::Tracking:
+			return "tracking";
+		case camux::Idle:
+			return "idle";
+	}
+	return "unknown";
+}
+
+static void print_stats(const camux::Stats &s) {
+	int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+						std::chrono::steady_clock::now().time_since_epoch()).count();
+	double uptime = (s.update_us - s.start_us) / 1e6;
+	double age = (now_us - s.update_us) / 1e6;
+
+	std::printf("eye_mouse (pid %d)  up %.0f s  last update %.1f s ago\n\n", s.pid, uptime, age);
+	std::printf("  state            %s%s\n", tracking_state_name(s.tracking_state), s.calibrated ? ", calibrated" : "");
+	std::printf("  fps              %8.1f\n", s.fps);
+	std::printf("  model load       %8.1f ms\n\n", s.model_load_ms);
+
+	std::printf("  cpu per hour     %8s\n", "s");
+	std::printf("    present        %8.0f\n", s.present_cpu_s_per_h);
+	std::printf("    absent         %8.0f\n\n", s.absent_cpu_s_per_h);
+
+	std::printf("  latency (avg)    %8s\n", "us");
+	std::printf("    detect         %8.0f\n", s.detect_us);
+	std::printf("    forehead       %8.0f\n", s.forehead_us);
+	std::printf("    pupil          %8.0f\n", s.pupil_us);
+	std::printf("      both eyes    %8.0f  (left %.0f, right %.0f)\n", s.pupils_us, s.left_pupil_us, s.right_pupil_us);
+	std::printf("    frame          %8.0f  (max %.0f)\n\n", s.frame_us, s.max_frame_us);
+
+	std::printf("  pupil search\n");
+	std::printf("    warm hits      %8.1f %%\n", s.pupil_warm_hit_rate * 100);
+	std::printf("    speedup        %8.2f x\n\n", s.pupil_search_speedup);
+
+	std::printf("  frames           %8llu\n", (unsigned long long) s.frames);
+	std::printf("  dropped          %8llu\n", (unsigned long long) s.dropped_frames);
+	std::printf("  late             %8llu\n", (unsigned long long) s.late_frames);
+	std::printf("  detector runs    %8llu\n", (unsigned long long) s.detector_runs);
+	std::printf("  faces lost       %8llu\n", (unsigned long long) s.faces_lost);
+	std::printf("  blinks           %8llu\n", (unsigned long long) s.blinks);
+	std::fflush(stdout);
+}
+
+int main(int argc, char **argv) {
+	double interval = 1;
+	bool once = false;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "-n" && i + 1 < argc) {
+			interval = std::atof(argv[++i]);
+		} else if (arg == "-1") {
+			once = true;
+		} else {
+			std::cerr << "Usage: eye_mouse_stat [-n <SECONDS>] [-1]" << std::endl;
+			return -1;
+		}
+	}
+
+	camux::StatsReader reader;
+	camux::Stats stats;
+
+	while (true) {
+		// (Re)attach if eye_mouse wasn't running or has restarted.
+		bool ok = (reader.read(stats) && kill(stats.pid, 0) == 0) ||
+				  (reader.open() && reader.read(stats));
+
+		if (!once) std::printf("\033[H\033[2J");
+		if (ok) {
+			print_stats(stats);
+		} else {
+			std::printf("eye_mouse is not running\n");
+			std::fflush(stdout);
+		}
+
+		if (once) return ok ? 0 : 1;
+		std::this_thread::sleep_for(std::chrono::milliseconds((int) (interval * 1000)));
+	}
+}
@@ -0,0 +1,163 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_loopback: Measure eye_mouse's motion-to-cursor latency with no camera, person or
+// display. A synthetic face whose eyes look where we tell them is fed through the same Pipeline
+// eye_mouse runs, into a cursor that records when it moved.
+//
+// Usage: eye_mouse_loopback [FRAMES] [MAX_P99_MS]
+//   FRAMES      How many frames to measure over, at 30 fps (default 600)
+//   MAX_P99_MS  Fail (exit 1) if the p99 motion-to-cursor latency is above this many milliseconds
+//
+// It first calibrates the gaze mapper on the synthetic face with the usual multi-point calibration,
+// then has the eyes jump back and forth across the screen. Two latencies are reported:
+//   capture to cursor   For every frame, from the frame's capture to its cursor move.
+//   motion to cursor    For every jump, from the capture of the first frame showing it to the first
+//                       cursor move that's closer to the new target than the old one. This is what
+//                       a user feels.
+// Exits 2 if the pipeline never finds the synthetic face or can't calibrate on it. Run from the
+// directory with the model files, like eye_mouse.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../Pipeline.h"
+#include "../camux/Cursor.h"
+#include "../camux/LatencyHistogram.h"
+#include "../camux/SyntheticSource.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+const double FPS = 30;
+const cv::Size SCREEN(1920, 1080);
+
+// Frames to wait for the pipeline to find the face before giving up.
+const int ACQUIRE_FRAMES = 90;
+// Samples per calibration target, and how long the whole calibration may take.
+const int CALIBRATION_SAMPLES = 10;
+const int MAX_CALIBRATION_FRAMES = 1000;
+// Frames between jumps, and where the eyes jump between (see SyntheticSource::setGaze()).
+const int JUMP_FRAMES = 15;
+const float JUMP_GAZE = .6f;
+
+/**
+ * A cursor that just remembers where and when it was last moved.
+ */
+class RecordingCursor : public camux::CursorSink {
+public:
+	bool move(const cv::Point &screen) override {
+		position = screen;
+		moved_us = camux::steadyMicros();
+		return true;
+	}
+
+	cv::Point position;
+	int64_t moved_us = 0;
+};
+
+// The gaze that looks at a point on the screen, if the synthetic eyes mapped linearly to it.
+static cv::Point2f gaze_for(const cv::Point2f &screen) {
+	return cv::Point2f(screen.x / SCREEN.width * 2 - 1, screen.y / SCREEN.height * 2 - 1);
+}
+
+int main(int argc, char **argv) {
+	int frames = argc > 1 ? std::atoi(argv[1]) : 600;
+	double max_p99_ms = argc > 2 ? std::atof(argv[2]) : 0;
+	if (frames <= 0) {
+		std::fprintf(stderr, "Usage: %s [FRAMES] [MAX_P99_MS]\n", argv[0]);
+		return 1;
+	}
+
+	camux::SyntheticSource source(cv::Size(640, 480), FPS);
+	Pipeline pipeline(HaarCascade);
+	RecordingCursor cursor;
+
+	camux::Frame frame;
+	camux::GazeSample sample;
+
+	// 1. Find the face.
+	source.setGaze(cv::Point2f(0, 0));
+	int acquired = 0;
+	for (; acquired < ACQUIRE_FRAMES; ++acquired) {
+		source.read(frame);
+		pipeline.process(frame, sample);
+		if (sample.face_found && sample.has_offset) break;
+	}
+	if (acquired == ACQUIRE_FRAMES) {
+		std::fprintf(stderr, "The pipeline didn't find the synthetic face (and forehead dot) in %d frames\n",
+					 ACQUIRE_FRAMES);
+		return 2;
+	}
+
+	// 2. Calibrate, looking at each target in turn.
+	camux::GazeCalibration calibration(SCREEN, 3, 3, CALIBRATION_SAMPLES);
+	calibration.start();
+	for (int i = 0; i < MAX_CALIBRATION_FRAMES && calibration.isRunning(); ++i) {
+		source.setGaze(gaze_for(calibration.getTarget()));
+		source.read(frame);
+		pipeline.process(frame, sample);
+		if (sample.has_offset) calibration.addSample(sample.gaze_offset);
+	}
+	if (calibration.isRunning() || !calibration.apply(pipeline.getGazeMapper())) {
+		std::fprintf(stderr, "Could not calibrate on the synthetic face\n");
+		return 2;
+	}
+
+	// 3. Jump the eyes back and forth and time the cursor following them.
+	camux::LatencyHistogram capture_to_cursor, motion_to_cursor;
+	cv::Point2f targets[2] = { cv::Point2f(SCREEN.width * (1 - JUMP_GAZE) / 2, SCREEN.height / 2.f),
+							   cv::Point2f(SCREEN.width * (1 + JUMP_GAZE) / 2, SCREEN.height / 2.f) };
+	int side = 0, jumps = 0, missed = 0, lost = 0;
+	bool pending = false;
+	int64_t jump_us = 0;
+	double error = 0;
+	int error_samples = 0;
+
+	for (int i = 0; i < frames; ++i) {
+		if (i % JUMP_FRAMES == 0) {
+			if (pending) ++missed;
+			side = 1 - side;
+			source.setGaze(gaze_for(targets[side]));
+			pending = i > 0;
+			jumps += pending;
+		}
+
+		source.read(frame);
+		if (i % JUMP_FRAMES == 0) jump_us = frame.capture_us;
+
+		pipeline.process(frame, sample);
+		if (!sample.gaze_valid) {
+			++lost;
+			continue;
+		}
+
+		cursor.move(cv::Point(cvRound(sample.gaze.x), cvRound(sample.gaze.y)));
+		capture_to_cursor.add(cursor.moved_us - frame.capture_us);
+
+		cv::Point2f at(cursor.position);
+		double to_new = cv::norm(at - targets[side]);
+		if (pending && to_new < cv::norm(at - targets[1 - side])) {
+			motion_to_cursor.add(cursor.moved_us - jump_us);
+			pending = false;
+		}
+
+		// Accuracy over the second half of each fixation, once the cursor has settled.
+		if (i % JUMP_FRAMES >= JUMP_FRAMES / 2) {
+			error += to_new;
+			++error_samples;
+		}
+	}
+	if (pending) ++missed;
+
+	std::printf("frames:            %d (%d without a gaze point)\n", frames, lost);
+	std::printf("capture to cursor: %s\n", capture_to_cursor.summary().c_str());
+	std::printf("motion to cursor:  %s\n", motion_to_cursor.summary().c_str());
+	std::printf("jumps followed:    %d of %d\n", jumps - missed, jumps);
+	if (error_samples) std::printf("settled error:     %.1f px\n", error / error_samples);
+
+	if (max_p99_ms > 0 && (motion_to_cursor.count() == 0 || motion_to_cursor.percentile(.99) > max_p99_ms * 1000)) {
+		std::fprintf(stderr, "p99 motion to cursor latency is over %.1f ms\n", max_p99_ms);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,351 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// camux_microbench: Fixed-input microbenchmarks of the tracker's kernels, with warm and cold caches,
+// written as JSON that can be stored and compared against later runs.
+//
+// Usage: camux_microbench [--baseline FILE] [--tolerance FRACTION] [--output FILE] [--runs N]
+//   --baseline   JSON written by an earlier run. Kernels whose median (warm or cold) got more than
+//                FRACTION slower are listed under "regressions", and the exit code is 1.
+//   --tolerance  How much slower counts as a regression (default 0.15, i.e 15%)
+//   --output     Also write the JSON to FILE, e.g to store it as the next baseline
+//   --runs       Timed runs per kernel and cache state (default 51)
+//
+// Every kernel runs on the same input every time: points from a fixed seed, and a frame of
+// camux::SyntheticSource's face with its eye and face crops. Warm runs follow each other back to
+// back (after WARMUP_RUNS untimed ones), so the kernel's code and data stay cached. Before each cold
+// run a buffer bigger than the last level cache is streamed through, so the run fetches everything
+// from memory. Times are nanoseconds per call: the median, which the baseline comparison uses, and
+// the fastest run. OpenCV is held to one thread so the numbers don't depend on the core count.
+//
+// The Haar kernel needs the cascade files and is skipped without them; run from the directory with
+// the model files, like eye_mouse.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../DetectorBackends.h"
+#include "../Pipeline.h"
+#include "../camux/Eye.h"
+#include "../camux/EyePreprocessor.h"
+#include "../camux/ResolutionController.h"
+#include "../camux/SyntheticSource.h"
+#include "../camux/ThresholdController.h"
+#include "../camux/geometry.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <opencv2/core/utility.hpp>
+
+// Untimed runs before the warm ones.
+const int WARMUP_RUNS = 5;
+// Streamed through before each cold run: more than any last level cache we run on.
+const size_t EVICT_BYTES = 64 << 20;
+// Points the bounding rectangle kernels bound: as many as dlib's face landmarks.
+const int POINTS = 68;
+// Detections the eye pick chooses from: about what the eye cascade finds in a band of the face.
+const int EYE_DETECTIONS = 8;
+
+/**
+ * A kernel and how to run it on its fixed input.
+ */
+struct Kernel {
+	std::string name;
+	// Calls per warm run, so kernels much faster than the clock's resolution are timed over many.
+	// Cold runs are always one call: the second would find the cache warm.
+	int calls;
+	// Before every run, untimed: resets whatever state the kernel keeps between calls.
+	std::function<void()> setup;
+	std::function<void()> run;
+	// Why the kernel can't run here, if it can't.
+	std::string skipped;
+};
+
+struct Timing {
+	double median_ns;
+	double min_ns;
+};
+
+struct Baseline {
+	double warm_ns;
+	double cold_ns;
+};
+
+// Results go here so the compiler can't drop the kernels.
+static volatile int sink;
+
+static double now_ns() {
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void evict_caches() {
+	static std::vector<unsigned char> buffer(EVICT_BYTES);
+	// Write every line, so they're dirty and the cache has to write them back to make room.
+	for (size_t i = 0; i < buffer.size(); i += 64) ++buffer[i];
+	sink = buffer[EVICT_BYTES / 2];
+}
+
+static Timing summarize(std::vector<double> &ns) {
+	std::sort(ns.begin(), ns.end());
+	Timing timing = { ns[ns.size() / 2], ns[0] };
+	return timing;
+}
+
+static Timing time_warm(const Kernel &kernel, int runs) {
+	for (int i = 0; i < WARMUP_RUNS; ++i) {
+		kernel.setup();
+		kernel.run();
+	}
+
+	std::vector<double> ns;
+	for (int i = 0; i < runs; ++i) {
+		kernel.setup();
+		double start = now_ns();
+		for (int c = 0; c < kernel.calls; ++c) kernel.run();
+		ns.push_back((now_ns() - start) / kernel.calls);
+	}
+	return summarize(ns);
+}
+
+static Timing time_cold(const Kernel &kernel, int runs) {
+	std::vector<double> ns;
+	for (int i = 0; i < runs; ++i) {
+		kernel.setup();
+		evict_caches();
+		double start = now_ns();
+		kernel.run();
+		ns.push_back(now_ns() - start);
+	}
+	return summarize(ns);
+}
+
+/**
+ * Read the kernels' medians from JSON this program wrote: one kernel per line.
+ */
+static bool load_baseline(const std::string &path, std::map<std::string, Baseline> &baseline) {
+	FILE *file = std::fopen(path.c_str(), "r");
+	if (!file) return false;
+
+	char line[512];
+	while (std::fgets(line, sizeof(line), file)) {
+		char name[128];
+		Baseline b;
+		if (std::sscanf(line, " {\"name\": \"%127[^\"]\", \"calls\": %*d, \"warm_ns\": %lf, \"warm_min_ns\": %*f, \"cold_ns\": %lf",
+						name, &b.warm_ns, &b.cold_ns) == 3) {
+			baseline[name] = b;
+		}
+	}
+	std::fclose(file);
+	return true;
+}
+
+// s as a JSON string, quoted and escaped.
+static std::string json_string(const std::string &s) {
+	std::string json = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') {
+			json += '\\';
+			json += c;
+		} else if ((unsigned char) c < 0x20) {
+			char escape[8];
+			std::snprintf(escape, sizeof(escape), "\\u%04x", c);
+			json += escape;
+		} else {
+			json += c;
+		}
+	}
+	return json + "\"";
+}
+
+static cv::Mat eye_crop(const cv::Mat &frame, const cv::Rect &eye) {
+	// As the pipeline crops eyes for the localizer (see Pipeline::_cropEye()).
+	double scale = camux::ResolutionController::eyeScale(eye);
+	if (std::abs(scale - 1) < .05) return frame(eye).clone();
+
+	cv::Mat crop;
+	cv::resize(frame(eye), crop, cv::Size(), scale, scale, scale < 1 ? cv::INTER_AREA : cv::INTER_LINEAR);
+	return crop;
+}
+
+int main(int argc, char **argv) {
+	std::string baseline_file, output_file;
+	double tolerance = 0.15;
+	int runs = 51;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		if (arg == "--baseline" && i + 1 < argc) {
+			baseline_file = argv[++i];
+		} else if (arg == "--output" && i + 1 < argc) {
+			output_file = argv[++i];
+		} else if (arg == "--tolerance" && i + 1 < argc) {
+			tolerance = std::atof(argv[++i]);
+		} else if (arg == "--runs" && i + 1 < argc && std::atoi(argv[i + 1]) > 0) {
+			runs = std::atoi(argv[++i]);
+		} else {
+			std::fprintf(stderr, "Usage: %s [--baseline FILE] [--tolerance FRACTION] [--output FILE] [--runs N]\n", argv[0]);
+			return -1;
+		}
+	}
+
+	std::map<std::string, Baseline> baseline;
+	if (!baseline_file.empty() && !load_baseline(baseline_file, baseline)) {
+		std::fprintf(stderr, "Could not read baseline %s\n", baseline_file.c_str());
+		return -1;
+	}
+
+	cv::setNumThreads(1);
+
+	// The fixed inputs.
+	cv::RNG rng(42);
+	camux::Points points(POINTS);
+	for (cv::Point2u &p : points) p = cv::Point2u(rng.uniform(100, 540), rng.uniform(80, 400));
+
+	camux::SyntheticSource source(cv::Size(640, 480), 0);
+	source.setGaze(cv::Point2f(.3f, -.2f));
+	camux::Frame input;
+	source.read(input);
+	cv::Mat frame = input.image.clone();
+	cv::Mat face_crop = frame(source.getFace()).clone();
+	cv::Mat left_crop = eye_crop(frame, source.getLeftEye());
+
+	std::vector<Kernel> kernels;
+	auto none = [] {};
+
+	kernels.push_back({ "bounding_rect", 1000, none, [&] { sink = camux::boundingRect(points).width; }, "" });
+	kernels.push_back({ "bounding_rect_margin", 1000, none,
+						[&] { sink = camux::boundingRectMargin(points, .2f, .3f).width; }, "" });
+
+	// One eye's preprocessing, at the thresholds a fresh eye starts with.
+	camux::ThresholdController thresholds;
+	camux::EyePreprocessor preprocessor;
+	std::vector<camux::GradientSample> gradients;
+	kernels.push_back({ "eye_preprocess", 1, none, [&] {
+		preprocessor.run(left_crop, thresholds.getGradientThreshold(), thresholds.getDarkThreshold(), gradients);
+		sink = gradients.size();
+	}, "" });
+
+	// A fresh eye every run, so each is a full search from the same thresholds rather than a warm
+	// start from the last one.
+	std::unique_ptr<camux::Eye> eye;
+	cv::Mat eye_input;
+	kernels.push_back({ "find_pupil_center", 1, [&] {
+		eye.reset(new camux::Eye(camux::Left, source.getLeftEye()));
+		eye_input = left_crop.clone();
+	}, [&] { sink = eye->findPupilCenter(eye_input).x; }, "" });
+
+	// The face cascade, then each eye's cascade on its side of the face and the pick of its most
+	// confident detection (HaarBackend::_detectEye()), from no previous eyes. The cascades are
+	// nearly all of it; haar_eye_pick times the pick alone.
+	camux::Face haar_face;
+	camux::Eye haar_left, haar_right;
+	DetectorState state(haar_face, haar_left, haar_right);
+	state.width = frame.cols;
+	state.height = frame.rows;
+	HaarBackend haar;
+	haar.load();
+	kernels.push_back({ "haar_face_and_eyes", 1, [&] { state.found = false; }, [&] {
+		haar.detect(frame, state);
+		sink = state.found;
+	}, haar.isLoaded() ? "" : "no Haar cascades" });
+
+	// _detectEye()'s pick of the most confident eye detection that isn't the other eye, on fixed
+	// detections.
+	std::vector<cv::Rect> eye_detections;
+	std::vector<double> eye_weights;
+	for (int i = 0; i < EYE_DETECTIONS; ++i) {
+		int size = rng.uniform(30, 60);
+		eye_detections.push_back(cv::Rect(rng.uniform(0, 100), rng.uniform(0, 60), size, size));
+		eye_weights.push_back(rng.uniform(0.0, 4.0));
+	}
+	cv::Point eye_window(180, 150);
+	// The other eye, overlapping the first detection, so the overlap test runs and rejects one.
+	cv::Rect other_eye = eye_detections[0] + eye_window;
+	kernels.push_back({ "haar_eye_pick", 1000, none, [&] {
+		int best = HaarBackend::mostConfident(eye_detections, eye_weights, eye_window, other_eye);
+		sink = best < 0 ? 0 : (eye_detections[best] + eye_window).x;
+	}, "" });
+
+	// The HSV range, opening and contours of the forehead dot search.
+	Pipeline pipeline(HaarCascade);
+	cv::Rect dot;
+	kernels.push_back({ "forehead_dot", 1, none, [&] { sink = pipeline.findForeheadDot(face_crop, dot); }, "" });
+
+	// Measure everything before printing, so printing doesn't disturb the caches.
+	std::vector<Timing> warm(kernels.size()), cold(kernels.size());
+	for (size_t k = 0; k < kernels.size(); ++k) {
+		if (!kernels[k].skipped.empty()) continue;
+		warm[k] = time_warm(kernels[k], runs);
+		cold[k] = time_cold(kernels[k], runs);
+	}
+
+	std::string json = "{\n";
+	char buffer[512];
+	std::snprintf(buffer, sizeof(buffer), "  \"version\": 1,\n  \"opencv\": \"%s\",\n  \"runs\": %d,\n  \"kernels\": [\n",
+				  CV_VERSION, runs);
+	json += buffer;
+
+	std::string regressions;
+	for (size_t k = 0; k < kernels.size(); ++k) {
+		const Kernel &kernel = kernels[k];
+		const char *comma = k + 1 < kernels.size() ? "," : "";
+		if (!kernel.skipped.empty()) {
+			std::snprintf(buffer, sizeof(buffer), "    {\"name\": \"%s\", \"skipped\": \"%s\"}%s\n", kernel.name.c_str(),
+						  kernel.skipped.c_str(), comma);
+			json += buffer;
+			continue;
+		}
+
+		std::snprintf(buffer, sizeof(buffer),
+					  "    {\"name\": \"%s\", \"calls\": %d, \"warm_ns\": %.1f, \"warm_min_ns\": %.1f, \"cold_ns\": %.1f, "
+					  "\"cold_min_ns\": %.1f}%s\n",
+					  kernel.name.c_str(), kernel.calls, warm[k].median_ns, warm[k].min_ns, cold[k].median_ns,
+					  cold[k].min_ns, comma);
+		json += buffer;
+
+		std::map<std::string, Baseline>::const_iterator base = baseline.find(kernel.name);
+		if (base == baseline.end()) continue;
+
+		const char *states[] = { "warm", "cold" };
+		double ns[] = { warm[k].median_ns, cold[k].median_ns };
+		double base_ns[] = { base->second.warm_ns, base->second.cold_ns };
+		for (int s = 0; s < 2; ++s) {
+			if (ns[s] <= base_ns[s] * (1 + tolerance)) continue;
+
+			std::snprintf(buffer, sizeof(buffer),
+						  "%s    {\"name\": \"%s\", \"cache\": \"%s\", \"ns\": %.1f, \"baseline_ns\": %.1f, \"slowdown\": %.3f}",
+						  regressions.empty() ? "" : ",\n", kernel.name.c_str(), states[s], ns[s], base_ns[s], ns[s] / base_ns[s]);
+			regressions += buffer;
+		}
+	}
+	json += "  ]";
+
+	if (!baseline_file.empty()) {
+		json += ",\n  \"baseline\": " + json_string(baseline_file) + ",\n";
+		std::snprintf(buffer, sizeof(buffer), "  \"tolerance\": %g,\n", tolerance);
+		json += buffer;
+		json += "  \"regressions\": [" + (regressions.empty() ? std::string() : "\n" + regressions + "\n  ") + "]";
+	}
+	json += "\n}\n";
+
+	std::fputs(json.c_str(), stdout);
+	if (!output_file.empty()) {
+		FILE *file = std::fopen(output_file.c_str(), "w");
+		if (!file || std::fputs(json.c_str(), file) < 0) {
+			std::fprintf(stderr, "Could not write %s\n", output_file.c_str());
+			if (file) std::fclose(file);
+			return -1;
+		}
+		std::fclose(file);
+	}
+
+	return regressions.empty() ? 0 : 1;
+}
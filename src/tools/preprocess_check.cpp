@@ -0,0 +1,247 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_preprocess_check: Check that the fused eye preprocessing (camux::EyePreprocessor) gives
+// what the OpenCV call sequence it replaced in Eye::_gradientIntersectionIsolation gave, in both its
+// scalar and SSE2 paths, and time all three.
+//
+// Usage: eye_mouse_preprocess_check [ITERATIONS]
+//   ITERATIONS  Runs of each path per crop size for the timings (default 2000)
+//
+// The crops are synthetic eyes, random noise, and odd shapes (single rows and columns, odd widths,
+// a 400x400 crop), over a range of thresholds. Grayscale, gradients, dark mask and weights must
+// match the OpenCV sequence exactly. The magnitude may be off by a rounding (some OpenCV builds'
+// cv::magnitude isn't correctly rounded, ours is), so the strong gradient lists may only differ
+// in gradients right at the threshold. The scalar and SSE2 paths must agree bit for bit. Exits 1
+// on any mismatch.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/EyePreprocessor.h"
+#include "../camux/FrameSource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Thresholds to check at: (gradient, dark) multiples of the means, the first the controller's start.
+const double THRESHOLDS[][2] = { { 0.3, 0.5 }, { 1.0, 0.8 }, { 2.5, 1.2 }, { 0, 0 }, { 0.7, 3.0 } };
+// How far (relatively) a magnitude may be from OpenCV's, or from the threshold for a gradient only
+// one side kept.
+const double MAGNITUDE_TOLERANCE = 1e-6;
+const double THRESHOLD_TOLERANCE = 1e-5;
+
+/**
+ * What Eye::_gradientIntersectionIsolation computed before the preprocessor, call for call.
+ */
+struct Reference {
+	cv::Mat gray, sobel_x, sobel_y, magnitude, dark, weights;
+	double magnitude_threshold = 0;
+	std::vector<camux::GradientSample> gradients;
+
+	void run(const cv::Mat &eye, double gradient_threshold, double dark_threshold) {
+		cv::Mat grads_to_use, grad_x, grad_y;
+
+		cv::cvtColor(eye, gray, cv::COLOR_BGR2GRAY);
+		cv::Sobel(gray, sobel_x, CV_32F, 1, 0);
+		cv::Sobel(gray, sobel_y, CV_32F, 0, 1);
+		cv::magnitude(sobel_x, sobel_y, magnitude);
+
+		magnitude_threshold = cv::mean(magnitude)[0] * gradient_threshold;
+		cv::threshold(magnitude, grads_to_use, magnitude_threshold, 255, cv::THRESH_TOZERO);
+		cv::divide(sobel_x, grads_to_use, grad_x);
+		cv::divide(sobel_y, grads_to_use, grad_y);
+
+		cv::threshold(gray, dark, cv::mean(gray)[0] * dark_threshold, 255, cv::THRESH_BINARY_INV);
+		cv::dilate(dark, dark, cv::getStructuringElement(cv::MORPH_ELLIPSE, cv::Size(3, 3)));
+
+		gradients.clear();
+		for (int y = 0; y < grads_to_use.rows; ++y) {
+			for (int x = 0; x < grads_to_use.cols; ++x) {
+				if (grads_to_use.at<float>(y, x) <= 0) continue;
+				camux::GradientSample g = { (float) x, (float) y, grad_x.at<float>(y, x), grad_y.at<float>(y, x) };
+				gradients.push_back(g);
+			}
+		}
+
+		gray.convertTo(weights, CV_32F, -1, 255);
+	}
+};
+
+static cv::Mat synthetic_eye(cv::RNG &rng, cv::Size size) {
+	cv::Mat eye(size, CV_8UC3, cv::Scalar(150, 170, 205));
+	cv::Point center(size.width / 2 + rng.uniform(-size.width / 6, size.width / 6 + 1),
+					 size.height / 2 + rng.uniform(-size.height / 8, size.height / 8 + 1));
+	int iris = std::max(1, std::min(size.width, size.height) / 4);
+
+	cv::ellipse(eye, cv::Point(size.width / 2, size.height / 2), cv::Size(size.width * 2 / 5, size.height / 3), 0, 0, 360,
+				cv::Scalar(225, 230, 235), -1);
+	cv::circle(eye, center, iris, cv::Scalar(60, 85, 110), -1);
+	cv::circle(eye, center, std::max(1, iris / 2), cv::Scalar(20, 20, 25), -1);
+	cv::circle(eye, center + cv::Point(iris / 3, -iris / 3), std::max(1, iris / 6), cv::Scalar(250, 250, 250), -1);
+
+	cv::Mat noise(size, CV_16SC3);
+	rng.fill(noise, cv::RNG::NORMAL, 0, 6);
+	cv::add(eye, noise, eye, cv::noArray(), CV_8U);
+	return eye;
+}
+
+static cv::Mat random_crop(cv::RNG &rng, cv::Size size) {
+	cv::Mat crop(size, CV_8UC3);
+	rng.fill(crop, cv::RNG::UNIFORM, 0, 256);
+	return crop;
+}
+
+static bool same(const cv::Mat &a, const cv::Mat &b) {
+	if (a.size() != b.size()) return false;
+	if (a.empty()) return true;
+	cv::Mat fa, fb;
+	a.convertTo(fa, CV_64F);
+	b.convertTo(fb, CV_64F);
+	return cv::norm(fa, fb, cv::NORM_INF) == 0;
+}
+
+static bool identical(const cv::Mat &a, const cv::Mat &b) {
+	if (a.size() != b.size() || a.type() != b.type()) return false;
+	for (int y = 0; y < a.rows; ++y) {
+		if (std::memcmp(a.ptr(y), b.ptr(y), a.cols * a.elemSize())) return false;
+	}
+	return true;
+}
+
+static bool near_threshold(float magnitude, double threshold) {
+	return std::fabs(magnitude - threshold) <= THRESHOLD_TOLERANCE * std::max(1.0, std::fabs(threshold));
+}
+
+// Whether the preprocessor's strong gradients are the reference's, but for ones at the threshold.
+static bool same_gradients(const std::vector<camux::GradientSample> &a, const std::vector<camux::GradientSample> &b,
+						   const cv::Mat &magnitude, double threshold) {
+	size_t i = 0, j = 0;
+	while (i < a.size() || j < b.size()) {
+		bool in_a = i < a.size(), in_b = j < b.size();
+		if (in_a && in_b && a[i].x == b[j].x && a[i].y == b[j].y) {
+			if (std::fabs(a[i].gx - b[j].gx) > THRESHOLD_TOLERANCE || std::fabs(a[i].gy - b[j].gy) > THRESHOLD_TOLERANCE) return false;
+			++i;
+			++j;
+			continue;
+		}
+
+		// Take whichever comes first in row-major order; it's only in one of the lists.
+		bool a_first = in_a && (!in_b || a[i].y < b[j].y || (a[i].y == b[j].y && a[i].x < b[j].x));
+		const camux::GradientSample &g = a_first ? a[i++] : b[j++];
+		if (!near_threshold(magnitude.at<float>((int) g.y, (int) g.x), threshold)) return false;
+	}
+	return true;
+}
+
+static bool same_samples(const std::vector<camux::GradientSample> &a, const std::vector<camux::GradientSample> &b) {
+	return a.size() == b.size() && (a.empty() || !std::memcmp(a.data(), b.data(), a.size() * sizeof(a[0])));
+}
+
+// Check one crop at every threshold. Returns the number of mismatches.
+static int check(const char *name, const cv::Mat &eye, camux::EyePreprocessor &scalar, camux::EyePreprocessor &vectorized) {
+	Reference reference;
+	std::vector<camux::GradientSample> scalar_gradients, vectorized_gradients;
+	int failures = 0;
+
+	for (size_t t = 0; t < sizeof(THRESHOLDS) / sizeof(THRESHOLDS[0]); ++t) {
+		double gradient_threshold = THRESHOLDS[t][0], dark_threshold = THRESHOLDS[t][1];
+		reference.run(eye, gradient_threshold, dark_threshold);
+		scalar.run(eye, gradient_threshold, dark_threshold, scalar_gradients);
+		vectorized.run(eye, gradient_threshold, dark_threshold, vectorized_gradients);
+
+		std::string bad;
+		if (!same(scalar.getGray(), reference.gray)) bad += " gray";
+		if (!same(scalar.getGradientX(), reference.sobel_x)) bad += " sobel_x";
+		if (!same(scalar.getGradientY(), reference.sobel_y)) bad += " sobel_y";
+		if (!eye.empty() && cv::norm(scalar.getMagnitude(), reference.magnitude, cv::NORM_INF | cv::NORM_RELATIVE) > MAGNITUDE_TOLERANCE) {
+			bad += " magnitude";
+		}
+		if (!same(scalar.getDark(), reference.dark)) bad += " dark";
+		if (!same(scalar.getWeights(), reference.weights)) bad += " weights";
+		if (!near_threshold(scalar.getMagnitudeThreshold(), reference.magnitude_threshold)) bad += " magnitude_threshold";
+		if (!same_gradients(scalar_gradients, reference.gradients, reference.magnitude, reference.magnitude_threshold)) {
+			bad += " gradients";
+		}
+
+		if (!identical(scalar.getGray(), vectorized.getGray()) || !identical(scalar.getGradientX(), vectorized.getGradientX()) ||
+			!identical(scalar.getGradientY(), vectorized.getGradientY()) || !identical(scalar.getMagnitude(), vectorized.getMagnitude()) ||
+			!identical(scalar.getDark(), vectorized.getDark()) || !identical(scalar.getWeights(), vectorized.getWeights()) ||
+			!same_samples(scalar_gradients, vectorized_gradients)) {
+			bad += " scalar!=vectorized";
+		}
+
+		if (!bad.empty()) {
+			std::printf("MISMATCH %s %dx%d thresholds %.1f/%.1f:%s\n", name, eye.cols, eye.rows, gradient_threshold, dark_threshold,
+						bad.c_str());
+			++failures;
+		}
+	}
+	return failures;
+}
+
+// Microseconds per crop for each path.
+static void time_paths(const cv::Mat &eye, int iterations) {
+	Reference reference;
+	camux::EyePreprocessor scalar, vectorized;
+	scalar.setVectorized(false);
+	std::vector<camux::GradientSample> gradients;
+	double gradient_threshold = THRESHOLDS[0][0], dark_threshold = THRESHOLDS[0][1];
+
+	int64_t start = camux::steadyMicros();
+	for (int i = 0; i < iterations; ++i) reference.run(eye, gradient_threshold, dark_threshold);
+	double reference_us = (double) (camux::steadyMicros() - start) / iterations;
+
+	start = camux::steadyMicros();
+	for (int i = 0; i < iterations; ++i) scalar.run(eye, gradient_threshold, dark_threshold, gradients);
+	double scalar_us = (double) (camux::steadyMicros() - start) / iterations;
+
+	start = camux::steadyMicros();
+	for (int i = 0; i < iterations; ++i) vectorized.run(eye, gradient_threshold, dark_threshold, gradients);
+	double vectorized_us = (double) (camux::steadyMicros() - start) / iterations;
+
+	std::printf("%4dx%-4d  opencv %8.1f us  scalar %8.1f us (%4.1fx)  %s %8.1f us (%4.1fx)\n", eye.cols, eye.rows, reference_us,
+				scalar_us, reference_us / scalar_us, vectorized.isVectorized() ? "sse2" : "(none)", vectorized_us,
+				reference_us / vectorized_us);
+}
+
+int main(int argc, char **argv) {
+	int iterations = argc > 1 ? std::atoi(argv[1]) : 2000;
+	if (iterations <= 0) {
+		std::fprintf(stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+		return -1;
+	}
+
+	camux::EyePreprocessor scalar, vectorized;
+	scalar.setVectorized(false);
+	if (!vectorized.isVectorized()) std::printf("No SSE2 kernels in this build; checking the scalar path only\n");
+
+	// Pipeline crops are 64 wide; the rest are edge cases for the borders and the vector loops' tails.
+	const cv::Size sizes[] = {
+		cv::Size(64, 40), cv::Size(64, 33), cv::Size(63, 41), cv::Size(65, 24), cv::Size(17, 9), cv::Size(16, 16),
+		cv::Size(9, 5), cv::Size(1, 1), cv::Size(7, 1), cv::Size(1, 7), cv::Size(2, 2), cv::Size(3, 17), cv::Size(400, 400)
+	};
+
+	cv::RNG rng(0x45ee);
+	int failures = 0, checks = 0;
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		for (int i = 0; i < 4; ++i) {
+			failures += check("synthetic", synthetic_eye(rng, sizes[s]), scalar, vectorized);
+			failures += check("random", random_crop(rng, sizes[s]), scalar, vectorized);
+			checks += 2 * sizeof(THRESHOLDS) / sizeof(THRESHOLDS[0]);
+		}
+	}
+	failures += check("black", cv::Mat(40, 64, CV_8UC3, cv::Scalar::all(0)), scalar, vectorized);
+	failures += check("white", cv::Mat(40, 64, CV_8UC3, cv::Scalar::all(255)), scalar, vectorized);
+	checks += 2 * sizeof(THRESHOLDS) / sizeof(THRESHOLDS[0]);
+	std::printf("%d of %d checks matched\n", checks - failures, checks);
+
+	time_paths(synthetic_eye(rng, cv::Size(64, 40)), iterations);
+	time_paths(synthetic_eye(rng, cv::Size(64, 64)), iterations);
+	time_paths(synthetic_eye(rng, cv::Size(400, 400)), std::max(1, iterations / 40));
+
+	return failures ? 1 : 0;
+}
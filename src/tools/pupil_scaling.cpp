@@ -0,0 +1,116 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_pupil_scaling: How the tile-parallel pupil search (camux::maximizePupilObjectiveParallel)
+// scales with threads on near-eye camera sized crops, and that it finds exactly what the serial
+// search does.
+//
+// Usage: eye_mouse_pupil_scaling [SIZE] [MIN_EFFICIENCY]
+//   SIZE            Width and height of the synthetic eye crop (default 400)
+//   MIN_EFFICIENCY  Fail (exit 1) if the speedup over one thread, divided by the threads, is below
+//                   this at 8 threads (or every core, if fewer), e.g 0.8
+//
+// The crop is a synthetic eye run through the same preprocessing as a real one (camux::EyePreprocessor,
+// at the ThresholdController's starting thresholds). The serial search is timed once, then the
+// parallel one at 1, 2, 4, ... threads up to the core count. Exits 1 if any result differs from the
+// serial one.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/EyePreprocessor.h"
+#include "../camux/FrameSource.h"
+#include "../camux/PupilObjective.h"
+#include "../camux/ThresholdController.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+
+#include <opencv2/core/utility.hpp>
+
+// Runs of each search to take the fastest of.
+const int RUNS = 3;
+
+static cv::Mat synthetic_eye(int size) {
+	cv::Mat eye(size, size, CV_8UC3, cv::Scalar(150, 170, 205));
+	cv::Point center(size / 2 + size / 10, size / 2 - size / 20);
+
+	cv::ellipse(eye, cv::Point(size / 2, size / 2), cv::Size(size * 9 / 20, size / 3), 0, 0, 360, cv::Scalar(225, 230, 235), -1);
+	cv::circle(eye, center, size / 5, cv::Scalar(60, 85, 110), -1);
+	cv::circle(eye, center, size / 12, cv::Scalar(20, 20, 25), -1);
+	cv::circle(eye, center + cv::Point(size / 30, -size / 30), std::max(1, size / 60), cv::Scalar(250, 250, 250), -1);
+
+	cv::Mat noise(eye.size(), CV_16SC3);
+	cv::RNG(7).fill(noise, cv::RNG::NORMAL, 0, 6);
+	cv::add(eye, noise, eye, cv::noArray(), CV_8U);
+	return eye;
+}
+
+// Fastest of RUNS searches, in milliseconds.
+template <typename Search>
+static double time_search(Search search) {
+	double best = 0;
+	for (int i = 0; i < RUNS; ++i) {
+		int64_t start = camux::steadyMicros();
+		search();
+		double ms = (camux::steadyMicros() - start) / 1000.0;
+		best = i == 0 ? ms : std::min(best, ms);
+	}
+	return best;
+}
+
+int main(int argc, char **argv) {
+	int size = argc > 1 ? std::atoi(argv[1]) : 400;
+	double min_efficiency = argc > 2 ? std::atof(argv[2]) : 0;
+	if (size < 8) {
+		std::fprintf(stderr, "Usage: %s [SIZE] [MIN_EFFICIENCY]\n", argv[0]);
+		return -1;
+	}
+
+	camux::ThresholdController thresholds;
+	camux::EyePreprocessor preprocessor;
+	std::vector<camux::GradientSample> gradients;
+	preprocessor.run(synthetic_eye(size), thresholds.getGradientThreshold(), thresholds.getDarkThreshold(), gradients);
+	const cv::Mat &weights = preprocessor.getWeights();
+	const cv::Mat &candidates = preprocessor.getDark();
+	cv::Rect crop(0, 0, size, size);
+
+	std::printf("%dx%d crop, %zu strong gradients, %d candidates\n", size, size, gradients.size(), cv::countNonZero(candidates));
+
+	double serial_score;
+	cv::Point serial;
+	double serial_ms = time_search([&] { serial = camux::maximizePupilObjective(gradients, weights, candidates, crop, serial_score); });
+	std::printf("serial      %9.1f ms  center (%d, %d)\n", serial_ms, serial.x, serial.y);
+
+	int cores = cv::getNumberOfCPUs();
+	int check_threads = std::min(8, cores);
+	double one_thread_ms = 0, check_efficiency = 0;
+	bool mismatch = false;
+
+	for (int threads = 1; threads <= cores; threads = threads < cores ? std::min(threads * 2, cores) : threads + 1) {
+		cv::setNumThreads(threads);
+
+		double score;
+		cv::Point center;
+		double ms = time_search([&] { center = camux::maximizePupilObjectiveParallel(gradients, weights, candidates, crop, score); });
+		if (threads == 1) one_thread_ms = ms;
+
+		double efficiency = one_thread_ms / ms / threads;
+		bool same = center == serial && score == serial_score;
+		mismatch |= !same;
+		if (threads <= check_threads) check_efficiency = efficiency;
+
+		std::printf("%2d threads  %9.1f ms  %5.2fx serial  %5.2fx one thread (%3.0f%% efficient)%s\n", threads, ms, serial_ms / ms,
+					one_thread_ms / ms, efficiency * 100, same ? "" : "  MISMATCH");
+	}
+	cv::setNumThreads(-1);
+
+	if (mismatch) {
+		std::printf("FAIL: the parallel search found a different center or score than the serial one\n");
+		return 1;
+	}
+	if (min_efficiency > 0 && check_efficiency < min_efficiency) {
+		std::printf("FAIL: %.0f%% efficient at %d threads, wanted %.0f%%\n", check_efficiency * 100, check_threads, min_efficiency * 100);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,401 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_soak: Run the tracker for millions of frames, headless, and fail if memory grows or
+// latency drifts. eye_mouse sessions run for 10+ hours; a vector that grows by a point a frame or a
+// buffer that's reallocated a little bigger every so often doesn't show up in a five minute run.
+//
+// Usage: eye_mouse_soak [OPTIONS] [ARCHIVE]
+//   ARCHIVE                  A frame archive recorded with eye_mouse --record, replayed in a loop.
+//                            Without one, frames of a synthetic face looking around (and blinking)
+//                            are used.
+//   --frames N               How many frames to run (default 1000000, ~9 hours of camera at 30 fps)
+//   --window N               Frames per sampling window (default 9000, five minutes at 30 fps)
+//   --profile FILE           Calibration profile to load for an archive, so gaze is mapped (the
+//                            synthetic face is calibrated on the spot)
+//   --max-rss-growth MB      Fail if RSS grows by more than this (default 32)
+//   --max-heap-growth MB     Fail if the malloc heap in use grows by more than this (default 16)
+//   --max-live-allocs N      Fail if the operator new allocations still live grow by more than
+//                            this (default 10000)
+//   --max-p99-drift RATIO    Fail if a stage's p99 latency grows by more than this factor (default 1.5)
+//   --csv FILE               Also write each window's samples as CSV
+//
+// Frames go through the same work as eye_mouse's main loop, minus the windows: the presence
+// scheduler, then Pipeline::process() (detection or tracking, forehead dot, both pupils, gaze
+// mapping) or Pipeline::scan(). Every window it samples RSS, the malloc heap in use, operator new
+// calls and live allocations, and the p50/p99 of each stage's latency. The first window is warm-up
+// (buffers grow to size, caches fill); the second is the baseline the last is checked against. A
+// stage's p99 only counts as drifting if it also grew by more than MIN_DRIFT_US, so stages that
+// take microseconds don't fail on noise.
+//
+// Exits 1 if a bound is exceeded, 2 if the run was too short to check (fewer than three windows).
+// Run from the directory with the model files, like eye_mouse.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../Pipeline.h"
+#include "../camux/CalibrationProfile.h"
+#include "../camux/FrameArchive.h"
+#include "../camux/LatencyHistogram.h"
+#include "../camux/PresenceScheduler.h"
+#include "../camux/SyntheticSource.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <new>
+#include <string>
+#include <vector>
+
+#include <malloc.h>
+#include <unistd.h>
+
+const cv::Size SCREEN(1920, 1080);
+
+// Frame interval given to archive frames whose timestamps don't advance (and across the loop).
+const int64_t FRAME_INTERVAL_US = 33333;
+
+// A stage's p99 must grow by at least this much (as well as by the ratio) to count as drift.
+const int64_t MIN_DRIFT_US = 500;
+
+// Samples per calibration target for the synthetic face, and how long it may take.
+const int CALIBRATION_SAMPLES = 10;
+const int MAX_CALIBRATION_FRAMES = 1000;
+// The synthetic face blinks for BLINK_FRAMES (~130 ms at 30 fps) every BLINK_INTERVAL frames.
+const uint64_t BLINK_INTERVAL = 150;
+const uint64_t BLINK_FRAMES = 4;
+
+// Allocation counters. Every operator new and delete in the process goes through the replacements
+// below, on any thread.
+static std::atomic<uint64_t> allocations(0);
+static std::atomic<uint64_t> deallocations(0);
+
+void * operator new(size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	void *p = std::malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void * operator new[](size_t size) {
+	return operator new(size);
+}
+
+void * operator new(size_t size, const std::nothrow_t &) noexcept {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	return std::malloc(size ? size : 1);
+}
+
+void * operator new[](size_t size, const std::nothrow_t &tag) noexcept {
+	return operator new(size, tag);
+}
+
+void operator delete(void *p) noexcept {
+	if (!p) return;
+	deallocations.fetch_add(1, std::memory_order_relaxed);
+	std::free(p);
+}
+
+void operator delete[](void *p) noexcept {
+	operator delete(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept {
+	operator delete(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept {
+	operator delete(p);
+}
+
+/**
+ * An archive replayed over and over. Timestamps carry on increasing across the loop, so the
+ * presence scheduler (which goes by them) sees one long session.
+ */
+class LoopingArchiveSource : public camux::FrameSource {
+public:
+	bool open(const std::string &path) { return archive_.open(path) && archive_.size() > 0; }
+
+	bool read(camux::Frame &frame) override {
+		size_t i = next_++ % archive_.size();
+		int64_t recorded = archive_.timestamp(i);
+		if (i == 0 || recorded <= last_recorded_) {
+			offset_ = last_us_ + FRAME_INTERVAL_US - recorded;
+		}
+		last_recorded_ = recorded;
+		last_us_ = recorded + offset_;
+
+		frame.image = archive_.frame(i);
+		frame.capture_us = camux::steadyMicros();
+		frame.timestamp_us = last_us_;
+		frame.index = next_ - 1;
+		return true;
+	}
+
+private:
+	camux::FrameArchiveReader archive_;
+	uint64_t next_ = 0;
+	int64_t offset_ = 0;
+	int64_t last_recorded_ = 0;
+	int64_t last_us_ = 0;
+};
+
+enum Stage {
+	DetectStage,
+	ForeheadStage,
+	PupilStage,
+	MapStage,
+	TotalStage,
+	STAGES
+};
+
+const char *STAGE_NAMES[STAGES] = { "detect", "forehead", "pupil", "map", "total" };
+
+// What's sampled at the end of each window.
+struct Window {
+	uint64_t frames;
+	double rss_mb;
+	double heap_mb;
+	int64_t live_allocations;
+	double allocations_per_frame;
+	int64_t p50_us[STAGES];
+	int64_t p99_us[STAGES];
+};
+
+static double rss_mb() {
+	long pages = 0, resident = 0;
+	std::ifstream statm("/proc/self/statm");
+	statm >> pages >> resident;
+	return resident * (double) sysconf(_SC_PAGESIZE) / (1 << 20);
+}
+
+// Bytes malloc has handed out and not had back: cv::Mat buffers and everything operator new
+// allocates. 0 where glibc can't tell us.
+static double heap_mb() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+	struct mallinfo2 info = mallinfo2();
+	return (info.uordblks + info.hblkhd) / 1048576.0;
+#else
+	return 0;
+#endif
+}
+
+// Calibrate the gaze mapper on the synthetic face, like eye_mouse_loopback does.
+static bool calibrate(camux::SyntheticSource &source, Pipeline &pipeline) {
+	camux::Frame frame;
+	camux::GazeSample sample;
+	camux::GazeCalibration calibration(SCREEN, 3, 3, CALIBRATION_SAMPLES);
+	calibration.start();
+
+	for (int i = 0; i < MAX_CALIBRATION_FRAMES && calibration.isRunning(); ++i) {
+		cv::Point2f target = calibration.getTarget();
+		source.setGaze(cv::Point2f(target.x / SCREEN.width * 2 - 1, target.y / SCREEN.height * 2 - 1));
+		source.read(frame);
+		pipeline.process(frame, sample);
+		if (sample.has_offset) calibration.addSample(sample.gaze_offset);
+	}
+	return !calibration.isRunning() && calibration.apply(pipeline.getGazeMapper());
+}
+
+static void usage(const char *name) {
+	std::fprintf(stderr, "Usage: %s [--frames N] [--window N] [--profile FILE] [--max-rss-growth MB] "
+				 "[--max-heap-growth MB] [--max-live-allocs N] [--max-p99-drift RATIO] [--csv FILE] [ARCHIVE]\n", name);
+}
+
+int main(int argc, char **argv) {
+	uint64_t frames = 1000000;
+	uint64_t window_frames = 9000;
+	double max_rss_growth_mb = 32;
+	double max_heap_growth_mb = 16;
+	int64_t max_live_allocations = 10000;
+	double max_p99_drift = 1.5;
+	std::string archive_file, profile_file, csv_file;
+
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool has_value = i + 1 < argc;
+		if (arg == "--frames" && has_value) {
+			frames = std::strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--window" && has_value) {
+			window_frames = std::strtoull(argv[++i], NULL, 10);
+		} else if (arg == "--profile" && has_value) {
+			profile_file = argv[++i];
+		} else if (arg == "--max-rss-growth" && has_value) {
+			max_rss_growth_mb = std::atof(argv[++i]);
+		} else if (arg == "--max-heap-growth" && has_value) {
+			max_heap_growth_mb = std::atof(argv[++i]);
+		} else if (arg == "--max-live-allocs" && has_value) {
+			max_live_allocations = std::atoll(argv[++i]);
+		} else if (arg == "--max-p99-drift" && has_value) {
+			max_p99_drift = std::atof(argv[++i]);
+		} else if (arg == "--csv" && has_value) {
+			csv_file = argv[++i];
+		} else if (arg[0] != '-' && archive_file.empty()) {
+			archive_file = arg;
+		} else {
+			usage(argv[0]);
+			return -1;
+		}
+	}
+	if (frames == 0 || window_frames == 0) {
+		usage(argv[0]);
+		return -1;
+	}
+
+	Pipeline pipeline(HaarCascade);
+
+	camux::SyntheticSource synthetic(cv::Size(640, 480), 0);
+	LoopingArchiveSource archive;
+	camux::FrameSource *source = &synthetic;
+
+	if (!archive_file.empty()) {
+		if (!archive.open(archive_file)) {
+			std::fprintf(stderr, "Could not open frame archive %s\n", archive_file.c_str());
+			return -1;
+		}
+		source = &archive;
+
+		camux::CalibrationProfile profile;
+		if (!profile_file.empty()) {
+			if (!profile.load(profile_file)) {
+				std::fprintf(stderr, "Could not load calibration profile %s\n", profile_file.c_str());
+				return -1;
+			}
+			pipeline.getLeftEye().getThresholdController() = profile.left_thresholds;
+			pipeline.getRightEye().getThresholdController() = profile.right_thresholds;
+			pipeline.getGazeMapper() = profile.gaze;
+		}
+	} else if (!calibrate(synthetic, pipeline)) {
+		std::fprintf(stderr, "Could not calibrate on the synthetic face; gaze mapping won't be exercised\n");
+	}
+
+	FILE *csv = NULL;
+	if (!csv_file.empty()) {
+		csv = std::fopen(csv_file.c_str(), "w");
+		if (!csv) {
+			std::fprintf(stderr, "Could not open %s\n", csv_file.c_str());
+			return -1;
+		}
+		std::fprintf(csv, "frames,rss_mb,heap_mb,live_allocations,allocations_per_frame");
+		for (int s = 0; s < STAGES; ++s) std::fprintf(csv, ",%s_p50_us,%s_p99_us", STAGE_NAMES[s], STAGE_NAMES[s]);
+		std::fprintf(csv, "\n");
+	}
+
+	camux::PresenceScheduler presence;
+	camux::Frame frame;
+	camux::GazeSample sample;
+	camux::LatencyHistogram stages[STAGES];
+	std::vector<Window> windows;
+	windows.reserve(frames / window_frames + 1);
+
+	uint64_t window_start_allocations = allocations.load();
+	uint64_t tracked = 0, scanned = 0, lost = 0;
+
+	std::printf("%10s %9s %9s %11s %9s", "frames", "rss MB", "heap MB", "live allocs", "new/frame");
+	for (int s = 0; s < STAGES; ++s) std::printf(" %9s", (std::string(STAGE_NAMES[s]) + " p99").c_str());
+	std::printf("  (us)\n");
+
+	for (uint64_t i = 1; i <= frames; ++i) {
+		// Look around, so the pupils, blinks and gaze all move.
+		synthetic.setGaze(cv::Point2f(std::sin(i * .05) * .7, std::sin(i * .031) * .5));
+		synthetic.setEyesClosed(i % BLINK_INTERVAL < BLINK_FRAMES);
+		if (!source->read(frame)) break;
+
+		camux::PresenceScheduler::Action action = presence.next(frame);
+		if (action == camux::PresenceScheduler::Scan) {
+			pipeline.scan(frame, presence.getScanScale(), sample);
+			presence.update(sample.face_found);
+			++scanned;
+		} else if (action == camux::PresenceScheduler::Track) {
+			pipeline.process(frame, sample);
+			presence.update(sample.face_found);
+			++tracked;
+			lost += !sample.face_found;
+
+			stages[DetectStage].add(sample.detect_us);
+			stages[ForeheadStage].add(sample.forehead_us);
+			stages[PupilStage].add(sample.pupil_us);
+			stages[MapStage].add(sample.map_us);
+			stages[TotalStage].add(sample.done_us - sample.capture_us);
+		}
+
+		if (i % window_frames != 0 && i != frames) continue;
+
+		Window window;
+		uint64_t total_allocations = allocations.load();
+		window.frames = i;
+		window.rss_mb = rss_mb();
+		window.heap_mb = heap_mb();
+		window.live_allocations = (int64_t) (total_allocations - deallocations.load());
+		window.allocations_per_frame = (double) (total_allocations - window_start_allocations) /
+									   (i - (windows.empty() ? 0 : windows.back().frames));
+		window_start_allocations = total_allocations;
+		for (int s = 0; s < STAGES; ++s) {
+			window.p50_us[s] = stages[s].percentile(.5);
+			window.p99_us[s] = stages[s].percentile(.99);
+			stages[s].reset();
+		}
+		windows.push_back(window);
+
+		std::printf("%10llu %9.1f %9.1f %11lld %9.1f", (unsigned long long) window.frames, window.rss_mb,
+					window.heap_mb, (long long) window.live_allocations, window.allocations_per_frame);
+		for (int s = 0; s < STAGES; ++s) std::printf(" %9lld", (long long) window.p99_us[s]);
+		std::printf("\n");
+		std::fflush(stdout);
+
+		if (csv) {
+			std::fprintf(csv, "%llu,%.2f,%.2f,%lld,%.2f", (unsigned long long) window.frames, window.rss_mb,
+						 window.heap_mb, (long long) window.live_allocations, window.allocations_per_frame);
+			for (int s = 0; s < STAGES; ++s) {
+				std::fprintf(csv, ",%lld,%lld", (long long) window.p50_us[s], (long long) window.p99_us[s]);
+			}
+			std::fprintf(csv, "\n");
+			std::fflush(csv);
+		}
+	}
+	if (csv) std::fclose(csv);
+
+	std::printf("\n%llu frames tracked (%llu without a face), %llu scans\n", (unsigned long long) tracked,
+				(unsigned long long) lost, (unsigned long long) scanned);
+
+	if (windows.size() < 3) {
+		std::fprintf(stderr, "Too few windows to check for growth (need 3, have %zu); run more frames or "
+					 "use a smaller --window\n", windows.size());
+		return 2;
+	}
+
+	const Window &baseline = windows[1];
+	const Window &last = windows.back();
+	bool failed = false;
+
+	double rss_growth = last.rss_mb - baseline.rss_mb;
+	double heap_growth = last.heap_mb - baseline.heap_mb;
+	int64_t live_growth = last.live_allocations - baseline.live_allocations;
+	std::printf("rss growth:         %+.1f MB (max %.1f)\n", rss_growth, max_rss_growth_mb);
+	std::printf("heap growth:        %+.1f MB (max %.1f)\n", heap_growth, max_heap_growth_mb);
+	std::printf("live alloc growth:  %+lld (max %lld)\n", (long long) live_growth, (long long) max_live_allocations);
+	if (rss_growth > max_rss_growth_mb) {
+		std::fprintf(stderr, "RSS grew by %.1f MB\n", rss_growth);
+		failed = true;
+	}
+	if (heap_growth > max_heap_growth_mb) {
+		std::fprintf(stderr, "The heap grew by %.1f MB\n", heap_growth);
+		failed = true;
+	}
+	if (live_growth > max_live_allocations) {
+		std::fprintf(stderr, "%lld more allocations are live than at the baseline\n", (long long) live_growth);
+		failed = true;
+	}
+
+	for (int s = 0; s < STAGES; ++s) {
+		int64_t before = baseline.p99_us[s], after = last.p99_us[s];
+		std::printf("%-9s p99:      %lld -> %lld us\n", STAGE_NAMES[s], (long long) before, (long long) after);
+		if (after > before * max_p99_drift && after - before > MIN_DRIFT_US) {
+			std::fprintf(stderr, "%s p99 latency drifted from %lld to %lld us\n", STAGE_NAMES[s],
+						 (long long) before, (long long) after);
+			failed = true;
+		}
+	}
+	return failed ? 1 : 0;
+}
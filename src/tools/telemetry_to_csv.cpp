@@ -0,0 +1,77 @@
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+//
+// eye_mouse_telemetry: Convert a binary telemetry log written by eye_mouse to CSV.
+//
+// Usage: eye_mouse_telemetry <LOG_FILE> [CSV_FILE]
+//   Writes to stdout if no CSV file is given. Records are written oldest first.
+//
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include "../camux/Telemetry.h"
+
+#include <fstream>
+#include <iostream>
+
+int main(int argc, char **argv) {
+	if (argc < 2 || argc > 3) {
+		std::cerr << "Usage: eye_mouse_telemetry <LOG_FILE> [CSV_FILE]" << std::endl;
+		return -1;
+	}
+
+	camux::TelemetryReader reader;
+	if (!reader.open(argv[1])) {
+		std::cerr << "Could not open telemetry log " << argv[1] << std::endl;
+		return -1;
+	}
+
+	std::ofstream file;
+	if (argc == 3) {
+		file.open(argv[2]);
+		if (!file) {
+			std::cerr << "Could not write " << argv[2] << std::endl;
+			return -1;
+		}
+	}
+	std::ostream &out = argc == 3 ? file : std::cout;
+
+	out << "frame,timestamp_us,"
+		<< "face_x,face_y,face_w,face_h,face_conf,"
+		<< "leye_x,leye_y,leye_w,leye_h,leye_conf,"
+		<< "reye_x,reye_y,reye_w,reye_h,reye_conf,"
+		<< "lpupil_x,lpupil_y,rpupil_x,rpupil_y,forehead_x,forehead_y,"
+		<< "calibration_frame,face_found,ran_detector,leye_closed,reye_closed,calibrating,calibrated,"
+		<< "detect_us,forehead_us,pupil_us,frame_us,latency_us,cursor_us,gaze_mapped,gaze_x,gaze_y\n";
+
+	// The records in the log now; any the tracker writes while we dump are left for the next run.
+	uint64_t records = reader.snapshot();
+	uint64_t skipped = 0;
+	camux::TelemetryRecord r;
+	for (uint64_t i = 0; i < records; ++i) {
+		// Records the tracker overwrote while we were reading them are skipped.
+		if (!reader.read(i, r)) {
+			++skipped;
+			continue;
+		}
+
+		out << r.frame << ',' << r.timestamp_us << ','
+			<< r.face[0] << ',' << r.face[1] << ',' << r.face[2] << ',' << r.face[3] << ',' << r.face_confidence << ','
+			<< r.left_eye[0] << ',' << r.left_eye[1] << ',' << r.left_eye[2] << ',' << r.left_eye[3] << ','
+			<< r.left_eye_confidence << ','
+			<< r.right_eye[0] << ',' << r.right_eye[1] << ',' << r.right_eye[2] << ',' << r.right_eye[3] << ','
+			<< r.right_eye_confidence << ','
+			<< r.left_pupil[0] << ',' << r.left_pupil[1] << ',' << r.right_pupil[0] << ',' << r.right_pupil[1] << ','
+			<< r.forehead[0] << ',' << r.forehead[1] << ','
+			<< r.calibration_frame << ','
+			<< !!(r.flags & camux::FaceFound) << ',' << !!(r.flags & camux::RanDetector) << ','
+			<< !!(r.flags & camux::LeftEyeClosed) << ',' << !!(r.flags & camux::RightEyeClosed) << ','
+			<< !!(r.flags & camux::Calibrating) << ',' << !!(r.flags & camux::Calibrated) << ','
+			<< r.detect_us << ',' << r.forehead_us << ',' << r.pupil_us << ',' << r.frame_us << ','
+			<< r.latency_us << ',' << r.cursor_us << ','
+			<< !!(r.flags & camux::GazeMapped) << ',' << r.gaze[0] << ',' << r.gaze[1] << '\n';
+	}
+
+	if (skipped) {
+		std::cerr << skipped << " records were overwritten while reading and skipped" << std::endl;
+	}
+	return 0;
+}